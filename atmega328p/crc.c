@@ -17,3 +17,13 @@ modbus_rtu_crc_t modbus_rtu_calc_crc(const uint8_t *begin, const uint8_t *end)
         crc = _crc16_update(crc, *begin++);
     return WORD_TO_CRC(crc);
 }
+
+modbus_rtu_crc_t modbus_rtu_crc_continue(
+    modbus_rtu_crc_t crc, const uint8_t *begin, const uint8_t *end)
+{
+    uint16_t crc16 = CRC_TO_WORD(crc);
+
+    while (begin != end)
+        crc16 = _crc16_update(crc16, *begin++);
+    return WORD_TO_CRC(crc16);
+}
@@ -6,3 +6,13 @@
 
 modbus_rtu_crc_t crc16_update(modbus_rtu_crc_t, uint8_t data);
 modbus_rtu_crc_t modbus_rtu_calc_crc(const uint8_t *begin, const uint8_t *end);
+
+/* initial value, CRC of data scattered over several buffers is computed by
+ * continuing from previous result:
+ * crc = MODBUS_RTU_CRC_INIT; crc = modbus_rtu_crc_continue(crc, b0, e0); ...
+ * */
+#define MODBUS_RTU_CRC_INIT                                                    \
+    ((modbus_rtu_crc_t){.low = UINT8_C(0xFF), .high = UINT8_C(0xFF)})
+
+modbus_rtu_crc_t modbus_rtu_crc_continue(
+    modbus_rtu_crc_t, const uint8_t *begin, const uint8_t *end);
@@ -67,13 +67,11 @@ modbus_rtu_crc_t crc16_update(const modbus_rtu_crc_t crc, const uint8_t data)
     return (modbus_rtu_crc_t){.low = LOW_BYTE(crc16), .high = HIGH_BYTE(crc16)};
 }
 
-modbus_rtu_crc_t modbus_rtu_calc_crc(const uint8_t *begin, const uint8_t *end)
+modbus_rtu_crc_t modbus_rtu_crc_continue(
+    const modbus_rtu_crc_t crc, const uint8_t *begin, const uint8_t *end)
 {
-    if (!begin || !end)
-        return (modbus_rtu_crc_t){.low = UINT8_C(0xFF), .high = UINT8_C(0xFF)};
-
-    uint8_t low  = UINT8_C(0xFF);
-    uint8_t high = UINT8_C(0xFF);
+    uint8_t low  = crc.low;
+    uint8_t high = crc.high;
 
     while (begin != end)
     {
@@ -85,3 +83,11 @@ modbus_rtu_crc_t modbus_rtu_calc_crc(const uint8_t *begin, const uint8_t *end)
 
     return (modbus_rtu_crc_t){.low = low, .high = high};
 }
+
+modbus_rtu_crc_t modbus_rtu_calc_crc(const uint8_t *begin, const uint8_t *end)
+{
+    if (!begin || !end)
+        return (modbus_rtu_crc_t){.low = UINT8_C(0xFF), .high = UINT8_C(0xFF)};
+
+    return modbus_rtu_crc_continue(MODBUS_RTU_CRC_INIT, begin, end);
+}
@@ -1,5 +1,8 @@
 #define _GNU_SOURCE
 
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -13,3 +16,15 @@ int gnu_ptsname_r(int fd, char *buf, size_t buflen)
     return ptsname_r(fd, buf, buflen);
 }
 int gnu_pipe2(int pipefd[2], int flags) { return pipe2(pipefd, flags); }
+int gnu_ppoll(
+    struct pollfd *fds, unsigned long nfds, const struct timespec *timeout)
+{
+    return ppoll(fds, nfds, timeout, NULL);
+}
+int gnu_pin_thread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
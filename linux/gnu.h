@@ -2,8 +2,16 @@
 
 // warppers around GNU/XOPEN/POSIX extensions
 
+struct pollfd;
+struct timespec;
+
 int gnu_thread_id(void);
 int gnu_grantpt(int fd);
 int gnu_unlockpt(int fd);
 int gnu_ptsname_r(int fd, char *buf, size_t buflen);
 int gnu_pipe2(int pipefd[2], int flags);
+// NULL == timeout: wait infinitely
+int gnu_ppoll(
+    struct pollfd *fds, unsigned long nfds, const struct timespec *timeout);
+// pin calling thread to cpu, return: 0 or error number
+int gnu_pin_thread(int cpu);
@@ -0,0 +1,416 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "log.h"
+#include "master.h"
+#include "master_async.h"
+#include "rtu_impl.h"
+#include "time_util.h"
+#include "tty.h"
+#include "util.h"
+
+#define EVENTS_MAX 16
+
+#define EXCEPTION_FLAG UINT8_C(0x80)
+#define HEADER_SIZE    (sizeof(modbus_rtu_addr_t) + sizeof(modbus_rtu_fcode_t))
+#define EXCEPTION_SIZE (HEADER_SIZE + sizeof(modbus_rtu_ecode_t) + 2)
+
+// epoll_data.u64: bus pointer | tag
+#define TAG_TTY   UINT64_C(0)
+#define TAG_TIMER UINT64_C(1)
+#define TAG_MASK  UINT64_C(1)
+
+STATIC_ASSERT(_Alignof(master_async_bus_t) > TAG_MASK, "bus alignment");
+
+void master_async_init(master_async_t *engine)
+{
+    CHECK(engine);
+    memset(engine, 0, sizeof(master_async_t));
+    CHECK_ERRNO(-1 != (engine->epoll_fd = epoll_create1(EPOLL_CLOEXEC)));
+}
+
+void master_async_deinit(master_async_t *engine)
+{
+    if (!engine) return;
+    if (-1 != engine->epoll_fd) CHECK_ERRNO(!close(engine->epoll_fd));
+    engine->epoll_fd = -1;
+}
+
+static void epoll_update(master_async_bus_t *bus, int op)
+{
+    struct epoll_event event
+        = {.events = EPOLLIN | (bus->wait_writable ? EPOLLOUT : 0),
+           .data   = {.u64 = (uintptr_t)bus | TAG_TTY}};
+
+    CHECK_ERRNO(!epoll_ctl(bus->engine->epoll_fd, op, bus->dev->fd, &event));
+}
+
+void master_async_bus_init(
+    master_async_bus_t *bus,
+    master_async_t *engine,
+    tty_dev_t *dev,
+    speed_t rate,
+    int timeout_exec_ms)
+{
+    CHECK(bus);
+    CHECK(engine);
+    CHECK(dev);
+    CHECK(-1 != dev->fd);
+    CHECK(!dev->framing_vtime);
+
+    memset(bus, 0, sizeof(master_async_bus_t));
+    bus->engine          = engine;
+    bus->dev             = dev;
+    bus->rate            = rate;
+    bus->timeout_exec_ms = timeout_exec_ms;
+    bus->turnaround_us   = calc_3t5_us(rate);
+    bus->state           = MASTER_ASYNC_BUS_idle;
+    CHECK_ERRNO(
+        -1
+        != (bus->timer_fd = timerfd_create(
+                CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)));
+
+    struct epoll_event event
+        = {.events = EPOLLIN, .data = {.u64 = (uintptr_t)bus | TAG_TIMER}};
+
+    CHECK_ERRNO(
+        !epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, bus->timer_fd, &event));
+    epoll_update(bus, EPOLL_CTL_ADD);
+}
+
+static void complete(master_async_req_t *req, master_async_result_t result)
+{
+    req->result             = result;
+    req->timing.complete_ns = timestamp_ns();
+    if (req->cb) req->cb(req);
+}
+
+void master_async_bus_deinit(master_async_bus_t *bus)
+{
+    if (!bus || !bus->engine) return;
+
+    if (MASTER_ASYNC_BUS_failed != bus->state)
+    {
+        CHECK_ERRNO(!epoll_ctl(
+            bus->engine->epoll_fd, EPOLL_CTL_DEL, bus->dev->fd, NULL));
+    }
+    CHECK_ERRNO(!epoll_ctl(
+        bus->engine->epoll_fd, EPOLL_CTL_DEL, bus->timer_fd, NULL));
+    CHECK_ERRNO(!close(bus->timer_fd));
+    bus->timer_fd = -1;
+
+    if (bus->curr) complete(bus->curr, MASTER_ASYNC_cancelled);
+    bus->curr = NULL;
+
+    while (bus->queue.head)
+    {
+        master_async_req_t *req = bus->queue.head;
+
+        bus->queue.head = req->next;
+        complete(req, MASTER_ASYNC_cancelled);
+    }
+    bus->engine = NULL;
+}
+
+static void timer_arm(master_async_bus_t *bus, int64_t deadline_ns)
+{
+    const struct itimerspec spec
+        = {.it_interval = {0, 0}, .it_value = ns_to_timespec(deadline_ns)};
+
+    CHECK_ERRNO(
+        !timerfd_settime(bus->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL));
+}
+
+static void turnaround(master_async_bus_t *bus)
+{
+    bus->curr  = NULL;
+    bus->state = MASTER_ASYNC_BUS_turnaround;
+    timer_arm(bus, timestamp_ns() + (int64_t)bus->turnaround_us * 1000);
+}
+
+static void finish(master_async_bus_t *bus, master_async_result_t result)
+{
+    master_async_req_t *req = bus->curr;
+
+    // callback can submit next request
+    turnaround(bus);
+    ++bus->engine->completed;
+    complete(req, result);
+}
+
+// failed bus: queued requests are completed from timer (not from submit)
+static void fail_queued(master_async_bus_t *bus)
+{
+    master_async_req_t *req = bus->queue.head;
+
+    // callbacks can resubmit, they are completed on next expiry
+    bus->queue.head = NULL;
+    bus->queue.tail = NULL;
+
+    while (req)
+    {
+        master_async_req_t *next = req->next;
+
+        ++bus->engine->completed;
+        complete(req, MASTER_ASYNC_bus_error);
+        req = next;
+    }
+}
+
+/* tty is not usable anymore (hang up, error), level triggered events would
+ * be reported forever, so tty is removed from epoll */
+static void bus_error(master_async_bus_t *bus)
+{
+    master_async_req_t *req = bus->curr;
+
+    logE("%d bus error", bus->dev->fd);
+    CHECK_ERRNO(!epoll_ctl(
+        bus->engine->epoll_fd, EPOLL_CTL_DEL, bus->dev->fd, NULL));
+    bus->curr          = NULL;
+    bus->state         = MASTER_ASYNC_BUS_failed;
+    bus->wait_writable = 0;
+    timer_arm(bus, timestamp_ns());
+
+    if (!req) return;
+    ++bus->engine->completed;
+    complete(req, MASTER_ASYNC_bus_error);
+}
+
+static void tx_done(master_async_bus_t *bus)
+{
+    master_async_req_t *req = bus->curr;
+
+    req->timing.tx_end_ns = timestamp_ns();
+
+    if (!req->rx_size)
+    {
+        finish(bus, MASTER_ASYNC_ok);
+        return;
+    }
+
+    /* request still has to leave the wire, then reply has to be transmitted
+     * (including slave processing time) */
+    const int64_t timeout_us = calc_tmin_us(bus->rate, req->tx_size)
+        + calc_tmax_us(bus->rate, req->rx_size)
+        + (int64_t)bus->timeout_exec_ms * 1000;
+
+    bus->state = MASTER_ASYNC_BUS_rx;
+    timer_arm(bus, req->timing.tx_end_ns + timeout_us * 1000);
+}
+
+static void tx(master_async_bus_t *bus)
+{
+    master_async_req_t *req = bus->curr;
+    const ssize_t r         = write(
+        bus->dev->fd, req->tx + bus->tx_written,
+        req->tx_size - bus->tx_written);
+
+    if (-1 == r && EAGAIN != errno && EINTR != errno)
+    {
+        logE("%d write failed %s", bus->dev->fd, strerror(errno));
+        bus_error(bus);
+        return;
+    }
+    if (-1 != r) bus->tx_written += (size_t)r;
+
+    const int wait_writable = req->tx_size != bus->tx_written;
+
+    if (wait_writable != bus->wait_writable)
+    {
+        bus->wait_writable = wait_writable;
+        epoll_update(bus, EPOLL_CTL_MOD);
+    }
+
+    if (!wait_writable) tx_done(bus);
+}
+
+static void start_next(master_async_bus_t *bus)
+{
+    if (MASTER_ASYNC_BUS_failed == bus->state && bus->queue.head)
+        timer_arm(bus, timestamp_ns());
+    if (MASTER_ASYNC_BUS_idle != bus->state || !bus->queue.head) return;
+
+    master_async_req_t *req = bus->queue.head;
+
+    bus->queue.head = req->next;
+    if (!bus->queue.head) bus->queue.tail = NULL;
+    req->next = NULL;
+
+    // discard late replies of previous requests
+    tty_flush_rx(bus->dev->fd);
+
+    bus->curr               = req;
+    bus->tx_written         = 0;
+    bus->state              = MASTER_ASYNC_BUS_tx;
+    req->timing.tx_begin_ns = timestamp_ns();
+    tx(bus);
+}
+
+void master_async_submit(master_async_bus_t *bus, master_async_req_t *req)
+{
+    CHECK(bus);
+    CHECK(bus->engine);
+    CHECK(req);
+    CHECK(req->tx);
+    CHECK(req->tx_size);
+    CHECK(!req->rx_size || req->rx);
+
+    req->result             = MASTER_ASYNC_ok;
+    req->ecode              = 0;
+    req->rx_received        = 0;
+    req->timing.submit_ns   = timestamp_ns();
+    req->timing.tx_begin_ns = -1;
+    req->timing.tx_end_ns   = -1;
+    req->timing.rx_begin_ns = -1;
+    req->timing.complete_ns = -1;
+    req->next               = NULL;
+
+    if (bus->queue.tail) bus->queue.tail->next = req;
+    else bus->queue.head = req;
+    bus->queue.tail = req;
+
+    start_next(bus);
+}
+
+int master_async_bus_idle(const master_async_bus_t *bus)
+{
+    CHECK(bus);
+    return MASTER_ASYNC_BUS_idle == bus->state && !bus->queue.head;
+}
+
+// exception reply is shorter, dont wait for expected size
+static size_t rx_expected(const master_async_req_t *req)
+{
+    if (HEADER_SIZE > req->rx_received) return req->rx_size;
+    if (!(EXCEPTION_FLAG & (uint8_t)req->rx[sizeof(modbus_rtu_addr_t)]))
+        return req->rx_size;
+    return min(req->rx_size, EXCEPTION_SIZE);
+}
+
+static void rx(master_async_bus_t *bus)
+{
+    master_async_req_t *req = bus->curr;
+
+    if (MASTER_ASYNC_BUS_rx != bus->state)
+    {
+        // nobody is waiting for these bytes
+        char discard[ADU_CAPACITY];
+        const ssize_t r = read(bus->dev->fd, discard, sizeof(discard));
+
+        if (!r) bus_error(bus);
+        else if (-1 == r) CHECK_ERRNO(EAGAIN == errno || EINTR == errno);
+        else logD("%d discarded %zd bytes", bus->dev->fd, r);
+        return;
+    }
+
+    const ssize_t r = read(
+        bus->dev->fd, req->rx + req->rx_received,
+        rx_expected(req) - req->rx_received);
+
+    if (-1 == r)
+    {
+        CHECK_ERRNO(EAGAIN == errno || EINTR == errno);
+        return;
+    }
+
+    // EOF: tty hung up
+    if (!r)
+    {
+        bus_error(bus);
+        return;
+    }
+
+    if (!req->rx_received) req->timing.rx_begin_ns = timestamp_ns();
+    req->rx_received += (size_t)r;
+
+    const size_t expected = rx_expected(req);
+
+    if (expected > req->rx_received) return;
+
+    if (expected != req->rx_size)
+    {
+        const char *const ecode = find_ecode(req->rx, req->rx + expected);
+
+        if (ecode) req->ecode = (modbus_rtu_ecode_t)*ecode;
+        finish(bus, ecode ? MASTER_ASYNC_exception : MASTER_ASYNC_crc_error);
+        return;
+    }
+
+    finish(
+        bus,
+        valid_crc(req->rx, req->rx_size) ? MASTER_ASYNC_ok
+                                         : MASTER_ASYNC_crc_error);
+}
+
+static void timer_expired(master_async_bus_t *bus)
+{
+    uint64_t expirations = 0;
+
+    if (-1 == read(bus->timer_fd, &expirations, sizeof(expirations)))
+    {
+        CHECK_ERRNO(EAGAIN == errno || EINTR == errno);
+        return;
+    }
+
+    if (MASTER_ASYNC_BUS_rx == bus->state)
+    {
+        finish(bus, MASTER_ASYNC_timeout);
+    }
+    else if (MASTER_ASYNC_BUS_failed == bus->state)
+    {
+        fail_queued(bus);
+    }
+    else if (MASTER_ASYNC_BUS_turnaround == bus->state)
+    {
+        bus->state = MASTER_ASYNC_BUS_idle;
+        start_next(bus);
+    }
+}
+
+int master_async_run(master_async_t *engine, int timeout_ms)
+{
+    CHECK(engine);
+
+    struct epoll_event events[EVENTS_MAX];
+
+    engine->completed = 0;
+
+    const int n = epoll_wait(engine->epoll_fd, events, EVENTS_MAX, timeout_ms);
+
+    if (-1 == n)
+    {
+        CHECK_ERRNO(EINTR == errno);
+        return 0;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        const uint64_t data     = events[i].data.u64;
+        master_async_bus_t *bus = (master_async_bus_t *)(uintptr_t)(
+            data & ~TAG_MASK);
+
+        if (TAG_TIMER == (data & TAG_MASK))
+        {
+            timer_expired(bus);
+            continue;
+        }
+
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+        {
+            // tty events of failed bus reported by same epoll_wait()
+            if (MASTER_ASYNC_BUS_failed != bus->state) bus_error(bus);
+            continue;
+        }
+        if (events[i].events & EPOLLOUT && MASTER_ASYNC_BUS_tx == bus->state)
+            tx(bus);
+        if (events[i].events & EPOLLIN && MASTER_ASYNC_BUS_failed != bus->state)
+            rx(bus);
+    }
+    return engine->completed;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rtu.h"
+#include "tty.h"
+
+/* event driven (epoll) master engine, single thread can drive many buses
+ *
+ * - requests (raw ADUs, CRC included) are queued per bus (tty_dev_t) and
+ *   executed one at a time: write, wait for reply (response timer), keep
+ *   silent interval (turnaround timer, turnaround_us) before next request
+ * - timers are timerfd based (CLOCK_MONOTONIC, absolute)
+ * - completion callback is called from master_async_run() with result and
+ *   timing, request can be resubmitted from the callback
+ * - exception reply is recognized after address and function code, request
+ *   completes without waiting for expected reply size
+ *
+ * NOTE: tty has to be in non-blocking mode (default, see tty_framing_on()) */
+
+typedef enum
+{
+    MASTER_ASYNC_ok = 0,
+    // no (complete) reply until response deadline
+    MASTER_ASYNC_timeout,
+    // complete reply received, CRC mismatch
+    MASTER_ASYNC_crc_error,
+    // exception reply, see ecode
+    MASTER_ASYNC_exception,
+    /* tty hung up or failed (EPOLLHUP/EPOLLERR, EOF, write error), bus is
+     * detached from engine, queued and later requests complete with it */
+    MASTER_ASYNC_bus_error,
+    // request was in progress/queued when bus was deinitialized
+    MASTER_ASYNC_cancelled
+} master_async_result_t;
+
+struct master_async_req;
+
+typedef void (*master_async_cb_t)(struct master_async_req *);
+
+typedef struct master_async_req
+{
+    // request ADU, valid until completion
+    const char *tx;
+    size_t tx_size;
+    // expected reply size, 0: no reply (broadcast)
+    char *rx;
+    size_t rx_size;
+    master_async_cb_t cb;
+    void *user_data;
+    /* begin: completion */
+    master_async_result_t result;
+    // MASTER_ASYNC_exception only
+    modbus_rtu_ecode_t ecode;
+    // number of reply bytes received
+    size_t rx_received;
+    // timestamp_ns(), -1: did not happen
+    struct
+    {
+        int64_t submit_ns;
+        int64_t tx_begin_ns;
+        // last byte handed over to driver
+        int64_t tx_end_ns;
+        // first reply byte
+        int64_t rx_begin_ns;
+        int64_t complete_ns;
+    } timing;
+    /* end: completion */
+    // private
+    struct master_async_req *next;
+} master_async_req_t;
+
+typedef struct master_async
+{
+    int epoll_fd;
+    // completions during current master_async_run()
+    int completed;
+} master_async_t;
+
+typedef enum
+{
+    MASTER_ASYNC_BUS_idle,
+    MASTER_ASYNC_BUS_tx,
+    MASTER_ASYNC_BUS_rx,
+    // silent interval after reply/timeout
+    MASTER_ASYNC_BUS_turnaround,
+    // tty removed from epoll, see MASTER_ASYNC_bus_error
+    MASTER_ASYNC_BUS_failed
+} master_async_bus_state_t;
+
+typedef struct master_async_bus
+{
+    master_async_t *engine;
+    tty_dev_t *dev;
+    speed_t rate;
+    // command execution timeout, depends on hardware
+    int timeout_exec_ms;
+    // silent interval before next request (default 3.5t), can be overridden
+    int turnaround_us;
+    int timer_fd;
+    master_async_bus_state_t state;
+    struct
+    {
+        master_async_req_t *head;
+        master_async_req_t *tail;
+    } queue;
+    master_async_req_t *curr;
+    size_t tx_written;
+    // EPOLLOUT is monitored (partial write)
+    int wait_writable;
+} master_async_bus_t;
+
+void master_async_init(master_async_t *);
+void master_async_deinit(master_async_t *);
+void master_async_bus_init(
+    master_async_bus_t *,
+    master_async_t *,
+    tty_dev_t *,
+    speed_t rate,
+    int timeout_exec_ms);
+/* request in progress and queued requests are completed with
+ * MASTER_ASYNC_cancelled */
+void master_async_bus_deinit(master_async_bus_t *);
+void master_async_submit(master_async_bus_t *, master_async_req_t *);
+// return: 1 if nothing is queued/in progress and turnaround has elapsed
+int master_async_bus_idle(const master_async_bus_t *);
+/* wait for events (timeout_ms: -1 infinite) and dispatch them
+ * return: number of completed requests */
+int master_async_run(master_async_t *, int timeout_ms);
@@ -0,0 +1,184 @@
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define MASTER_BITS_BMI2
+#endif
+
+#include "check.h"
+#include "master_bits.h"
+
+#define LSB_OF_BYTES UINT64_C(0x0101010101010101)
+#define MSB_OF_BYTES UINT64_C(0x8080808080808080)
+// LSB of byte k moved to bit 56 + k (no carries, partial products disjoint)
+#define GATHER_LSBS UINT64_C(0x0102040810204080)
+// bit k of byte k
+#define DIAGONAL UINT64_C(0x8040201008040201)
+
+/* kernels convert all count states, vector kernels whole groups of 8
+ * states and the rest with scalar code */
+typedef void (*pack_t)(uint8_t *bits, const uint8_t *states, size_t count);
+typedef void (*unpack_t)(uint8_t *states, const uint8_t *bits, size_t count);
+
+static void pack_scalar(uint8_t *bits, const uint8_t *states, size_t count)
+{
+    // unused bits of last byte are cleared
+    memset(bits, 0, (count + 7) / 8);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (states[i]) bits[i / 8] |= (uint8_t)(1u << (i % 8));
+    }
+}
+
+static void unpack_scalar(uint8_t *states, const uint8_t *bits, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) states[i] = bits[i / 8] >> (i % 8) & 1;
+}
+
+// MSB of each byte set iff byte is not 0
+static inline uint64_t nonzero_bytes(uint64_t word)
+{
+    return ((word & ~MSB_OF_BYTES) + ~MSB_OF_BYTES | word) & MSB_OF_BYTES;
+}
+
+static void pack_swar(uint8_t *bits, const uint8_t *states, size_t count)
+{
+    const size_t groups = count / 8;
+
+    for (size_t i = 0; i < groups; ++i)
+    {
+        uint64_t word;
+
+        memcpy(&word, states + 8 * i, sizeof(word));
+        bits[i] = (uint8_t)((nonzero_bytes(word) >> 7) * GATHER_LSBS >> 56);
+    }
+    pack_scalar(bits + groups, states + 8 * groups, count % 8);
+}
+
+static void unpack_swar(uint8_t *states, const uint8_t *bits, size_t count)
+{
+    const size_t groups = count / 8;
+
+    for (size_t i = 0; i < groups; ++i)
+    {
+        // byte k keeps bit k of bits[i], then 0x01..0x80 -> 1 (no carries)
+        const uint64_t spread = bits[i] * LSB_OF_BYTES & DIAGONAL;
+        const uint64_t word   = (spread + ~MSB_OF_BYTES & MSB_OF_BYTES) >> 7;
+
+        memcpy(states + 8 * i, &word, sizeof(word));
+    }
+    unpack_scalar(states + 8 * groups, bits + groups, count % 8);
+}
+
+#ifdef MASTER_BITS_BMI2
+__attribute__((target("bmi2"))) static void
+pack_bmi2(uint8_t *bits, const uint8_t *states, size_t count)
+{
+    const size_t groups = count / 8;
+
+    for (size_t i = 0; i < groups; ++i)
+    {
+        uint64_t word;
+
+        memcpy(&word, states + 8 * i, sizeof(word));
+        bits[i] = (uint8_t)_pext_u64(nonzero_bytes(word), MSB_OF_BYTES);
+    }
+    pack_scalar(bits + groups, states + 8 * groups, count % 8);
+}
+
+__attribute__((target("bmi2"))) static void
+unpack_bmi2(uint8_t *states, const uint8_t *bits, size_t count)
+{
+    const size_t groups = count / 8;
+
+    for (size_t i = 0; i < groups; ++i)
+    {
+        const uint64_t word = _pdep_u64(bits[i], LSB_OF_BYTES);
+
+        memcpy(states + 8 * i, &word, sizeof(word));
+    }
+    unpack_scalar(states + 8 * groups, bits + groups, count % 8);
+}
+#endif
+
+static master_bits_isa_t isa = MASTER_BITS_ISA_scalar;
+static pack_t pack           = pack_scalar;
+static unpack_t unpack       = unpack_scalar;
+
+int master_bits_select_isa(master_bits_isa_t candidate)
+{
+    switch (candidate)
+    {
+    case MASTER_BITS_ISA_scalar:
+        pack   = pack_scalar;
+        unpack = unpack_scalar;
+        break;
+    case MASTER_BITS_ISA_swar:
+        pack   = pack_swar;
+        unpack = unpack_swar;
+        break;
+    case MASTER_BITS_ISA_bmi2:
+#ifdef MASTER_BITS_BMI2
+        if (!__builtin_cpu_supports("bmi2")) return 0;
+        pack   = pack_bmi2;
+        unpack = unpack_bmi2;
+        break;
+#else
+        return 0;
+#endif
+    default: return 0;
+    }
+    isa = candidate;
+    return 1;
+}
+
+master_bits_isa_t master_bits_isa(void)
+{
+    return isa;
+}
+
+#ifdef MASTER_BITS_BMI2
+/* pdep/pext are microcoded on AMD before Zen 3 (family 19h), latency grows
+ * with number of set mask bits and is worse than multiply/mask */
+static int slow_pdep_pext(void)
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__builtin_cpu_is("amd")) return 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 1;
+
+    const unsigned family = (eax >> 8 & 0xF) + (eax >> 20 & 0xFF);
+
+    return family < 0x19;
+}
+#endif
+
+__attribute__((constructor)) static void select_best_isa(void)
+{
+#ifdef MASTER_BITS_BMI2
+    __builtin_cpu_init();
+    if (!slow_pdep_pext() && master_bits_select_isa(MASTER_BITS_ISA_bmi2))
+        return;
+#endif
+    master_bits_select_isa(MASTER_BITS_ISA_swar);
+}
+
+uint8_t *master_bits_pack(uint8_t *bits, const uint8_t *states, size_t count)
+{
+    CHECK(bits || !count);
+    CHECK(states || !count);
+
+    pack(bits, states, count);
+    return bits + (count + 7) / 8;
+}
+
+uint8_t *
+master_bits_unpack(uint8_t *states, const uint8_t *bits, size_t count)
+{
+    CHECK(states || !count);
+    CHECK(bits || !count);
+
+    unpack(states, bits, count);
+    return states + count;
+}
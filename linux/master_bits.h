@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* conversion between packed coil/input bits (FC1/FC2 replies, FC15
+ * requests: state i is bit (i % 8) of bits[i / 8]) and state arrays of one
+ * byte per coil/input (uint8_t, bool)
+ *
+ * 8 states are converted at once by 64-bit multiply/mask (portable default)
+ * or on x86 with fast BMI2 by pdep/pext (selected at runtime, not on AMD
+ * before Zen 3 where they are microcoded), remaining states by scalar code */
+
+typedef enum
+{
+    MASTER_BITS_ISA_scalar = 0,
+    MASTER_BITS_ISA_swar,
+    MASTER_BITS_ISA_bmi2
+} master_bits_isa_t;
+
+// return: implementation in use, best supported by default
+master_bits_isa_t master_bits_isa(void);
+/* testing/benchmarking only, not thread safe
+ * return: 1 isa selected, 0 not supported by cpu (selection unchanged) */
+int master_bits_select_isa(master_bits_isa_t);
+
+/* states: 0 OFF, otherwise ON, unused bits of last byte are 0
+ * return: bits + (count + 7) / 8 */
+uint8_t *master_bits_pack(uint8_t *bits, const uint8_t *states, size_t count);
+/* states: 0 OFF, 1 ON
+ * return: states + count */
+uint8_t *
+master_bits_unpack(uint8_t *states, const uint8_t *bits, size_t count);
@@ -0,0 +1,310 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "check.h"
+#include "log.h"
+#include "master_coalesce.h"
+#include "rtu_impl.h"
+#include "util.h"
+
+typedef modbus_rtu_data16_t data16_t;
+
+#define RD_REGISTERS_MAX 125
+#define WR_REGISTERS_MAX 123
+#define BYTES_MAX        249
+
+static int is_read(master_coalesce_op_t op)
+{
+    return MASTER_COALESCE_rd_registers == op
+        || MASTER_COALESCE_rd_bytes == op;
+}
+
+static size_t unit_size(master_coalesce_op_t op)
+{
+    return MASTER_COALESCE_rd_registers == op
+            || MASTER_COALESCE_wr_registers == op
+        ? sizeof(data16_t)
+        : sizeof(uint8_t);
+}
+
+static uint16_t count_max(master_coalesce_op_t op)
+{
+    switch (op)
+    {
+    case MASTER_COALESCE_rd_registers: return RD_REGISTERS_MAX;
+    case MASTER_COALESCE_wr_registers: return WR_REGISTERS_MAX;
+    default: return BYTES_MAX;
+    }
+}
+
+void master_coalesce_init(
+    master_coalesce_t *coalesce, rtu_master_impl_t *impl, uint16_t gap)
+{
+    CHECK(coalesce);
+    CHECK(impl);
+
+    memset(coalesce, 0, sizeof(master_coalesce_t));
+    coalesce->impl          = impl;
+    coalesce->gap           = gap;
+    coalesce->turnaround_us = calc_3t5_us(impl->rate);
+}
+
+void master_coalesce_submit(
+    master_coalesce_t *coalesce, master_coalesce_req_t *req)
+{
+    CHECK(coalesce);
+    CHECK(req);
+    CHECK(req->data);
+    CHECK(0 < req->count && count_max(req->op) >= req->count);
+
+    if (MASTER_COALESCE_QUEUE_MAX == coalesce->queue_size)
+        master_coalesce_flush(coalesce);
+
+    req->ok  = 0;
+    req->seq = coalesce->seq++;
+    coalesce->queue[coalesce->queue_size++] = req;
+    ++coalesce->stats.requests;
+}
+
+static int compare(const void *a, const void *b)
+{
+    const master_coalesce_req_t *ra = *(master_coalesce_req_t *const *)a;
+    const master_coalesce_req_t *rb = *(master_coalesce_req_t *const *)b;
+
+    // writes first, queued reads observe queued writes
+    if (is_read(ra->op) != is_read(rb->op)) return is_read(ra->op) ? 1 : -1;
+    if (ra->op != rb->op) return (int)ra->op - (int)rb->op;
+    if (ra->addr != rb->addr) return (int)ra->addr - (int)rb->addr;
+    if (ra->mem_addr != rb->mem_addr)
+        return (int)ra->mem_addr - (int)rb->mem_addr;
+    return ra->seq < rb->seq ? -1 : 1;
+}
+
+static int transaction(
+    rtu_master_impl_t *impl,
+    master_coalesce_op_t op,
+    modbus_rtu_addr_t addr,
+    uint16_t mem_addr,
+    uint16_t count,
+    void *data)
+{
+    const modbus_rtu_mem_addr_t mem = WORD_TO_MEM_ADDR(mem_addr);
+
+    switch (op)
+    {
+    case MASTER_COALESCE_rd_registers:
+        return !!rtu_master_rd_holding_registers(
+            impl, addr, mem, WORD_TO_COUNT(count), data);
+    case MASTER_COALESCE_rd_bytes:
+        return !!rtu_master_rd_bytes(impl, addr, mem, (uint8_t)count, data);
+    case MASTER_COALESCE_wr_registers:
+        return !!rtu_master_wr_registers(
+            impl, addr, mem, WORD_TO_COUNT(count), data);
+    case MASTER_COALESCE_wr_bytes:
+        return !!rtu_master_wr_bytes(impl, addr, mem, (uint8_t)count, data);
+    }
+    return 0;
+}
+
+// return: end of run, [begin, end) fits into single request
+static master_coalesce_req_t **run_end(
+    const master_coalesce_t *coalesce,
+    master_coalesce_req_t **begin,
+    master_coalesce_req_t **end)
+{
+    const master_coalesce_req_t *first = *begin;
+    // reads may skip gap, writes must not (memory in between is unknown)
+    const uint32_t gap           = is_read(first->op) ? coalesce->gap : 0;
+    uint32_t range_end           = (uint32_t)first->mem_addr + first->count;
+    master_coalesce_req_t **curr = begin + 1;
+
+    for (; curr != end; ++curr)
+    {
+        const master_coalesce_req_t *req = *curr;
+        const uint32_t req_end           = (uint32_t)req->mem_addr + req->count;
+
+        if (req->op != first->op || req->addr != first->addr) break;
+        if (req->mem_addr > range_end + gap) break;
+        if (max(range_end, req_end) - first->mem_addr > count_max(first->op))
+            break;
+        range_end = max(range_end, req_end);
+    }
+    return curr;
+}
+
+// registers and bytes share rtu_memory address space
+static int overlap(
+    const master_coalesce_req_t *a, const master_coalesce_req_t *b)
+{
+    return a->addr == b->addr
+        && (uint32_t)a->mem_addr + a->count > b->mem_addr
+        && (uint32_t)b->mem_addr + b->count > a->mem_addr;
+}
+
+/* runs of batch are executed in address order
+ * return: 1 overlapping writes of [begin, end) end up in the same run */
+static int batch_ordered(
+    const master_coalesce_t *coalesce,
+    master_coalesce_req_t *const *begin,
+    master_coalesce_req_t *const *end)
+{
+    master_coalesce_req_t *sorted[MASTER_COALESCE_QUEUE_MAX];
+    size_t run[MASTER_COALESCE_QUEUE_MAX];
+    const size_t size = (size_t)(end - begin);
+
+    memcpy(sorted, begin, size * sizeof(sorted[0]));
+    qsort(sorted, size, sizeof(sorted[0]), compare);
+
+    for (master_coalesce_req_t **curr = sorted; curr != sorted + size;)
+    {
+        master_coalesce_req_t **const next
+            = run_end(coalesce, curr, sorted + size);
+
+        for (; curr != next; ++curr)
+            run[curr - sorted] = (size_t)(next - sorted);
+    }
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        for (size_t j = i + 1; j < size; ++j)
+        {
+            if (run[i] != run[j] && overlap(sorted[i], sorted[j])) return 0;
+        }
+    }
+    return 1;
+}
+
+static void execute(
+    master_coalesce_t *coalesce,
+    master_coalesce_req_t **begin,
+    master_coalesce_req_t **end)
+{
+    const master_coalesce_req_t *first = *begin;
+    const size_t size                  = unit_size(first->op);
+    const uint32_t range_begin         = first->mem_addr;
+    uint32_t range_end                 = range_begin;
+    uint8_t buf[BYTES_MAX * sizeof(data16_t)];
+
+    for (master_coalesce_req_t **curr = begin; curr != end; ++curr)
+    {
+        const uint32_t req_end = (uint32_t)(*curr)->mem_addr + (*curr)->count;
+
+        range_end = max(range_end, req_end);
+    }
+
+    if (!is_read(first->op))
+    {
+        master_coalesce_req_t *writes[MASTER_COALESCE_QUEUE_MAX];
+        const size_t writes_num = (size_t)(end - begin);
+
+        // apply in submission order, later writes win
+        memcpy(writes, begin, writes_num * sizeof(writes[0]));
+        for (size_t i = 1; i < writes_num; ++i)
+        {
+            master_coalesce_req_t *req = writes[i];
+            size_t j                   = i;
+
+            for (; j && writes[j - 1]->seq > req->seq; --j)
+                writes[j] = writes[j - 1];
+            writes[j] = req;
+        }
+        for (size_t i = 0; i < writes_num; ++i)
+        {
+            memcpy(
+                buf + (writes[i]->mem_addr - range_begin) * size,
+                writes[i]->data, writes[i]->count * size);
+        }
+    }
+
+    const int ok = transaction(
+        coalesce->impl, first->op, first->addr, (uint16_t)range_begin,
+        (uint16_t)(range_end - range_begin), buf);
+
+    ++coalesce->stats.transactions;
+    logD(
+        "%d %u requests -> op %d addr %u [%u, %u) %s", coalesce->impl->dev->fd,
+        (unsigned)(end - begin), (int)first->op, (unsigned)first->addr,
+        (unsigned)range_begin, (unsigned)range_end, ok ? "ok" : "failed");
+
+    for (master_coalesce_req_t **curr = begin; curr != end; ++curr)
+    {
+        master_coalesce_req_t *req = *curr;
+
+        req->ok = ok;
+        if (ok && is_read(req->op))
+        {
+            memcpy(
+                req->data, buf + (req->mem_addr - range_begin) * size,
+                req->count * size);
+        }
+    }
+}
+
+static void execute_batch(
+    master_coalesce_t *coalesce,
+    master_coalesce_req_t **begin,
+    master_coalesce_req_t **end,
+    uint32_t transactions)
+{
+    qsort(begin, (size_t)(end - begin), sizeof(begin[0]), compare);
+
+    while (begin != end)
+    {
+        master_coalesce_req_t **const run = run_end(coalesce, begin, end);
+
+        if (transactions != coalesce->stats.transactions
+            && 0 < coalesce->turnaround_us)
+        {
+            CHECK_ERRNO(
+                !usleep((useconds_t)coalesce->turnaround_us) || EINTR == errno);
+        }
+
+        execute(coalesce, begin, run);
+        begin = run;
+    }
+}
+
+size_t master_coalesce_flush(master_coalesce_t *coalesce)
+{
+    CHECK(coalesce);
+
+    const uint32_t transactions = coalesce->stats.transactions;
+    master_coalesce_req_t *reads[MASTER_COALESCE_QUEUE_MAX];
+    size_t reads_num  = 0;
+    size_t writes_num = 0;
+
+    // queue is in submission order, move reads behind writes (stable)
+    for (size_t i = 0; i < coalesce->queue_size; ++i)
+    {
+        master_coalesce_req_t *const req = coalesce->queue[i];
+
+        if (is_read(req->op)) reads[reads_num++] = req;
+        else coalesce->queue[writes_num++] = req;
+    }
+    memcpy(
+        coalesce->queue + writes_num, reads, reads_num * sizeof(reads[0]));
+
+    master_coalesce_req_t **const writes_end = coalesce->queue + writes_num;
+
+    /* batch of writes is closed before write which would be folded into
+     * other request than a write it overlaps (different op, run split by
+     * count_max), overlapping writes keep submission order across batches */
+    for (master_coalesce_req_t **begin = coalesce->queue; begin != writes_end;)
+    {
+        master_coalesce_req_t **end = begin + 1;
+
+        while (end != writes_end && batch_ordered(coalesce, begin, end + 1))
+            ++end;
+        execute_batch(coalesce, begin, end, transactions);
+        begin = end;
+    }
+
+    execute_batch(
+        coalesce, writes_end, writes_end + reads_num, transactions);
+
+    coalesce->queue_size = 0;
+    return coalesce->stats.transactions - transactions;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "master_impl.h"
+
+/* request coalescing on top of rtu_master_impl_t
+ *
+ * requests are queued and executed by master_coalesce_flush():
+ * - reads of the same slave and kind whose ranges are at most gap apart
+ *   are merged into one FC3 (<= 125 registers) or FC65 (<= 249 bytes)
+ *   request, the gap is read and dropped
+ * - adjacent/overlapping writes are folded into one FC16 (<= 123 registers)
+ *   or FC66 (<= 249 bytes) request, overlapping writes are applied in
+ *   submission order (also across requests: FC16 vs FC66 on the same
+ *   rtu_memory bytes, runs split at size limit)
+ * - results are scattered back to the original requests
+ * - writes are executed before reads, so reads observe queued writes
+ *
+ * addresses and counts are in memory units (register/byte), host order */
+
+#define MASTER_COALESCE_QUEUE_MAX 64
+
+typedef enum
+{
+    MASTER_COALESCE_rd_registers,
+    MASTER_COALESCE_rd_bytes,
+    MASTER_COALESCE_wr_registers,
+    MASTER_COALESCE_wr_bytes
+} master_coalesce_op_t;
+
+typedef struct
+{
+    master_coalesce_op_t op;
+    modbus_rtu_addr_t addr;
+    uint16_t mem_addr;
+    uint16_t count;
+    // registers: modbus_rtu_data16_t[count], bytes: uint8_t[count]
+    void *data;
+    // set by master_coalesce_flush(), 1: transaction succeeded
+    int ok;
+    // private
+    uint32_t seq;
+} master_coalesce_req_t;
+
+typedef struct
+{
+    rtu_master_impl_t *impl;
+    // max distance between merged reads
+    uint16_t gap;
+    // silent interval between transactions (default 3.5t), can be overridden
+    int turnaround_us;
+    master_coalesce_req_t *queue[MASTER_COALESCE_QUEUE_MAX];
+    size_t queue_size;
+    uint32_t seq;
+    struct
+    {
+        uint32_t requests;
+        uint32_t transactions;
+    } stats;
+} master_coalesce_t;
+
+void master_coalesce_init(
+    master_coalesce_t *, rtu_master_impl_t *, uint16_t gap);
+/* req has to stay valid until master_coalesce_flush(), queue is flushed
+ * when full */
+void master_coalesce_submit(master_coalesce_t *, master_coalesce_req_t *);
+// return: number of bus transactions
+size_t master_coalesce_flush(master_coalesce_t *);
@@ -0,0 +1,235 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MASTER_DECODE_X86
+#endif
+
+#include "check.h"
+#include "master_decode.h"
+#include "util.h"
+
+typedef modbus_rtu_data16_t data16_t;
+
+/* pattern: host (little-endian) byte k of each 4 byte group is wire byte
+ * pattern[k], kernels process whole vectors only, callers decode the rest
+ * return: number of bytes processed */
+typedef size_t (*permute_t)(
+    void *dst, const void *src, size_t size, const uint8_t *pattern);
+
+static const uint8_t pattern_u16[4] = {1, 0, 3, 2};
+static const uint8_t pattern_str[2][4] = {{0, 1, 2, 3}, {1, 0, 3, 2}};
+static const uint8_t pattern_32[4][4] = {
+    [MASTER_DECODE_ABCD] = {3, 2, 1, 0},
+    [MASTER_DECODE_CDAB] = {1, 0, 3, 2},
+    [MASTER_DECODE_BADC] = {2, 3, 0, 1},
+    [MASTER_DECODE_DCBA] = {0, 1, 2, 3}};
+
+// scalar ISA has no kernel, callers decode all values (portable)
+static size_t
+permute_none(void *dst, const void *src, size_t size, const uint8_t *pattern)
+{
+    return 0;
+}
+
+#ifdef MASTER_DECODE_X86
+__attribute__((target("ssse3"))) static size_t
+permute_ssse3(void *dst, const void *src, size_t size, const uint8_t *pattern)
+{
+    const __m128i mask = _mm_setr_epi8(
+        pattern[0], pattern[1], pattern[2], pattern[3], 4 + pattern[0],
+        4 + pattern[1], 4 + pattern[2], 4 + pattern[3], 8 + pattern[0],
+        8 + pattern[1], 8 + pattern[2], 8 + pattern[3], 12 + pattern[0],
+        12 + pattern[1], 12 + pattern[2], 12 + pattern[3]);
+    const uint8_t *in = src;
+    uint8_t *out      = dst;
+    size_t i          = 0;
+
+    for (; i + sizeof(__m128i) <= size; i += sizeof(__m128i))
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+
+        _mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static size_t
+permute_avx2(void *dst, const void *src, size_t size, const uint8_t *pattern)
+{
+    // vpshufb works on 128 bit lanes, 4 byte groups never cross them
+    const __m256i mask = _mm256_setr_epi8(
+        pattern[0], pattern[1], pattern[2], pattern[3], 4 + pattern[0],
+        4 + pattern[1], 4 + pattern[2], 4 + pattern[3], 8 + pattern[0],
+        8 + pattern[1], 8 + pattern[2], 8 + pattern[3], 12 + pattern[0],
+        12 + pattern[1], 12 + pattern[2], 12 + pattern[3], pattern[0],
+        pattern[1], pattern[2], pattern[3], 4 + pattern[0], 4 + pattern[1],
+        4 + pattern[2], 4 + pattern[3], 8 + pattern[0], 8 + pattern[1],
+        8 + pattern[2], 8 + pattern[3], 12 + pattern[0], 12 + pattern[1],
+        12 + pattern[2], 12 + pattern[3]);
+    const uint8_t *in = src;
+    uint8_t *out      = dst;
+    size_t i          = 0;
+
+    for (; i + sizeof(__m256i) <= size; i += sizeof(__m256i))
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(v, mask));
+    }
+    // 125 registers leave up to 31 bytes, one more 128 bit step
+    return i + permute_ssse3(out + i, in + i, size - i, pattern);
+}
+#endif
+
+static master_decode_isa_t isa = MASTER_DECODE_ISA_scalar;
+static permute_t permute       = permute_none;
+
+static int isa_supported(master_decode_isa_t candidate)
+{
+    switch (candidate)
+    {
+    case MASTER_DECODE_ISA_scalar: return 1;
+#ifdef MASTER_DECODE_X86
+    case MASTER_DECODE_ISA_ssse3: return __builtin_cpu_supports("ssse3");
+    case MASTER_DECODE_ISA_avx2: return __builtin_cpu_supports("avx2");
+#else
+    default: break;
+#endif
+    }
+    return 0;
+}
+
+int master_decode_select_isa(master_decode_isa_t candidate)
+{
+    if (!isa_supported(candidate)) return 0;
+
+    switch (candidate)
+    {
+    case MASTER_DECODE_ISA_scalar: permute = permute_none; break;
+#ifdef MASTER_DECODE_X86
+    case MASTER_DECODE_ISA_ssse3: permute = permute_ssse3; break;
+    case MASTER_DECODE_ISA_avx2: permute = permute_avx2; break;
+#else
+    default: break;
+#endif
+    }
+    isa = candidate;
+    return 1;
+}
+
+master_decode_isa_t master_decode_isa(void)
+{
+    return isa;
+}
+
+__attribute__((constructor)) static void select_best_isa(void)
+{
+#ifdef MASTER_DECODE_X86
+    __builtin_cpu_init();
+#endif
+    if (master_decode_select_isa(MASTER_DECODE_ISA_avx2)) return;
+    if (master_decode_select_isa(MASTER_DECODE_ISA_ssse3)) return;
+}
+
+static uint16_t swap16(uint16_t word)
+{
+    return (uint16_t)(word << 8 | word >> 8);
+}
+
+static uint32_t to_u32(const data16_t *src, master_decode_order_t order)
+{
+    const uint32_t w0 = DATA16_TO_WORD(src[0]);
+    const uint32_t w1 = DATA16_TO_WORD(src[1]);
+
+    switch (order)
+    {
+    case MASTER_DECODE_ABCD: return w0 << 16 | w1;
+    case MASTER_DECODE_CDAB: return w1 << 16 | w0;
+    case MASTER_DECODE_BADC:
+        return (uint32_t)swap16((uint16_t)w0) << 16 | swap16((uint16_t)w1);
+    case MASTER_DECODE_DCBA:
+        return (uint32_t)swap16((uint16_t)w1) << 16 | swap16((uint16_t)w0);
+    }
+    return 0;
+}
+
+void master_decode_u16(uint16_t *dst, const data16_t *src, size_t count)
+{
+    CHECK(dst || !count);
+    CHECK(src || !count);
+
+    size_t i = permute(dst, src, count * sizeof(uint16_t), pattern_u16)
+             / sizeof(uint16_t);
+
+    for (; i < count; ++i) dst[i] = DATA16_TO_WORD(src[i]);
+}
+
+void master_decode_i16(int16_t *dst, const data16_t *src, size_t count)
+{
+    // two's complement, same bits
+    master_decode_u16((uint16_t *)dst, src, count);
+}
+
+// dst: count 32 bit values, unaligned
+static void decode_32(
+    void *dst, const data16_t *src, size_t count, master_decode_order_t order)
+{
+    CHECK(dst || !count);
+    CHECK(src || !count);
+    CHECK(MASTER_DECODE_DCBA >= order);
+
+    const size_t size = count * sizeof(uint32_t);
+    uint8_t *out      = dst;
+    size_t i = permute(dst, src, size, pattern_32[order]) / sizeof(uint32_t);
+
+    for (; i < count; ++i)
+    {
+        const uint32_t value = to_u32(src + 2 * i, order);
+
+        memcpy(out + i * sizeof(uint32_t), &value, sizeof(uint32_t));
+    }
+}
+
+void master_decode_u32(
+    uint32_t *dst,
+    const data16_t *src,
+    size_t count,
+    master_decode_order_t order)
+{
+    decode_32(dst, src, count, order);
+}
+
+void master_decode_i32(
+    int32_t *dst,
+    const data16_t *src,
+    size_t count,
+    master_decode_order_t order)
+{
+    decode_32(dst, src, count, order);
+}
+
+void master_decode_f32(
+    float *dst, const data16_t *src, size_t count, master_decode_order_t order)
+{
+    _Static_assert(sizeof(float) == sizeof(uint32_t), "float is not 32 bit");
+    decode_32(dst, src, count, order);
+}
+
+size_t
+master_decode_str(char *dst, const data16_t *src, size_t count, int swap)
+{
+    CHECK(dst);
+    CHECK(src || !count);
+
+    size_t i = permute(dst, src, count * sizeof(data16_t), pattern_str[!!swap])
+             / sizeof(data16_t);
+
+    for (; i < count; ++i)
+    {
+        dst[2 * i]     = (char)(swap ? src[i].low : src[i].high);
+        dst[2 * i + 1] = (char)(swap ? src[i].high : src[i].low);
+    }
+    dst[2 * count] = '\0';
+    return strlen(dst);
+}
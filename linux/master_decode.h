@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rtu.h"
+
+/* typed decoding of register payloads (e.g. reply->data of
+ * parse_reply_rd_holding_registers()) into host order arrays
+ *
+ * registers are big-endian on the wire, 32 bit values span 2 registers
+ * (4 bytes A B C D in wire order, A most significant in ABCD), word order
+ * differs between devices:
+ * - ABCD: big-endian (Modbus default, high word first)
+ * - CDAB: low word first
+ * - BADC: high word first, bytes of each register swapped
+ * - DCBA: little-endian
+ *
+ * all conversions are byte permutations within 4 byte groups, on x86 they
+ * run as SSSE3/AVX2 shuffle kernels selected at runtime (CPUID), scalar
+ * code is used elsewhere and for tails */
+
+typedef enum
+{
+    MASTER_DECODE_ABCD = 0,
+    MASTER_DECODE_CDAB,
+    MASTER_DECODE_BADC,
+    MASTER_DECODE_DCBA
+} master_decode_order_t;
+
+typedef enum
+{
+    MASTER_DECODE_ISA_scalar = 0,
+    MASTER_DECODE_ISA_ssse3,
+    MASTER_DECODE_ISA_avx2
+} master_decode_isa_t;
+
+// return: kernels in use, best supported by default
+master_decode_isa_t master_decode_isa(void);
+/* testing/benchmarking only, not thread safe
+ * return: 1 isa selected, 0 not supported by cpu (selection unchanged) */
+int master_decode_select_isa(master_decode_isa_t);
+
+// dst[count] <- src[count]
+void master_decode_u16(
+    uint16_t *dst, const modbus_rtu_data16_t *src, size_t count);
+void master_decode_i16(
+    int16_t *dst, const modbus_rtu_data16_t *src, size_t count);
+// dst[count] <- src[2 * count]
+void master_decode_u32(
+    uint32_t *dst,
+    const modbus_rtu_data16_t *src,
+    size_t count,
+    master_decode_order_t);
+void master_decode_i32(
+    int32_t *dst,
+    const modbus_rtu_data16_t *src,
+    size_t count,
+    master_decode_order_t);
+// IEEE 754 single
+void master_decode_f32(
+    float *dst,
+    const modbus_rtu_data16_t *src,
+    size_t count,
+    master_decode_order_t);
+/* 2 characters per register, high byte first (low byte first if swap)
+ * dst has to hold 2 * count + 1 characters, string is cut at first NUL and
+ * always terminated
+ * return: string length */
+size_t master_decode_str(
+    char *dst, const modbus_rtu_data16_t *src, size_t count, int swap);
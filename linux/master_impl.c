@@ -1,10 +1,24 @@
 #include "master_impl.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
 #include "check.h"
+#include "crc.h"
+#include "log.h"
+#include "master_bits.h"
 #include "rtu_impl.h"
+#include "time_util.h"
 #include "tty.h"
+#include "util.h"
 
 typedef modbus_rtu_addr_t addr_t;
 typedef modbus_rtu_fcode_t fcode_t;
+typedef modbus_rtu_ecode_t ecode_t;
 typedef modbus_rtu_mem_addr_t mem_addr_t;
 typedef modbus_rtu_count_t count_t;
 typedef modbus_rtu_data16_t data16_t;
@@ -26,79 +40,951 @@ typedef modbus_rtu_rd_bytes_request_t rd_bytes_request_t;
 typedef modbus_rtu_rd_bytes_reply_header_t rd_bytes_reply_header_t;
 typedef modbus_rtu_rd_bytes_reply_t rd_bytes_reply_t;
 
-static const void *
-write_impl(rtu_master_impl_t *impl, const void *const data, const size_t size)
+#define EXCEPTION_FLAG UINT8_C(0x80)
+// max payload of FC65/FC66 (bytes) and FC16 (registers)
+#define BITS_MAX         2000
+#define RANGE_CHUNK_MAX  249
+#define WR_REGISTERS_MAX 123
+#define EXCEPTION_SIZE                                                         \
+    (sizeof(addr_t) + sizeof(fcode_t) + sizeof(ecode_t) + sizeof(crc_t))
+
+void rtu_master_rtt_init(
+    rtu_master_rtt_table_t *table, int64_t min_us, int64_t max_us)
+{
+    CHECK(table);
+    CHECK(0 <= min_us && min_us <= max_us);
+
+    memset(table, 0, sizeof(rtu_master_rtt_table_t));
+    table->min_us = min_us;
+    table->max_us = max_us;
+}
+
+int64_t rtu_master_rtt_timeout_us(
+    const rtu_master_rtt_table_t *table, const addr_t addr)
+{
+    CHECK(table);
+
+    const rtu_master_rtt_t *rtt = &table->slaves[addr];
+
+    if (!rtt->samples) return table->max_us;
+
+    int64_t timeout_us = max(table->min_us, rtt->srtt_us + 4 * rtt->rttvar_us);
+
+    for (uint32_t i = 0; i < rtt->backoff && timeout_us < table->max_us; ++i)
+        timeout_us = max(INT64_C(1), 2 * timeout_us);
+    return min(table->max_us, timeout_us);
+}
+
+void rtu_master_rtt_update(
+    rtu_master_rtt_table_t *table, const addr_t addr, const int64_t sample_us)
+{
+    CHECK(table);
+
+    rtu_master_rtt_t *rtt = &table->slaves[addr];
+
+    rtt->backoff = 0;
+    if (!rtt->samples++)
+    {
+        rtt->srtt_us   = sample_us;
+        rtt->rttvar_us = sample_us / 2;
+        return;
+    }
+
+    // gains 1/8 and 1/4
+    const int64_t err = sample_us - rtt->srtt_us;
+
+    rtt->srtt_us += err / 8;
+    rtt->rttvar_us += (llabs(err) - rtt->rttvar_us) / 4;
+}
+
+void rtu_master_rtt_missed(rtu_master_rtt_table_t *table, const addr_t addr)
+{
+    CHECK(table);
+
+    rtu_master_rtt_t *rtt = &table->slaves[addr];
+
+    // stop once max_us is reached
+    if (rtu_master_rtt_timeout_us(table, addr) < table->max_us) ++rtt->backoff;
+}
+
+// CRC field is last 2 bytes of frame, can be split between segments
+static int valid_crc_v(const struct iovec *iov, int iovcnt)
 {
-    const char *const begin = data;
-    const char *const end   = begin + size;
-    const int tmax_ms       = calc_tmax_ms(impl->rate, size);
-    const char *const curr  = tty_write(impl->dev, begin, end, tmax_ms, NULL);
+    const size_t size = tty_iov_size(iov, iovcnt);
+
+    if (sizeof(crc_t) >= size) return 0;
+
+    size_t payload = size - sizeof(crc_t);
+    crc_t crc      = MODBUS_RTU_CRC_INIT;
+    uint8_t received[sizeof(crc_t)];
+    size_t received_num = 0;
+
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        const uint8_t *begin     = iov[i].iov_base;
+        const uint8_t *const end = begin + iov[i].iov_len;
+        const size_t n           = min(payload, iov[i].iov_len);
+
+        crc = modbus_rtu_crc_continue(crc, begin, begin + n);
+        payload -= n;
+        for (begin += n; begin != end; ++begin)
+            received[received_num++] = *begin;
+    }
+    return crc.low == received[0] && crc.high == received[1];
+}
+
+static int
+write_impl(rtu_master_impl_t *impl, const struct iovec *iov, int iovcnt)
+{
+    const size_t size         = tty_iov_size(iov, iovcnt);
+    const int64_t tmax_us     = calc_tmax_us(impl->rate, size);
+    const int64_t deadline_ns = timestamp_ns() + tmax_us * 1000;
+    const size_t written
+        = tty_writev_until(impl->dev, iov, iovcnt, deadline_ns, NULL);
     tty_logD(impl->dev);
-    return end == curr ? curr : NULL;
+    return size == written;
 }
 
-static void *
-read_impl(rtu_master_impl_t *impl, void *const data, const size_t size)
+/* first segment has to hold at least address + function code
+ * header_ns: arrival of address + function code, -1 if not received
+ * trace: NULL or receives rx phases */
+static int read_impl(
+    rtu_master_impl_t *impl,
+    const struct iovec *iov,
+    const int iovcnt,
+    const int64_t deadline_ns,
+    int64_t *header_ns,
+    rtu_master_trace_t *trace)
 {
-    char *const begin = data;
-    char *const end   = begin + size;
-    const int tmax_ms = calc_tmax_ms(impl->rate, size) + impl->timeout_exec_ms;
-    char *const curr  = tty_read(impl->dev, begin, end, tmax_ms, NULL);
+    const size_t header_size = sizeof(addr_t) + sizeof(fcode_t);
+    char *const begin        = iov[0].iov_base;
+    // address + function code, enough to classify reply
+    char *const header_end = begin + header_size;
+
+    CHECK(0 < iovcnt && TTY_IOV_MAX >= iovcnt);
+    CHECK(header_size <= iov[0].iov_len);
+
+    char *curr = begin;
+
+    if (trace)
+    {
+        // first byte on its own, slave response time is visible
+        curr = tty_read_until(impl->dev, begin, begin + 1, deadline_ns, NULL);
+        if (begin != curr) trace->rx_first_ns = timestamp_ns();
+    }
+    if (!trace || begin != curr)
+        curr = tty_read_until(impl->dev, curr, header_end, deadline_ns, NULL);
+
+    *header_ns = header_end == curr ? timestamp_ns() : -1;
+    if (trace) trace->rx_bytes = (size_t)(curr - begin);
+
+    if (header_end != curr)
+    {
+        tty_logD(impl->dev);
+        return 0;
+    }
+
+    if (EXCEPTION_FLAG & (uint8_t)begin[sizeof(addr_t)])
+    {
+        // exception reply is shorter, dont wait for expected size
+        char exception[EXCEPTION_SIZE];
+
+        memcpy(exception, begin, header_size);
+        curr = tty_read_until(
+            impl->dev, exception + header_size, exception + EXCEPTION_SIZE,
+            deadline_ns, NULL);
+        tty_logD(impl->dev);
+
+        const char *const ecode = find_ecode(exception, curr);
+
+        if (trace)
+        {
+            trace->rx_bytes = (size_t)(curr - exception);
+            if (ecode) trace->rx_last_ns = timestamp_ns();
+        }
+        if (ecode) impl->ecode = (ecode_t)*ecode;
+        return 0;
+    }
+
+    // rest of reply, header is already received
+    struct iovec rest[TTY_IOV_MAX];
+
+    memcpy(rest, iov, sizeof(struct iovec) * (size_t)iovcnt);
+    rest[0].iov_base = header_end;
+    rest[0].iov_len -= header_size;
+
+    const size_t expected = tty_iov_size(rest, iovcnt);
+    const size_t received
+        = tty_readv_until(impl->dev, rest, iovcnt, deadline_ns, NULL);
+
+    if (trace)
+    {
+        trace->rx_bytes += received;
+        if (expected == received) trace->rx_last_ns = timestamp_ns();
+    }
     tty_logD(impl->dev);
-    return end == curr ? curr : NULL;
+    return expected == received;
 }
 
-void *rtu_master_rd_holding_registers(
+void rtu_master_pacing_init(rtu_master_pacing_t *pacing, speed_t rate)
+{
+    CHECK(pacing);
+
+    memset(pacing, 0, sizeof(rtu_master_pacing_t));
+    pacing->min_gap_us = calc_3t5_us(rate);
+}
+
+// until silent interval after previous transaction elapses
+static void pacing_sleep(rtu_master_pacing_t *pacing)
+{
+    const int64_t wait_ns = pacing->next_tx_ns - timestamp_ns();
+
+    if (0 >= wait_ns) return;
+
+    ++pacing->stats.waits;
+    pacing->stats.wait_total_us += wait_ns / 1000;
+    sleep_until_ns(pacing->next_tx_ns);
+}
+
+static void pacing_wait(rtu_master_pacing_t *pacing)
+{
+    ++pacing->stats.transactions;
+    pacing_sleep(pacing);
+}
+
+// bus is silent from now on (reply received or given up)
+static void pacing_done(rtu_master_pacing_t *pacing, addr_t addr)
+{
+    const int64_t gap_us = pacing->min_gap_us + pacing->margin_us[addr];
+
+    pacing->next_tx_ns = timestamp_ns() + gap_us * 1000;
+}
+
+// request end (queued to tty), drain only when traced
+static void
+trace_tx_end(rtu_master_impl_t *impl, rtu_master_trace_t *trace, int64_t ns)
+{
+    if (!trace) return;
+    trace->tx_end_ns = ns;
+    tty_drain(impl->dev->fd);
+    trace->tx_drained_ns = timestamp_ns();
+}
+
+/* reply_us: budget for reply from end of request write
+ * tx_end_ns: end of request write, -1 if not written
+ * header_ns: see read_impl()
+ * return: reply received completely */
+static int exchange_poll(
+    rtu_master_impl_t *impl,
+    const struct iovec *tx,
+    const int tx_cnt,
+    const struct iovec *rx,
+    const int rx_cnt,
+    const int64_t reply_us,
+    int64_t *tx_end_ns,
+    int64_t *header_ns,
+    rtu_master_trace_t *trace)
+{
+    if (!write_impl(impl, tx, tx_cnt)) return 0;
+
+    *tx_end_ns = timestamp_ns();
+    trace_tx_end(impl, trace, *tx_end_ns);
+    return read_impl(
+        impl, rx, rx_cnt, *tx_end_ns + reply_us * 1000, header_ns, trace);
+}
+
+#define URING_WRITE   UINT64_C(1)
+#define URING_READ    UINT64_C(2)
+#define URING_BUF_NUM 8
+// write, link timeout, read
+#define URING_ENTRIES 4
+
+int rtu_master_uring_init(rtu_master_uring_t *uring, tty_dev_t *dev)
+{
+    CHECK(uring);
+    CHECK(dev);
+
+    memset(uring, 0, sizeof(rtu_master_uring_t));
+
+    const int r = tty_uring_init(
+        &uring->ring, URING_ENTRIES, ADU_CAPACITY, URING_BUF_NUM);
+
+    if (r) return r;
+    // single shot read of O_NONBLOCK tty completes with -EAGAIN
+    if (!tty_uring_multishot(&uring->ring))
+    {
+        tty_uring_deinit(&uring->ring);
+        return -ENOTSUP;
+    }
+    uring->dev = dev;
+    tty_configure_read(dev, 1, 0);
+    return 0;
+}
+
+void rtu_master_uring_deinit(rtu_master_uring_t *uring)
+{
+    if (!uring) return;
+    // armed read is cancelled with the ring
+    tty_uring_deinit(&uring->ring);
+    uring->armed = 0;
+}
+
+static void uring_consumed(rtu_master_uring_t *uring, tty_uring_event_t *event)
+{
+    if (TTY_URING_OP_READ != event->op) return;
+    tty_uring_release(&uring->ring, event);
+    if (!event->more) uring->armed = 0;
+}
+
+static void uring_arm(rtu_master_uring_t *uring)
+{
+    if (uring->armed) return;
+    tty_uring_read(&uring->ring, uring->dev, URING_READ);
+    uring->armed = 1;
+}
+
+// late reply of previous transaction, read by kernel already
+static void uring_discard(rtu_master_uring_t *uring)
+{
+    tty_uring_event_t events[URING_BUF_NUM];
+    size_t num = 0;
+
+    while (0 != (num = tty_uring_reap(
+                     &uring->ring, events, events + length_of(events))))
+    {
+        for (size_t i = 0; i < num; ++i) uring_consumed(uring, &events[i]);
+    }
+}
+
+typedef struct
+{
+    const struct iovec *iov;
+    int iovcnt;
+    size_t received;
+    // rx segments, exception size once header is received
+    size_t expected;
+    // address, function code, exception code, CRC
+    char head[EXCEPTION_SIZE];
+} uring_rx_t;
+
+// scatter received bytes into rx segments, excess bytes are dropped
+static void uring_rx_store(uring_rx_t *rx, const char *data, size_t size)
+{
+    const size_t header_size = sizeof(addr_t) + sizeof(fcode_t);
+
+    while (size && rx->received < rx->expected)
+    {
+        // header decides expected size
+        const size_t limit
+            = rx->received < header_size ? header_size : rx->expected;
+        const size_t n = min(size, limit - rx->received);
+        size_t offset  = rx->received;
+
+        if (offset < sizeof(rx->head))
+        {
+            memcpy(
+                rx->head + offset, data, min(n, sizeof(rx->head) - offset));
+        }
+        size_t copied = 0;
+
+        for (int i = 0; i < rx->iovcnt && copied != n; ++i)
+        {
+            const size_t len = rx->iov[i].iov_len;
+
+            if (offset >= len)
+            {
+                offset -= len;
+                continue;
+            }
+
+            const size_t chunk = min(n - copied, len - offset);
+
+            memcpy((char *)rx->iov[i].iov_base + offset, data + copied, chunk);
+            copied += chunk;
+            offset = 0;
+        }
+        rx->received += n;
+        data += n;
+        size -= n;
+
+        if (header_size == rx->received
+            && EXCEPTION_FLAG & (uint8_t)rx->head[sizeof(addr_t)])
+        {
+            rx->expected = EXCEPTION_SIZE;
+        }
+    }
+}
+
+// same as exchange_poll(), request and reply go through impl->uring
+static int exchange_uring(
+    rtu_master_impl_t *impl,
+    const struct iovec *tx,
+    const int tx_cnt,
+    const struct iovec *rx,
+    const int rx_cnt,
+    const int64_t reply_us,
+    int64_t *tx_end_ns,
+    int64_t *header_ns,
+    rtu_master_trace_t *trace)
+{
+    rtu_master_uring_t *const uring = impl->uring;
+    const size_t header_size        = sizeof(addr_t) + sizeof(fcode_t);
+    const size_t tx_size            = tty_iov_size(tx, tx_cnt);
+    const int64_t tmax_us           = calc_tmax_us(impl->rate, tx_size);
+    uring_rx_t reply                = {
+        .iov = rx, .iovcnt = rx_cnt, .expected = tty_iov_size(rx, rx_cnt)};
+    int64_t deadline_ns = -1;
+    int written         = 0;
+
+    CHECK(impl->dev == uring->dev);
+    CHECK(0 < rx_cnt && header_size <= rx[0].iov_len);
+
+    uring_discard(uring);
+    uring_arm(uring);
+    tty_uring_writev(
+        &uring->ring, uring->dev, tx, tx_cnt, (int)tmax_us, URING_WRITE);
+    ++uring->stats.transactions;
+
+    // write is bounded by its link timeout (tx iov is in use until then)
+    while (!written
+           || (reply.received < reply.expected && timestamp_ns() < deadline_ns))
+    {
+        const int timeout_us = written
+            ? (int)max(INT64_C(0), (deadline_ns - timestamp_ns()) / 1000)
+            : -1;
+        tty_uring_event_t events[URING_BUF_NUM];
+
+        ++uring->stats.enters;
+        tty_uring_submit(&uring->ring, 1, timeout_us);
+
+        const size_t num = tty_uring_reap(
+            &uring->ring, events, events + length_of(events));
+
+        for (size_t i = 0; i < num; ++i)
+        {
+            tty_uring_event_t *const event = &events[i];
+            const int64_t now_ns           = timestamp_ns();
+            const size_t before            = reply.received;
+
+            if (TTY_URING_OP_WRITE == event->op)
+            {
+                written = 1;
+                if ((int)tx_size != event->result)
+                {
+                    logD("%d write %d", impl->dev->fd, event->result);
+                    continue;
+                }
+                *tx_end_ns  = now_ns;
+                deadline_ns = now_ns + reply_us * 1000;
+                trace_tx_end(impl, trace, now_ns);
+                continue;
+            }
+
+            if (0 < event->result)
+                uring_rx_store(&reply, event->data, (size_t)event->result);
+            uring_consumed(uring, event);
+
+            if (trace && !before && reply.received) trace->rx_first_ns = now_ns;
+            if (before < header_size && header_size <= reply.received)
+                *header_ns = now_ns;
+            if (trace && before < reply.expected
+                && reply.expected == reply.received)
+                trace->rx_last_ns = now_ns;
+        }
+        uring_arm(uring);
+    }
+
+    if (trace) trace->rx_bytes = reply.received;
+    if (reply.received < header_size
+        || !(EXCEPTION_FLAG & (uint8_t)reply.head[sizeof(addr_t)]))
+        return reply.expected == reply.received;
+
+    const char *const ecode
+        = find_ecode(reply.head, reply.head + reply.received);
+
+    if (ecode) impl->ecode = (ecode_t)*ecode;
+    else if (trace) trace->rx_last_ns = -1;
+    return 0;
+}
+
+static int exchange(
+    rtu_master_impl_t *impl,
+    const struct iovec *tx,
+    const int tx_cnt,
+    const struct iovec *rx,
+    const int rx_cnt,
+    rtu_master_trace_t *trace)
+{
+    const addr_t addr = *(const addr_t *)tx[0].iov_base;
+
+    // late reply of previous transaction must not be taken for this one
+    tty_flush_rx(impl->dev->fd);
+
+    const int char_bits     = tty_char_bits(&impl->dev->config);
+    const size_t tx_size    = tty_iov_size(tx, tx_cnt);
+    const size_t rx_size    = tty_iov_size(rx, rx_cnt);
+    // request is still on the wire when write() returns
+    const int64_t tx_wire_us  = calc_frame_us(impl->rate, char_bits, tx_size);
+    const int64_t rx_wire_us  = calc_frame_us(impl->rate, char_bits, rx_size);
+    const int64_t response_us = impl->rtt
+        ? rtu_master_rtt_timeout_us(impl->rtt, addr)
+        : INT64_C(10000) + (int64_t)impl->timeout_exec_ms * 1000;
+    const int64_t reply_us    = tx_wire_us + response_us + rx_wire_us;
+    int64_t tx_end_ns         = -1;
+    int64_t header_ns         = -1;
+    const int received        = impl->uring
+               ? exchange_uring(
+                   impl, tx, tx_cnt, rx, rx_cnt, reply_us, &tx_end_ns,
+                   &header_ns, trace)
+               : exchange_poll(
+                   impl, tx, tx_cnt, rx, rx_cnt, reply_us, &tx_end_ns,
+                   &header_ns, trace);
+
+    if (-1 == tx_end_ns) return 0;
+
+    if (impl->rtt && -1 != header_ns)
+    {
+        // first byte latency, header itself took 2 characters
+        const int64_t header_wire_us = calc_frame_us(
+            impl->rate, char_bits, sizeof(addr_t) + sizeof(fcode_t));
+        const int64_t sample_us
+            = (header_ns - tx_end_ns) / 1000 - tx_wire_us - header_wire_us;
+
+        rtu_master_rtt_update(impl->rtt, addr, max(INT64_C(0), sample_us));
+    }
+    else if (impl->rtt) rtu_master_rtt_missed(impl->rtt, addr);
+    return received && valid_crc_v(rx, rx_cnt);
+}
+
+static int transact_once(
+    rtu_master_impl_t *impl,
+    const struct iovec *tx,
+    const int tx_cnt,
+    const struct iovec *rx,
+    const int rx_cnt)
+{
+    const uint8_t *const header = tx[0].iov_base;
+    const addr_t addr           = header[0];
+    rtu_master_trace_t local;
+    // histograms are fed even if caller does not want the record
+    rtu_master_trace_t *const trace
+        = impl->trace ? impl->trace : impl->latency ? &local : NULL;
+
+    if (impl->pacing) pacing_wait(impl->pacing);
+    if (trace)
+    {
+        *trace = (rtu_master_trace_t){
+            .addr          = addr,
+            .fcode         = header[sizeof(addr_t)],
+            .ok            = 0,
+            .tx_begin_ns   = timestamp_ns(),
+            .tx_end_ns     = -1,
+            .tx_drained_ns = -1,
+            .rx_first_ns   = -1,
+            .rx_last_ns    = -1,
+            .tx_bytes      = tty_iov_size(tx, tx_cnt),
+            .rx_bytes      = 0};
+    }
+
+    const int ok = exchange(impl, tx, tx_cnt, rx, rx_cnt, trace);
+
+    if (impl->pacing) pacing_done(impl->pacing, addr);
+    if (trace)
+    {
+        trace->ok = ok;
+        if (impl->latency) rtu_master_latency_update(impl->latency, trace);
+    }
+    return ok;
+}
+
+void rtu_master_health_init(
+    rtu_master_health_table_t *table, const rtu_master_health_policy_t *policy)
+{
+    CHECK(table);
+    CHECK(policy);
+    CHECK(0 <= policy->retries);
+    CHECK(0 < policy->failures_to_open);
+    CHECK(0 < policy->backoff_min_us);
+    CHECK(policy->backoff_min_us <= policy->backoff_max_us);
+
+    memset(table, 0, sizeof(rtu_master_health_table_t));
+    table->policy = *policy;
+}
+
+static void health_failed(
+    const rtu_master_health_policy_t *policy,
+    rtu_master_health_t *health,
+    int64_t now_ns)
+{
+    ++health->stats.failures;
+    ++health->failures;
+
+    const int half_open = RTU_MASTER_HEALTH_half_open == health->state;
+
+    if (!half_open && policy->failures_to_open > health->failures) return;
+
+    health->backoff_us = half_open
+        ? min(policy->backoff_max_us, 2 * health->backoff_us)
+        : policy->backoff_min_us;
+    ++health->stats.opened;
+    health->state    = RTU_MASTER_HEALTH_open;
+    health->probe_ns = now_ns + health->backoff_us * 1000;
+}
+
+/* request and reply are scattered between caller buffers (payload) and
+ * small side buffers (header, CRC), there is no intermediate copy */
+static int transact_v(
+    rtu_master_impl_t *impl,
+    const struct iovec *tx,
+    const int tx_cnt,
+    const struct iovec *rx,
+    const int rx_cnt)
+{
+    impl->ecode = 0;
+    if (!impl->health) return transact_once(impl, tx, tx_cnt, rx, rx_cnt);
+
+    const rtu_master_health_policy_t *policy = &impl->health->policy;
+    rtu_master_health_t *health
+        = &impl->health->slaves[*(const addr_t *)tx[0].iov_base];
+
+    if (RTU_MASTER_HEALTH_open == health->state)
+    {
+        if (timestamp_ns() < health->probe_ns)
+        {
+            ++health->stats.rejected;
+            return 0;
+        }
+        ++health->stats.probes;
+        health->state = RTU_MASTER_HEALTH_half_open;
+    }
+
+    ++health->stats.transactions;
+
+    const int attempts
+        = 1 + (RTU_MASTER_HEALTH_closed == health->state ? policy->retries : 0);
+
+    for (int attempt = 0; attempt < attempts; ++attempt)
+    {
+        if (attempt)
+        {
+            ++health->stats.retries;
+            // silent interval, rest of corrupted reply is flushed by exchange
+            if (impl->pacing) pacing_sleep(impl->pacing);
+            else usleep((useconds_t)calc_3t5_us(impl->rate));
+        }
+
+        const int ok = transact_once(impl, tx, tx_cnt, rx, rx_cnt);
+
+        // exception: slave is alive, retry would not help
+        if (ok || impl->ecode)
+        {
+            health->state    = RTU_MASTER_HEALTH_closed;
+            health->failures = 0;
+            return ok;
+        }
+    }
+
+    health_failed(policy, health, timestamp_ns());
+    return 0;
+}
+
+static int transact(
+    rtu_master_impl_t *impl,
+    const void *const tx,
+    const size_t tx_size,
+    void *const rx,
+    const size_t rx_size)
+{
+    const struct iovec tx_iov = {.iov_base = (void *)tx, .iov_len = tx_size};
+    const struct iovec rx_iov = {.iov_base = rx, .iov_len = rx_size};
+
+    return transact_v(impl, &tx_iov, 1, &rx_iov, 1);
+}
+
+// request: header (side buffer), payload (caller memory), CRC
+static int transact_gather(
+    rtu_master_impl_t *impl,
+    const void *const header,
+    const size_t header_size,
+    const void *const payload,
+    const size_t payload_size,
+    void *const rx,
+    const size_t rx_size)
+{
+    const uint8_t *const header_begin  = header;
+    const uint8_t *const payload_begin = payload;
+    // CRC continues from header to payload, nothing is copied
+    crc_t crc = modbus_rtu_crc_continue(
+        MODBUS_RTU_CRC_INIT, header_begin, header_begin + header_size);
+
+    crc = modbus_rtu_crc_continue(
+        crc, payload_begin, payload_begin + payload_size);
+
+    const struct iovec tx[]
+        = {{.iov_base = (void *)header, .iov_len = header_size},
+           {.iov_base = (void *)payload, .iov_len = payload_size},
+           {.iov_base = &crc, .iov_len = sizeof(crc)}};
+    const struct iovec rx_iov = {.iov_base = rx, .iov_len = rx_size};
+
+    return transact_v(impl, tx, length_of(tx), &rx_iov, 1);
+}
+
+// reply: header (side buffer), payload (caller memory), CRC
+static int transact_scatter(
+    rtu_master_impl_t *impl,
+    const void *const tx,
+    const size_t tx_size,
+    void *const header,
+    const size_t header_size,
+    void *const payload,
+    const size_t payload_size)
+{
+    crc_t crc;
+    const struct iovec tx_iov = {.iov_base = (void *)tx, .iov_len = tx_size};
+    const struct iovec rx[]
+        = {{.iov_base = header, .iov_len = header_size},
+           {.iov_base = payload, .iov_len = payload_size},
+           {.iov_base = &crc, .iov_len = sizeof(crc)}};
+
+    return transact_v(impl, &tx_iov, 1, rx, length_of(rx));
+}
+
+typedef char *(*make_request_rd_t)(
+    addr_t, mem_addr_t, count_t, char *dst, size_t max_size);
+
+static void *rd_bits(
     rtu_master_impl_t *const impl,
+    make_request_rd_t make_request,
     const addr_t addr,
     const mem_addr_t mem_addr,
     const count_t count,
-    data16_t *const data)
+    uint8_t *const bits)
 {
-    rd_holding_registers_request_t req
-        = {.addr     = addr,
-           .fcode    = FCODE_RD_HOLDING_REGISTERS,
-           .mem_addr = mem_addr,
-           .count    = count};
+    char tx_buf[sizeof(modbus_rtu_mem_access_request_t)];
+    const char *req_end
+        = make_request(addr, mem_addr, count, tx_buf, sizeof(tx_buf));
 
-    if (!implace_crc(&req, sizeof(req))) return NULL;
-    if (!write_impl(impl, &req, sizeof(req))) return NULL;
+    if (!req_end) return NULL;
 
     char rx_buf[ADU_CAPACITY];
-    const size_t data_size     = COUNT_TO_WORD(count) * sizeof(data16_t);
-    const size_t expected_size = sizeof(rd_holding_registers_reply_header_t)
+    const size_t data_size     = (COUNT_TO_WORD(count) + 7u) / 8u;
+    const size_t expected_size = sizeof(modbus_rtu_rd_bits_reply_header_t)
         + data_size + sizeof(crc_t);
 
-    if (!read_impl(impl, rx_buf, expected_size)) return NULL;
+    if (!transact(
+            impl, tx_buf, (size_t)(req_end - tx_buf), rx_buf, expected_size))
+        return NULL;
 
-    const rd_holding_registers_reply_t *rep
-        = parse_reply_rd_holding_registers(rx_buf, expected_size);
+    // FC1/FC2 replies have the same layout
+    const modbus_rtu_rd_bits_reply_t *rep
+        = parse_reply_rd_coils(rx_buf, expected_size);
 
     if (!rep) return NULL;
 
-    memcpy(data, rep->data, data_size);
+    memcpy(bits, rep->bits, data_size);
+    return bits + data_size;
+}
+
+void *rtu_master_rd_coils(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    uint8_t *const bits)
+{
+    return rd_bits(impl, make_request_rd_coils, addr, mem_addr, count, bits);
+}
+
+void *rtu_master_rd_inputs(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    uint8_t *const bits)
+{
+    return rd_bits(impl, make_request_rd_inputs, addr, mem_addr, count, bits);
+}
+
+uint8_t *rtu_master_rd_coil_states(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    uint8_t *const states)
+{
+    uint8_t bits[(BITS_MAX + 7) / 8];
+
+    if (!rtu_master_rd_coils(impl, addr, mem_addr, count, bits)) return NULL;
+    return master_bits_unpack(states, bits, COUNT_TO_WORD(count));
+}
+
+uint8_t *rtu_master_rd_input_states(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    uint8_t *const states)
+{
+    uint8_t bits[(BITS_MAX + 7) / 8];
+
+    if (!rtu_master_rd_inputs(impl, addr, mem_addr, count, bits)) return NULL;
+    return master_bits_unpack(states, bits, COUNT_TO_WORD(count));
+}
+
+static void *rd_registers(
+    rtu_master_impl_t *const impl,
+    const char *const tx_buf,
+    const char *const req_end,
+    const count_t count,
+    data16_t *const data)
+{
+    if (!req_end) return NULL;
+
+    // FC3/FC4/FC23 replies have the same layout
+    rd_holding_registers_reply_header_t header;
+    const size_t data_size = COUNT_TO_WORD(count) * sizeof(data16_t);
+
+    if (!transact_scatter(
+            impl, tx_buf, (size_t)(req_end - tx_buf), &header, sizeof(header),
+            data, data_size))
+        return NULL;
+
+    if (data_size != header.byte_count) return NULL;
     return data + COUNT_TO_WORD(count);
 }
 
-const void *rtu_master_wr_registers(
+void *rtu_master_rd_holding_registers(
     rtu_master_impl_t *const impl,
     const addr_t addr,
     const mem_addr_t mem_addr,
     const count_t count,
-    const data16_t *const data)
+    data16_t *const data)
+{
+    char tx_buf[sizeof(rd_holding_registers_request_t)];
+    const char *req_end = make_request_rd_holding_registers(
+        addr, mem_addr, count, tx_buf, sizeof(tx_buf));
+
+    return rd_registers(impl, tx_buf, req_end, count, data);
+}
+
+void *rtu_master_rd_input_registers(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    data16_t *const data)
+{
+    char tx_buf[sizeof(modbus_rtu_rd_input_registers_request_t)];
+    const char *req_end = make_request_rd_input_registers(
+        addr, mem_addr, count, tx_buf, sizeof(tx_buf));
+
+    return rd_registers(impl, tx_buf, req_end, count, data);
+}
+
+int rtu_master_wr_coil(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const int on)
+{
+    char tx_buf[sizeof(modbus_rtu_wr_coil_reply_t)];
+    const char *req_end = make_request_wr_coil(
+        addr, mem_addr, on ? UINT8_C(0xFF) : UINT8_C(0x00), tx_buf,
+        sizeof(tx_buf));
+
+    if (!req_end) return 0;
+
+    modbus_rtu_wr_coil_reply_t reply;
+
+    if (!transact(
+            impl, tx_buf, (size_t)(req_end - tx_buf), &reply, sizeof(reply)))
+        return 0;
+
+    // reply is echo of request
+    if (!parse_reply_wr_coil(&reply, sizeof(reply))) return 0;
+    return !memcmp(&reply, tx_buf, sizeof(reply));
+}
+
+const void *rtu_master_wr_coils(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    const uint8_t *const bits)
 {
     char tx_buf[ADU_CAPACITY];
 
-    const char *req_end = make_request_wr_registers(
-        addr, mem_addr, data, count, tx_buf, sizeof(tx_buf));
+    const char *req_end = make_request_wr_coils(
+        addr, mem_addr, bits, count, tx_buf, sizeof(tx_buf));
 
     if (!req_end) return NULL;
 
-    if (!write_impl(impl, tx_buf, (size_t)(req_end - tx_buf))) return NULL;
+    modbus_rtu_wr_coils_reply_t reply;
+
+    if (!transact(
+            impl, tx_buf, (size_t)(req_end - tx_buf), &reply, sizeof(reply)))
+        return NULL;
+
+    if (!parse_reply_wr_coils(&reply, sizeof(reply))) return NULL;
+    return bits + (COUNT_TO_WORD(count) + 7u) / 8u;
+}
+
+const uint8_t *rtu_master_wr_coil_states(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    const uint8_t *const states)
+{
+    uint8_t bits[(BITS_MAX + 7) / 8];
+
+    // out of range count is rejected by make_request_wr_coils()
+    if (BITS_MAX < COUNT_TO_WORD(count)) return NULL;
+    master_bits_pack(bits, states, COUNT_TO_WORD(count));
+    if (!rtu_master_wr_coils(impl, addr, mem_addr, count, bits)) return NULL;
+    return states + COUNT_TO_WORD(count);
+}
+
+void *rtu_master_rd_wr_registers(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t rd_mem_addr,
+    const count_t rd_count,
+    data16_t *const rd_data,
+    const mem_addr_t wr_mem_addr,
+    const count_t wr_count,
+    const data16_t *const wr_data)
+{
+    char tx_buf[ADU_CAPACITY];
+    const char *req_end = make_request_rd_wr_registers(
+        addr, rd_mem_addr, rd_count, wr_mem_addr, wr_data, wr_count, tx_buf,
+        sizeof(tx_buf));
+
+    return rd_registers(impl, tx_buf, req_end, rd_count, rd_data);
+}
+
+const void *rtu_master_wr_registers(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    const data16_t *const data)
+{
+    if (!data || WR_REGISTERS_MAX < COUNT_TO_WORD(count)) return NULL;
 
+    const size_t data_size = COUNT_TO_WORD(count) * sizeof(data16_t);
+    const wr_registers_request_header_t header
+        = {.addr       = addr,
+           .fcode      = FCODE_WR_REGISTERS,
+           .mem_addr   = mem_addr,
+           .count      = count,
+           .byte_count = (uint8_t)data_size};
     wr_registers_reply_t reply;
 
-    if (!read_impl(impl, &reply, sizeof(reply))) return NULL;
+    if (!transact_gather(
+            impl, &header, sizeof(header), data, data_size, &reply,
+            sizeof(reply)))
+        return NULL;
 
     if (!parse_reply_wr_registers(&reply, sizeof(reply))) return NULL;
     return data + COUNT_TO_WORD(count);
@@ -111,18 +997,19 @@ const void *rtu_master_wr_bytes(
     const uint8_t count,
     const uint8_t *const bytes)
 {
-    char tx_buf[ADU_CAPACITY];
-
-    const char *req_end = make_request_wr_bytes(
-        addr, mem_addr, bytes, count, tx_buf, sizeof(tx_buf));
-
-    if (!req_end) return NULL;
-
-    if (!write_impl(impl, tx_buf, (size_t)(req_end - tx_buf))) return NULL;
+    if (!bytes || RANGE_CHUNK_MAX < count) return NULL;
 
+    const wr_bytes_request_header_t header
+        = {.addr     = addr,
+           .fcode    = FCODE_WR_BYTES,
+           .mem_addr = mem_addr,
+           .count    = count};
     wr_bytes_reply_t reply;
 
-    if (!read_impl(impl, &reply, sizeof(reply))) return NULL;
+    if (!transact_gather(
+            impl, &header, sizeof(header), bytes, count, &reply,
+            sizeof(reply)))
+        return NULL;
 
     if (!parse_reply_wr_bytes(&reply, sizeof(reply))) return NULL;
     return bytes + count;
@@ -142,18 +1029,196 @@ void *rtu_master_rd_bytes(
            .count    = count};
 
     if (!implace_crc(&req, sizeof(req))) return NULL;
-    if (!write_impl(impl, &req, sizeof(req))) return NULL;
 
-    char rx_buf[ADU_CAPACITY];
-    const size_t expected_size
-        = sizeof(rd_bytes_reply_header_t) + count + sizeof(crc_t);
+    rd_bytes_reply_header_t header;
 
-    if (!read_impl(impl, rx_buf, expected_size)) return NULL;
+    if (!transact_scatter(
+            impl, &req, sizeof(req), &header, sizeof(header), bytes, count))
+        return NULL;
 
-    const rd_bytes_reply_t *rep = parse_reply_rd_bytes(rx_buf, expected_size);
+    if (count != header.count) return NULL;
+    return bytes + count;
+}
 
-    if (!rep) return NULL;
+int rtu_master_prepare(
+    rtu_master_prepared_t *prepared,
+    const fcode_t fcode,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const count_t count)
+{
+    CHECK(prepared);
 
-    memcpy(bytes, rep->bytes, count);
-    return bytes + count;
+    const uint16_t n = COUNT_TO_WORD(count);
+    char *const tx   = prepared->tx;
+
+    memset(prepared, 0, sizeof(rtu_master_prepared_t));
+
+    make_request_rd_t make_request = NULL;
+
+    switch (fcode)
+    {
+    case FCODE_RD_COILS:
+        make_request           = make_request_rd_coils;
+        prepared->payload_size = (uint8_t)((n + 7u) / 8u);
+        break;
+    case FCODE_RD_INPUT:
+        make_request           = make_request_rd_inputs;
+        prepared->payload_size = (uint8_t)((n + 7u) / 8u);
+        break;
+    case FCODE_RD_HOLDING_REGISTERS:
+        make_request           = make_request_rd_holding_registers;
+        prepared->payload_size = (uint8_t)(n * sizeof(data16_t));
+        break;
+    case FCODE_RD_IN_REGISTERS:
+        make_request           = make_request_rd_input_registers;
+        prepared->payload_size = (uint8_t)(n * sizeof(data16_t));
+        break;
+    case FCODE_RD_BYTES:
+        if (UINT8_MAX < n) return 0;
+        prepared->payload_size = (uint8_t)n;
+        break;
+    default: return 0;
+    }
+
+    const char *const tx_end = make_request
+        ? make_request(addr, mem_addr, count, tx, sizeof(prepared->tx))
+        : make_request_rd_bytes(
+            addr, mem_addr, (uint8_t)n, tx, sizeof(prepared->tx));
+
+    if (!tx_end || !prepared->payload_size) return 0;
+    prepared->tx_size = (uint8_t)(tx_end - tx);
+
+    // reply header is fully determined by request
+    char *header = prepared->rx_header;
+
+    *header++ = (char)addr;
+    *header++ = (char)fcode;
+    if (FCODE_RD_BYTES == fcode)
+    {
+        *header++ = (char)mem_addr.high;
+        *header++ = (char)mem_addr.low;
+    }
+    *header++                = (char)prepared->payload_size;
+    prepared->rx_header_size = (uint8_t)(header - prepared->rx_header);
+    return 1;
+}
+
+void *rtu_master_poll(
+    rtu_master_impl_t *const impl,
+    const rtu_master_prepared_t *const prepared,
+    void *const data)
+{
+    CHECK(impl);
+    CHECK(prepared);
+    CHECK(prepared->tx_size);
+    CHECK(data);
+
+    char header[sizeof(prepared->rx_header)];
+
+    if (!transact_scatter(
+            impl, prepared->tx, prepared->tx_size, header,
+            prepared->rx_header_size, data, prepared->payload_size))
+        return NULL;
+
+    if (memcmp(header, prepared->rx_header, prepared->rx_header_size))
+        return NULL;
+    return (char *)data + prepared->payload_size;
+}
+
+static int range_chunk(
+    rtu_master_impl_t *impl,
+    const addr_t addr,
+    const uint16_t mem_addr,
+    const uint8_t count,
+    uint8_t *const bytes,
+    const int write)
+{
+    const mem_addr_t mem = WORD_TO_MEM_ADDR(mem_addr);
+
+    if (write) return !!rtu_master_wr_bytes(impl, addr, mem, count, bytes);
+    return !!rtu_master_rd_bytes(impl, addr, mem, count, bytes);
+}
+
+static void *range_impl(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const size_t count,
+    uint8_t *const bytes,
+    rtu_master_range_t *range,
+    const int write)
+{
+    CHECK(impl);
+    CHECK(bytes || !count);
+    CHECK(UINT32_C(0x10000) >= MEM_ADDR_TO_WORD(mem_addr) + count);
+
+    rtu_master_range_t defaults = {.retries = 0};
+
+    if (!range) range = &defaults;
+    memset(&range->stats, 0, sizeof(range->stats));
+    impl->ecode = 0;
+
+    const int64_t turnaround_ns = (int64_t)1000
+        * (range->turnaround_us ? range->turnaround_us
+                                : calc_3t5_us(impl->rate));
+    const int64_t begin_ns = timestamp_ns();
+    int64_t next_ns        = begin_ns;
+    size_t offset          = 0;
+
+    while (offset != count)
+    {
+        const uint8_t size = (uint8_t)min(count - offset, RANGE_CHUNK_MAX);
+        const uint16_t chunk_addr
+            = (uint16_t)(MEM_ADDR_TO_WORD(mem_addr) + offset);
+        int ok = 0;
+
+        // exception reply is final
+        for (int attempt = 0;
+             !ok && !impl->ecode && attempt <= range->retries; ++attempt)
+        {
+            if (attempt) ++range->stats.retries;
+            // frames are spaced exactly by silent interval
+            sleep_until_ns(next_ns);
+            ++range->stats.frames;
+            ok = range_chunk(
+                impl, addr, chunk_addr, size, bytes + offset, write);
+            next_ns = timestamp_ns() + turnaround_ns;
+        }
+
+        if (!ok) break;
+        offset += size;
+    }
+
+    range->stats.bytes      = offset;
+    range->stats.elapsed_us = (timestamp_ns() - begin_ns) / 1000;
+    range->stats.bytes_per_s
+        = range->stats.elapsed_us
+        ? (int64_t)offset * INT64_C(1000000) / range->stats.elapsed_us
+        : 0;
+
+    return offset == count ? bytes + count : NULL;
+}
+
+void *rtu_master_read_range(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const size_t count,
+    uint8_t *const bytes,
+    rtu_master_range_t *range)
+{
+    return range_impl(impl, addr, mem_addr, count, bytes, range, 0);
+}
+
+const void *rtu_master_write_range(
+    rtu_master_impl_t *const impl,
+    const addr_t addr,
+    const mem_addr_t mem_addr,
+    const size_t count,
+    const uint8_t *const bytes,
+    rtu_master_range_t *range)
+{
+    // bytes are not modified by write
+    return range_impl(impl, addr, mem_addr, count, (uint8_t *)bytes, range, 1);
 }
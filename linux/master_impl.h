@@ -4,8 +4,114 @@
 #include <stdint.h>
 
 #include "master.h"
+#include "master_trace.h"
 #include "rtu.h"
 #include "tty.h"
+#include "tty_uring.h"
+
+/* per slave response time estimate (Jacobson/Karels): smoothed first byte
+ * latency (reply start - request end on the wire) and its mean deviation,
+ * missed replies double the timeout (Karn) until next sample */
+typedef struct
+{
+    int64_t srtt_us;
+    int64_t rttvar_us;
+    uint32_t samples;
+    // doublings of timeout, reset by sample
+    uint32_t backoff;
+} rtu_master_rtt_t;
+
+typedef struct
+{
+    // bounds of adaptive response timeout
+    int64_t min_us;
+    int64_t max_us;
+    rtu_master_rtt_t slaves[256];
+} rtu_master_rtt_table_t;
+
+/* per slave health (circuit breaker)
+ * - closed: requests are sent, failed attempts are retried
+ * - open: slave failed failures_to_open transactions in a row, requests are
+ *   rejected immediately (no bus time) until backoff expires
+ * - half open: single probe request, success closes the circuit, failure
+ *   opens it again with doubled backoff (up to backoff_max_us)
+ * exception reply counts as success (slave is alive) */
+typedef enum
+{
+    RTU_MASTER_HEALTH_closed = 0,
+    RTU_MASTER_HEALTH_open,
+    RTU_MASTER_HEALTH_half_open
+} rtu_master_health_state_t;
+
+typedef struct
+{
+    // additional attempts of failed transaction (closed state only)
+    int retries;
+    int failures_to_open;
+    int64_t backoff_min_us;
+    int64_t backoff_max_us;
+} rtu_master_health_policy_t;
+
+typedef struct
+{
+    rtu_master_health_state_t state;
+    // failed transactions in a row
+    int failures;
+    int64_t backoff_us;
+    int64_t probe_ns;
+    struct
+    {
+        uint32_t transactions;
+        uint32_t retries;
+        uint32_t failures;
+        // not sent, circuit open
+        uint32_t rejected;
+        uint32_t opened;
+        uint32_t probes;
+    } stats;
+} rtu_master_health_t;
+
+typedef struct
+{
+    rtu_master_health_policy_t policy;
+    rtu_master_health_t slaves[256];
+} rtu_master_health_table_t;
+
+/* bus pacing: next request starts exactly min_gap_us (3.5t) plus margin of
+ * slave addressed by previous transaction after end of its reply (timeout,
+ * exception), back-to-back transactions run at maximum compliant rate,
+ * turnaround of layers above (range, mirror, shared) adds to it */
+typedef struct
+{
+    int64_t min_gap_us;
+    // extra silence per slave, e.g. slow turnaround, broadcast (addr 0)
+    int64_t margin_us[256];
+    // earliest start of next request, timestamp_ns()
+    int64_t next_tx_ns;
+    struct
+    {
+        uint32_t transactions;
+        // request was delayed to keep silent interval
+        uint32_t waits;
+        int64_t wait_total_us;
+    } stats;
+} rtu_master_pacing_t;
+
+/* io_uring transport (ring of single tty, not shared): request write and
+ * reply reads are submitted together, each io_uring_enter() submits and
+ * waits, multishot read stays armed between transactions */
+typedef struct
+{
+    tty_uring_t ring;
+    tty_dev_t *dev;
+    int armed;
+    struct
+    {
+        uint32_t transactions;
+        // io_uring_enter() calls
+        uint32_t enters;
+    } stats;
+} rtu_master_uring_t;
 
 typedef struct
 {
@@ -13,9 +119,116 @@ typedef struct
     speed_t rate;
     // command execution timeout, depends on hardware
     int timeout_exec_ms;
+    /* exception code of last transaction, 0: none (reply is recognized
+     * after 2 bytes, exception does not wait for full reply timeout) */
+    modbus_rtu_ecode_t ecode;
+    /* adaptive response timeout per slave, replaces timeout_exec_ms
+     * NULL: static timeout (timeout_exec_ms + 10ms) */
+    rtu_master_rtt_table_t *rtt;
+    // NULL: no retries, circuit is always closed
+    rtu_master_health_table_t *health;
+    // NULL: request is sent as soon as it is issued
+    rtu_master_pacing_t *pacing;
+    // NULL: no tracing, otherwise phases of last transaction (attempt)
+    rtu_master_trace_t *trace;
+    // NULL: no per slave latency histograms
+    rtu_master_latency_table_t *latency;
+    // NULL: poll based tty_read()/tty_write()
+    rtu_master_uring_t *uring;
 } rtu_master_impl_t;
 
-/* return: fail: NULL, success: data + count */
+void rtu_master_rtt_init(
+    rtu_master_rtt_table_t *, int64_t min_us, int64_t max_us);
+/* (srtt + 4 x rttvar) x 2^backoff bounded by [min_us, max_us], max_us until
+ * first sample
+ * return: response timeout (first byte latency) */
+int64_t
+rtu_master_rtt_timeout_us(const rtu_master_rtt_table_t *, modbus_rtu_addr_t);
+void rtu_master_rtt_update(
+    rtu_master_rtt_table_t *, modbus_rtu_addr_t, int64_t sample_us);
+// reply did not start within timeout, next one is doubled (up to max_us)
+void rtu_master_rtt_missed(rtu_master_rtt_table_t *, modbus_rtu_addr_t);
+
+// min_gap_us = 3.5t of rate, no margins
+void rtu_master_pacing_init(rtu_master_pacing_t *, speed_t rate);
+
+/* dev is switched to VMIN 1 (reads complete with data only)
+ * return: 0, -errno if io_uring or multishot read is not available (caller
+ * keeps poll based I/O) */
+int rtu_master_uring_init(rtu_master_uring_t *, tty_dev_t *);
+void rtu_master_uring_deinit(rtu_master_uring_t *);
+
+typedef struct
+{
+    // additional attempts of failed chunk (not on exception)
+    int retries;
+    // silent interval between frames (from reply end), 0: 3.5t
+    int turnaround_us;
+    struct
+    {
+        uint32_t frames;
+        uint32_t retries;
+        size_t bytes;
+        int64_t elapsed_us;
+        // payload throughput
+        int64_t bytes_per_s;
+    } stats;
+} rtu_master_range_t;
+
+/* pre-encoded read request for repeated polls (FC1, FC2, FC3, FC4, FC65)
+ * request bytes and CRC are encoded once, reply is validated against cached
+ * header (address, function code, byte count/address) and size */
+typedef struct
+{
+    // request ADU including CRC
+    char tx[sizeof(modbus_rtu_mem_access_request_t)];
+    uint8_t tx_size;
+    char rx_header[sizeof(modbus_rtu_rd_bytes_reply_header_t)];
+    uint8_t rx_header_size;
+    // registers/bits/bytes of reply
+    uint8_t payload_size;
+} rtu_master_prepared_t;
+
+void rtu_master_health_init(
+    rtu_master_health_table_t *, const rtu_master_health_policy_t *);
+
+/* bits: packed LSB first (see modbus_rtu_rd_bits_reply_t)
+ * return: fail: NULL (exception: see ecode), success: bits + (count + 7) / 8 */
+void *rtu_master_rd_coils(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t count,
+    uint8_t *bits);
+
+/* return: fail: NULL, success: bits + (count + 7) / 8 */
+void *rtu_master_rd_inputs(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t count,
+    uint8_t *bits);
+
+/* states: one byte per coil/input (0 OFF, 1 ON), see master_bits.h
+ * return: fail: NULL (exception: see ecode), success: states + count */
+uint8_t *rtu_master_rd_coil_states(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t count,
+    uint8_t *states);
+
+/* return: fail: NULL, success: states + count */
+uint8_t *rtu_master_rd_input_states(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t count,
+    uint8_t *states);
+
+/* replies of register/byte reads are received directly into data/bytes
+ * (no intermediate copy), their content is undefined on failure
+ * return: fail: NULL (exception: see ecode), success: data + count */
 void *rtu_master_rd_holding_registers(
     rtu_master_impl_t *,
     modbus_rtu_addr_t,
@@ -23,6 +236,48 @@ void *rtu_master_rd_holding_registers(
     modbus_rtu_count_t count,
     modbus_rtu_data16_t *data);
 
+/* return: fail: NULL, success: data + count */
+void *rtu_master_rd_input_registers(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t count,
+    modbus_rtu_data16_t *data);
+
+/* on: 0 OFF, otherwise ON
+ * return: fail: 0, success: 1 */
+int rtu_master_wr_coil(
+    rtu_master_impl_t *, modbus_rtu_addr_t, modbus_rtu_mem_addr_t, int on);
+
+/* return: fail: NULL, success: bits + (count + 7) / 8 */
+const void *rtu_master_wr_coils(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t count,
+    const uint8_t *bits);
+
+/* states: 0 OFF, otherwise ON
+ * return: fail: NULL, success: states + count */
+const uint8_t *rtu_master_wr_coil_states(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t count,
+    const uint8_t *states);
+
+/* write and read in single round trip (FC23), write is executed first
+ * return: fail: NULL (exception: see ecode), success: rd_data + rd_count */
+void *rtu_master_rd_wr_registers(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t rd_mem_addr,
+    modbus_rtu_count_t rd_count,
+    modbus_rtu_data16_t *rd_data,
+    modbus_rtu_mem_addr_t wr_mem_addr,
+    modbus_rtu_count_t wr_count,
+    const modbus_rtu_data16_t *wr_data);
+
 /* return: fail: NULL, success: data + count */
 const void *rtu_master_wr_registers(
     rtu_master_impl_t *,
@@ -46,3 +301,39 @@ void *rtu_master_rd_bytes(
     modbus_rtu_mem_addr_t,
     uint8_t count,
     uint8_t *bytes);
+
+/* count: registers (FC3, FC4), coils/inputs (FC1, FC2), bytes (FC65)
+ * return: 0 unsupported function code or count, 1 success */
+int rtu_master_prepare(
+    rtu_master_prepared_t *,
+    modbus_rtu_fcode_t,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t count);
+
+/* sends prepared request as is, payload is received into data
+ * (prepared->payload_size bytes)
+ * return: fail: NULL (exception: see ecode), success: data + payload_size */
+void *rtu_master_poll(
+    rtu_master_impl_t *, const rtu_master_prepared_t *, void *data);
+
+/* arbitrary length transfer: split into maximal FC65/FC66 frames (249 bytes)
+ * sent back-to-back with turnaround spacing, failed chunks are retried
+ * individually, range (NULL: defaults) receives aggregate stats
+ * return: fail: NULL, success: bytes + count */
+void *rtu_master_read_range(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    size_t count,
+    uint8_t *bytes,
+    rtu_master_range_t *range);
+
+/* return: fail: NULL, success: bytes + count */
+const void *rtu_master_write_range(
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    size_t count,
+    const uint8_t *bytes,
+    rtu_master_range_t *range);
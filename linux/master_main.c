@@ -0,0 +1,633 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "log.h"
+#include "master_impl.h"
+#include "master_trace.h"
+#include "time_util.h"
+#include "tty.h"
+#include "util.h"
+
+typedef modbus_rtu_data16_t data16_t;
+
+#define COILS_RD_MAX     2000
+#define COILS_WR_MAX     1968
+#define REGISTERS_RD_MAX 125
+#define REGISTERS_WR_MAX 123
+#define MEM_SIZE         0x10000
+#define LOOP_DEPTH_MAX   8
+#define LINE_SIZE_MAX    16384
+
+typedef enum
+{
+    CMD_rd_coils,
+    CMD_rd_inputs,
+    CMD_rd_registers,
+    CMD_rd_input_registers,
+    CMD_rd_bytes,
+    CMD_wr_coil,
+    CMD_wr_coils,
+    CMD_wr_registers,
+    CMD_wr_bytes,
+    CMD_addr,
+    CMD_sleep,
+    CMD_loop,
+    CMD_end
+} cmd_op_t;
+
+typedef struct
+{
+    const char *name;
+    cmd_op_t op;
+    // number of arguments
+    size_t min;
+    size_t max;
+} cmd_spec_t;
+
+static const cmd_spec_t cmd_specs[] = {
+    {"rd_coils", CMD_rd_coils, 2, 2},
+    {"rd_inputs", CMD_rd_inputs, 2, 2},
+    {"rd_registers", CMD_rd_registers, 2, 2},
+    {"rd_input_registers", CMD_rd_input_registers, 2, 2},
+    {"rd_bytes", CMD_rd_bytes, 2, 2},
+    {"wr_coil", CMD_wr_coil, 2, 2},
+    {"wr_coils", CMD_wr_coils, 2, 1 + COILS_WR_MAX},
+    {"wr_registers", CMD_wr_registers, 2, 1 + REGISTERS_WR_MAX},
+    {"wr_bytes", CMD_wr_bytes, 2, MEM_SIZE},
+    {"addr", CMD_addr, 1, 1},
+    {"sleep", CMD_sleep, 1, 1},
+    {"loop", CMD_loop, 1, 1},
+    {"end", CMD_end, 0, 0}};
+
+typedef struct
+{
+    cmd_op_t op;
+    // script line (1 based), 0: -c
+    size_t line;
+    long *args;
+    size_t args_num;
+    // loop: index of matching end
+    size_t match;
+} cmd_t;
+
+typedef struct
+{
+    cmd_t *cmds;
+    size_t size;
+    size_t capacity;
+    // indices of open loops
+    size_t loops[LOOP_DEPTH_MAX];
+    size_t loops_num;
+} script_t;
+
+typedef struct
+{
+    rtu_master_impl_t *impl;
+    modbus_rtu_addr_t addr;
+    int verbose;
+    struct
+    {
+        uint64_t requests;
+        uint64_t ok;
+        // no reply byte until deadline
+        uint64_t timeouts;
+        // incomplete reply, CRC mismatch, unexpected content
+        uint64_t invalid;
+        uint64_t exceptions[256];
+    } stats;
+} ctx_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig_no)
+{
+    stop_requested = 1;
+}
+
+static void help(const char *argv0, const char *message)
+{
+    if (message) printf("%s: %s\n", argv0, message);
+    printf(
+        "%s:"
+        " -a rtu_address"
+        " -d device_path"
+        " (-c command | -f script_path ('-' stdin))..."
+        " [-r rate (19200)]"
+        " [-p parity E/O/N (E)]"
+        " [-t exec timeout ms (50)]"
+        " [-g turnaround margin us after reply (0)]"
+        " [-n script repetitions (1), 0: until SIGINT]"
+        " [-v print read values]"
+        " [-C latency csv path]"
+        " [-D tty_debug_size (0)]"
+        " [-U io_uring transport]\n",
+        argv0);
+    printf(
+        "%s: commands (one per script line, '#' comment, numbers in C"
+        " notation):\n"
+        "  rd_coils|rd_inputs mem_addr count (1..%d)\n"
+        "  rd_registers|rd_input_registers mem_addr count (1..%d)\n"
+        "  rd_bytes mem_addr count (FC65, split into 249 byte frames)\n"
+        "  wr_coil mem_addr 0|1\n"
+        "  wr_coils mem_addr state... (1..%d)\n"
+        "  wr_registers mem_addr value... (1..%d)\n"
+        "  wr_bytes mem_addr value... (FC66, split into 249 byte frames)\n"
+        "  addr rtu_address (following commands)\n"
+        "  sleep ms\n"
+        "  loop count ... end (nested up to %d)\n",
+        argv0, COILS_RD_MAX, REGISTERS_RD_MAX, COILS_WR_MAX,
+        REGISTERS_WR_MAX, LOOP_DEPTH_MAX);
+    exit(message ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void parse_error(size_t line, const char *message, const char *what)
+{
+    if (line) fprintf(stderr, "line %zu: ", line);
+    else fprintf(stderr, "-c: ");
+    fprintf(stderr, "%s %s\n", message, what ? what : "");
+    exit(EXIT_FAILURE);
+}
+
+static speed_t parse_speed(const char *str)
+{
+    const int bps = str ? atoi(str) : 0;
+
+    // non-standard rates are configured with termios2 (BOTHER)
+    if (0 < bps) return tty_speed(bps);
+    logW("unsupported rate %s, fallback to 19200", str ? str : "NULL");
+    return B19200;
+}
+
+static parity_t parse_parity(const char *str)
+{
+    if (!str) goto fallback;
+    if (0 == strcmp(str, "E")) return PARITY_even;
+    if (0 == strcmp(str, "O")) return PARITY_odd;
+    if (0 == strcmp(str, "N")) return PARITY_none;
+fallback:
+    logW("unsupported parity %s, fallback to Even", str ? str : "NULL");
+    return PARITY_even;
+}
+
+static void
+check_range(size_t line, long value, long min_value, long max_value)
+{
+    if (min_value <= value && max_value >= value) return;
+
+    char what[64];
+
+    snprintf(
+        what, sizeof(what), "%ld not in [%ld, %ld]", value, min_value,
+        max_value);
+    parse_error(line, "argument", what);
+}
+
+static void validate(const cmd_t *cmd)
+{
+    const long *const args = cmd->args;
+    const size_t values    = cmd->args_num - 1;
+
+    switch (cmd->op)
+    {
+    case CMD_rd_coils:
+    case CMD_rd_inputs:
+        check_range(cmd->line, args[1], 1, COILS_RD_MAX);
+        break;
+    case CMD_rd_registers:
+    case CMD_rd_input_registers:
+        check_range(cmd->line, args[1], 1, REGISTERS_RD_MAX);
+        break;
+    case CMD_rd_bytes: check_range(cmd->line, args[1], 1, MEM_SIZE); break;
+    case CMD_wr_coil:
+    case CMD_wr_coils:
+        for (size_t i = 1; i < cmd->args_num; ++i)
+            check_range(cmd->line, args[i], 0, 1);
+        break;
+    case CMD_wr_registers:
+        for (size_t i = 1; i < cmd->args_num; ++i)
+            check_range(cmd->line, args[i], 0, UINT16_MAX);
+        break;
+    case CMD_wr_bytes:
+        for (size_t i = 1; i < cmd->args_num; ++i)
+            check_range(cmd->line, args[i], 0, UINT8_MAX);
+        break;
+    case CMD_addr: check_range(cmd->line, args[0], 0, 247); return;
+    case CMD_sleep: check_range(cmd->line, args[0], 0, INT32_MAX); return;
+    case CMD_loop: check_range(cmd->line, args[0], 0, INT32_MAX); return;
+    case CMD_end: return;
+    }
+
+    // memory access
+    const long count = CMD_wr_coil == cmd->op ? 1
+                     : CMD_wr_coils == cmd->op || CMD_wr_registers == cmd->op
+                             || CMD_wr_bytes == cmd->op
+                         ? (long)values
+                         : args[1];
+
+    check_range(cmd->line, args[0], 0, MEM_SIZE - 1);
+    check_range(cmd->line, args[0] + count, 1, MEM_SIZE);
+}
+
+static void script_push(script_t *script, cmd_t cmd)
+{
+    if (script->size == script->capacity)
+    {
+        script->capacity = script->capacity ? 2 * script->capacity : 64;
+        script->cmds
+            = realloc(script->cmds, script->capacity * sizeof(cmd_t));
+        CHECK_ERRNO(script->cmds);
+    }
+
+    if (CMD_loop == cmd.op)
+    {
+        if (LOOP_DEPTH_MAX == script->loops_num)
+            parse_error(cmd.line, "loops nested too deep", NULL);
+        script->loops[script->loops_num++] = script->size;
+    }
+    else if (CMD_end == cmd.op)
+    {
+        if (!script->loops_num) parse_error(cmd.line, "end without loop", NULL);
+        script->cmds[script->loops[--script->loops_num]].match = script->size;
+    }
+    script->cmds[script->size++] = cmd;
+}
+
+static void parse_line(script_t *script, char *str, size_t line)
+{
+    char *const comment = strchr(str, '#');
+
+    if (comment) *comment = '\0';
+
+    char *save      = NULL;
+    const char *tok = strtok_r(str, " \t\r\n", &save);
+
+    if (!tok) return;
+
+    const cmd_spec_t *spec = NULL;
+
+    for (size_t i = 0; i < length_of(cmd_specs) && !spec; ++i)
+    {
+        if (!strcmp(tok, cmd_specs[i].name)) spec = &cmd_specs[i];
+    }
+    if (!spec) parse_error(line, "unknown command", tok);
+
+    cmd_t cmd = {.op = spec->op, .line = line, .args = NULL, .args_num = 0};
+    size_t capacity = 0;
+
+    while ((tok = strtok_r(NULL, " \t\r\n", &save)))
+    {
+        char *end = NULL;
+
+        if (spec->max == cmd.args_num)
+            parse_error(line, "too many arguments for", spec->name);
+        // wr_bytes allows MEM_SIZE values, grow with what the line has
+        if (capacity == cmd.args_num)
+        {
+            capacity = capacity ? 2 * capacity : 4;
+            if (capacity > spec->max) capacity = spec->max;
+            cmd.args = realloc(cmd.args, capacity * sizeof(long));
+            CHECK_ERRNO(cmd.args);
+        }
+        cmd.args[cmd.args_num++] = strtol(tok, &end, 0);
+        if (!end || *end) parse_error(line, "not a number", tok);
+    }
+
+    if (spec->min > cmd.args_num)
+        parse_error(line, "missing arguments for", spec->name);
+    validate(&cmd);
+    script_push(script, cmd);
+}
+
+static void parse_file(script_t *script, const char *path)
+{
+    FILE *const file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+
+    if (!file)
+    {
+        fprintf(stderr, "can not open script %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    char str[LINE_SIZE_MAX];
+
+    for (size_t line = 1; fgets(str, sizeof(str), file); ++line)
+    {
+        if (!strchr(str, '\n') && !feof(file))
+            parse_error(line, "line too long", NULL);
+        parse_line(script, str, line);
+    }
+
+    if (stdin != file) fclose(file);
+}
+
+static void print_values(const cmd_t *cmd, const void *values, int registers)
+{
+    const uint8_t *const bytes  = values;
+    const data16_t *const words = values;
+    const size_t count          = (size_t)cmd->args[1];
+
+    printf("%s 0x%04lX:", cmd_specs[cmd->op].name, cmd->args[0]);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (registers) printf(" 0x%04X", (unsigned)DATA16_TO_WORD(words[i]));
+        else printf(" %u", (unsigned)bytes[i]);
+    }
+    printf("\n");
+}
+
+static void request(ctx_t *ctx, const cmd_t *cmd)
+{
+    static data16_t registers[REGISTERS_RD_MAX];
+    static uint8_t bytes[MEM_SIZE];
+    rtu_master_impl_t *const impl   = ctx->impl;
+    const modbus_rtu_addr_t addr    = ctx->addr;
+    const modbus_rtu_mem_addr_t mem = WORD_TO_MEM_ADDR(cmd->args[0]);
+    // values/count following mem_addr
+    const long *const args = cmd->args + 1;
+    const size_t values    = cmd->args_num - 1;
+    int ok                 = 0;
+
+    switch (cmd->op)
+    {
+    case CMD_rd_coils:
+        ok = !!rtu_master_rd_coil_states(
+            impl, addr, mem, WORD_TO_COUNT(args[0]), bytes);
+        break;
+    case CMD_rd_inputs:
+        ok = !!rtu_master_rd_input_states(
+            impl, addr, mem, WORD_TO_COUNT(args[0]), bytes);
+        break;
+    case CMD_rd_registers:
+        ok = !!rtu_master_rd_holding_registers(
+            impl, addr, mem, WORD_TO_COUNT(args[0]), registers);
+        break;
+    case CMD_rd_input_registers:
+        ok = !!rtu_master_rd_input_registers(
+            impl, addr, mem, WORD_TO_COUNT(args[0]), registers);
+        break;
+    case CMD_rd_bytes:
+        ok = !!rtu_master_read_range(
+            impl, addr, mem, (size_t)args[0], bytes, NULL);
+        break;
+    case CMD_wr_coil:
+        ok = rtu_master_wr_coil(impl, addr, mem, (int)args[0]);
+        break;
+    case CMD_wr_coils:
+    case CMD_wr_bytes:
+        for (size_t i = 0; i < values; ++i) bytes[i] = (uint8_t)args[i];
+        ok = CMD_wr_coils == cmd->op
+               ? !!rtu_master_wr_coil_states(
+                   impl, addr, mem, WORD_TO_COUNT(values), bytes)
+               : !!rtu_master_write_range(
+                   impl, addr, mem, values, bytes, NULL);
+        break;
+    case CMD_wr_registers:
+        for (size_t i = 0; i < values; ++i)
+            registers[i] = WORD_TO_DATA16(args[i]);
+        ok = !!rtu_master_wr_registers(
+            impl, addr, mem, WORD_TO_COUNT(values), registers);
+        break;
+    default: CHECK(0);
+    }
+
+    // interrupted by SIGINT/SIGTERM, not a bus failure
+    if (!ok && stop_requested) return;
+
+    ++ctx->stats.requests;
+    if (ok) ++ctx->stats.ok;
+    else if (impl->ecode) ++ctx->stats.exceptions[impl->ecode];
+    else if (!impl->trace->rx_bytes) ++ctx->stats.timeouts;
+    else ++ctx->stats.invalid;
+
+    if (!ok)
+    {
+        logW(
+            "%s addr %u mem 0x%04lX failed, ecode 0x%02X",
+            cmd_specs[cmd->op].name, (unsigned)addr, cmd->args[0],
+            (unsigned)impl->ecode);
+        return;
+    }
+
+    if (!ctx->verbose) return;
+
+    switch (cmd->op)
+    {
+    case CMD_rd_coils:
+    case CMD_rd_inputs:
+    case CMD_rd_bytes: print_values(cmd, bytes, 0); break;
+    case CMD_rd_registers:
+    case CMD_rd_input_registers: print_values(cmd, registers, 1); break;
+    default: break;
+    }
+}
+
+static void run(ctx_t *ctx, const script_t *script, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end && !stop_requested; ++i)
+    {
+        const cmd_t *const cmd = &script->cmds[i];
+
+        switch (cmd->op)
+        {
+        case CMD_addr: ctx->addr = (modbus_rtu_addr_t)cmd->args[0]; break;
+        case CMD_sleep:
+            sleep_until_ns(timestamp_ns() + cmd->args[0] * INT64_C(1000000));
+            break;
+        case CMD_loop:
+            for (long n = 0; n < cmd->args[0] && !stop_requested; ++n)
+                run(ctx, script, i + 1, cmd->match);
+            i = cmd->match;
+            break;
+        case CMD_end: break;
+        default: request(ctx, cmd); break;
+        }
+    }
+}
+
+static void report(
+    const ctx_t *ctx, const rtu_master_latency_table_t *latency, int64_t ns)
+{
+    const double elapsed_s = (double)ns / 1e9;
+    uint64_t frames        = 0;
+
+    for (size_t i = 0; i < length_of(latency->slaves); ++i)
+        frames += latency->slaves[i].transactions;
+
+    printf(
+        "requests %" PRIu64 " ok %" PRIu64 " failed %" PRIu64
+        " (timeout %" PRIu64 " invalid reply %" PRIu64,
+        ctx->stats.requests, ctx->stats.ok,
+        ctx->stats.requests - ctx->stats.ok, ctx->stats.timeouts,
+        ctx->stats.invalid);
+    for (size_t ecode = 0; ecode < length_of(ctx->stats.exceptions); ++ecode)
+    {
+        if (!ctx->stats.exceptions[ecode]) continue;
+        printf(
+            " exception 0x%02zX %" PRIu64, ecode,
+            ctx->stats.exceptions[ecode]);
+    }
+    printf(")\n");
+    printf(
+        "elapsed %.3f s, %.1f requests/s, %" PRIu64 " frames %.1f frames/s\n",
+        elapsed_s, elapsed_s > 0 ? (double)ctx->stats.requests / elapsed_s : 0,
+        frames, elapsed_s > 0 ? (double)frames / elapsed_s : 0);
+
+    const rtu_master_phase_t phases[]
+        = {RTU_MASTER_PHASE_total, RTU_MASTER_PHASE_response};
+    const char *const names[] = {"round trip", "response"};
+
+    for (size_t addr = 0; addr < length_of(latency->slaves); ++addr)
+    {
+        const rtu_master_latency_t *const slave = &latency->slaves[addr];
+
+        if (!slave->transactions) continue;
+
+        for (size_t i = 0; i < length_of(phases); ++i)
+        {
+            // no reply at all
+            if (-1 == rtu_master_latency_percentile_us(slave, phases[i], 500))
+                continue;
+            printf(
+                "addr %zu %s us: p50 %" PRId64 " p90 %" PRId64 " p99 %" PRId64
+                " max %" PRId64 "\n",
+                addr, names[i],
+                rtu_master_latency_percentile_us(slave, phases[i], 500),
+                rtu_master_latency_percentile_us(slave, phases[i], 900),
+                rtu_master_latency_percentile_us(slave, phases[i], 990),
+                slave->max_us[phases[i]]);
+        }
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    const char *path     = NULL;
+    const char *csv_path = NULL;
+    speed_t rate         = B19200;
+    parity_t parity      = PARITY_even;
+    int debug_size       = 0;
+    int addr             = -1;
+    int timeout_exec_ms  = 50;
+    int64_t margin_us    = 0;
+    long repetitions     = 1;
+    int verbose          = 0;
+    int use_uring        = 0;
+    script_t script;
+
+    memset(&script, 0, sizeof(script));
+
+    for (int c;
+         -1 != (c = getopt(argc, (char **)argv, "C:D:Ua:c:d:f:g:hn:p:r:t:v"));)
+    {
+        switch (c)
+        {
+        case 'C': csv_path = optarg; break;
+        case 'D': debug_size = optarg ? atoi(optarg) : 0; break;
+        case 'U': use_uring = 1; break;
+        case 'a': addr = optarg ? atoi(optarg) : -1; break;
+        case 'c':
+        {
+            char *const line = strdup(optarg);
+
+            CHECK_ERRNO(line);
+            parse_line(&script, line, 0);
+            free(line);
+            break;
+        }
+        case 'd': path = optarg; break;
+        case 'f': parse_file(&script, optarg); break;
+        case 'g': margin_us = optarg ? atoll(optarg) : 0; break;
+        case 'h': help(argv[0], NULL); break;
+        case 'n': repetitions = optarg ? atol(optarg) : 1; break;
+        case 'p': parity = parse_parity(optarg); break;
+        case 'r': rate = parse_speed(optarg); break;
+        case 't': timeout_exec_ms = optarg ? atoi(optarg) : 50; break;
+        case 'v': verbose = 1; break;
+        case ':':
+        case '?':
+        default: help(argv[0], "geopt() failure"); break;
+        }
+    }
+
+    if (!path) help(argv[0], "device path missing");
+    if (0 > addr || 247 < addr) help(argv[0], "address missing");
+    if (!script.size) help(argv[0], "no command");
+    if (script.loops_num) help(argv[0], "loop without end");
+
+    tty_dev_t dev;
+
+    tty_init(&dev, debug_size);
+    tty_open(&dev, path, NULL);
+    tty_exclusive_on(dev.fd);
+    tty_configure(
+        &dev, rate, parity, DATA_BITS_8,
+        PARITY_none == parity ? STOP_BITS_2 : STOP_BITS_1);
+    tty_flush(dev.fd);
+
+    rtu_master_pacing_t pacing;
+    rtu_master_trace_t trace;
+    rtu_master_latency_table_t *const latency
+        = malloc(sizeof(rtu_master_latency_table_t));
+
+    CHECK_ERRNO(latency);
+    rtu_master_pacing_init(&pacing, rate);
+    rtu_master_latency_init(latency);
+
+    // back-to-back at 3.5t (plus margin) after every reply
+    for (size_t i = 0; i < length_of(pacing.margin_us); ++i)
+        pacing.margin_us[i] = margin_us;
+
+    rtu_master_impl_t impl
+        = {.dev             = &dev,
+           .rate            = rate,
+           .timeout_exec_ms = timeout_exec_ms,
+           .pacing          = &pacing,
+           .trace           = &trace,
+           .latency         = latency};
+    rtu_master_uring_t uring;
+
+    if (use_uring)
+    {
+        const int r = rtu_master_uring_init(&uring, &dev);
+
+        if (r) logW("io_uring not available (%s), using poll", strerror(-r));
+        else impl.uring = &uring;
+    }
+
+    ctx_t ctx
+        = {.impl = &impl, .addr = (modbus_rtu_addr_t)addr, .verbose = verbose};
+
+    set_signal_handler(SIGINT, on_signal, NULL);
+    set_signal_handler(SIGTERM, on_signal, NULL);
+
+    const int64_t begin_ns = timestamp_ns();
+
+    for (long n = 0; (!repetitions || n < repetitions) && !stop_requested; ++n)
+        run(&ctx, &script, 0, script.size);
+
+    report(&ctx, latency, timestamp_ns() - begin_ns);
+
+    if (csv_path)
+    {
+        FILE *const file = fopen(csv_path, "w");
+
+        CHECK_ERRNO(file);
+        rtu_master_latency_export(latency, file);
+        fclose(file);
+    }
+
+    for (size_t i = 0; i < script.size; ++i) free(script.cmds[i].args);
+    free(script.cmds);
+    free(latency);
+    if (impl.uring) rtu_master_uring_deinit(impl.uring);
+    tty_close(&dev);
+    tty_deinit(&dev);
+    return ctx.stats.requests == ctx.stats.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "log.h"
+#include "master_mirror.h"
+#include "rtu_impl.h"
+#include "time_util.h"
+#include "util.h"
+
+#define FRAME_BYTES_MAX 249
+// 3.5t rounded up to characters
+#define SILENT_CHARS 4
+
+#define WR_FRAME_COST                                                      \
+    (sizeof(modbus_rtu_wr_bytes_request_header_t) + sizeof(modbus_rtu_crc_t) \
+     + sizeof(modbus_rtu_wr_bytes_reply_t) + SILENT_CHARS)
+#define RD_FRAME_COST                                                      \
+    (sizeof(modbus_rtu_rd_bytes_request_t)                                 \
+     + sizeof(modbus_rtu_rd_bytes_reply_header_t) + sizeof(modbus_rtu_crc_t) \
+     + SILENT_CHARS)
+
+static int test_bit(const uint8_t *map, size_t i)
+{
+    return map[i / 8] >> (i % 8) & 1;
+}
+
+static void set_bits(uint8_t *map, size_t begin, size_t end, int value)
+{
+    for (size_t i = begin; i != end; ++i)
+    {
+        if (value) map[i / 8] |= (uint8_t)(1u << (i % 8));
+        else map[i / 8] &= (uint8_t)~(1u << (i % 8));
+    }
+}
+
+// return: first set bit >= begin, size if none
+static size_t next_bit(const uint8_t *map, size_t begin, size_t size)
+{
+    size_t i = begin;
+
+    while (i < size)
+    {
+        // skip clean bitmap bytes at once
+        if (!(i % 8) && !map[i / 8])
+        {
+            i += 8;
+            continue;
+        }
+        if (test_bit(map, i)) return i;
+        ++i;
+    }
+    return size;
+}
+
+static size_t count_bits(const uint8_t *map, size_t size)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < size; ++i) n += (size_t)test_bit(map, i);
+    return n;
+}
+
+void master_mirror_init(
+    master_mirror_t *mirror,
+    rtu_master_impl_t *impl,
+    modbus_rtu_addr_t addr,
+    uint16_t mem_addr,
+    size_t size)
+{
+    CHECK(mirror);
+    CHECK(impl);
+    CHECK(size);
+    CHECK(UINT32_C(0x10000) >= mem_addr + size);
+
+    const size_t map_size = (size + 7) / 8;
+
+    memset(mirror, 0, sizeof(master_mirror_t));
+    mirror->impl          = impl;
+    mirror->addr          = addr;
+    mirror->mem_addr      = mem_addr;
+    mirror->size          = size;
+    mirror->wr_gap        = WR_FRAME_COST;
+    mirror->rd_gap        = RD_FRAME_COST;
+    mirror->turnaround_us = calc_3t5_us(impl->rate);
+    CHECK_ERRNO(NULL != (mirror->data = calloc(size, 1)));
+    CHECK_ERRNO(NULL != (mirror->dirty = calloc(map_size, 1)));
+    CHECK_ERRNO(NULL != (mirror->stale = calloc(map_size, 1)));
+    set_bits(mirror->stale, 0, size, 1);
+}
+
+void master_mirror_deinit(master_mirror_t *mirror)
+{
+    if (!mirror) return;
+    free(mirror->data);
+    free(mirror->dirty);
+    free(mirror->stale);
+    mirror->data  = NULL;
+    mirror->dirty = NULL;
+    mirror->stale = NULL;
+}
+
+void master_mirror_write(
+    master_mirror_t *mirror, size_t offset, const void *bytes, size_t count)
+{
+    CHECK(mirror);
+    CHECK(bytes || !count);
+    CHECK(offset <= mirror->size && count <= mirror->size - offset);
+
+    const uint8_t *src = bytes;
+
+    for (size_t i = offset; i != offset + count; ++i, ++src)
+    {
+        // value of stale byte on slave is unknown, has to be written
+        if (mirror->data[i] == *src && !test_bit(mirror->stale, i)) continue;
+        mirror->data[i] = *src;
+        set_bits(mirror->dirty, i, i + 1, 1);
+        set_bits(mirror->stale, i, i + 1, 0);
+    }
+}
+
+void master_mirror_invalidate(
+    master_mirror_t *mirror, size_t offset, size_t count)
+{
+    CHECK(mirror);
+    CHECK(offset <= mirror->size && count <= mirror->size - offset);
+
+    // pending writes win, slave value is going to be overwritten anyway
+    for (size_t i = offset; i != offset + count; ++i)
+    {
+        if (!test_bit(mirror->dirty, i)) set_bits(mirror->stale, i, i + 1, 1);
+    }
+}
+
+size_t master_mirror_dirty(const master_mirror_t *mirror)
+{
+    CHECK(mirror);
+    return count_bits(mirror->dirty, mirror->size);
+}
+
+size_t master_mirror_stale(const master_mirror_t *mirror)
+{
+    CHECK(mirror);
+    return count_bits(mirror->stale, mirror->size);
+}
+
+/* return: end of frame starting at begin (set bit of map), bytes with bit
+ * set in other map are not known to match slave and end the frame */
+static size_t run_end(
+    const uint8_t *map,
+    const uint8_t *other,
+    size_t begin,
+    size_t size,
+    size_t gap)
+{
+    const size_t limit = min(size, begin + FRAME_BYTES_MAX);
+    size_t end         = begin + 1;
+
+    for (size_t i = end; i < limit; ++i)
+    {
+        if (test_bit(map, i)) end = i + 1;
+        else if (test_bit(other, i) || i - end >= gap) break;
+    }
+    return end;
+}
+
+static int sync_pass(master_mirror_t *mirror, int write, int64_t *next_ns)
+{
+    uint8_t *const map   = write ? mirror->dirty : mirror->stale;
+    uint8_t *const other = write ? mirror->stale : mirror->dirty;
+    const size_t gap     = write ? mirror->wr_gap : mirror->rd_gap;
+    int ok               = 1;
+
+    for (size_t begin = next_bit(map, 0, mirror->size); begin < mirror->size;)
+    {
+        const size_t end = run_end(map, other, begin, mirror->size, gap);
+        const modbus_rtu_mem_addr_t mem
+            = WORD_TO_MEM_ADDR((uint16_t)(mirror->mem_addr + begin));
+        const uint8_t count = (uint8_t)(end - begin);
+        int frame_ok        = 0;
+
+        sleep_until_ns(*next_ns);
+        if (write)
+        {
+            frame_ok = !!rtu_master_wr_bytes(
+                mirror->impl, mirror->addr, mem, count, mirror->data + begin);
+            ++mirror->stats.wr_frames;
+            mirror->stats.wr_bytes += count;
+        }
+        else
+        {
+            frame_ok = !!rtu_master_rd_bytes(
+                mirror->impl, mirror->addr, mem, count, mirror->data + begin);
+            ++mirror->stats.rd_frames;
+            mirror->stats.rd_bytes += count;
+        }
+        *next_ns = timestamp_ns() + (int64_t)mirror->turnaround_us * 1000;
+
+        logD(
+            "%d mirror addr %u %s [%zu, %zu) %s", mirror->impl->dev->fd,
+            (unsigned)mirror->addr, write ? "wr" : "rd", begin, end,
+            frame_ok ? "ok" : "failed");
+
+        if (frame_ok) set_bits(map, begin, end, 0);
+        else
+        {
+            // failed read is received into shadow, whole frame is unknown
+            if (!write) set_bits(map, begin, end, 1);
+            ++mirror->stats.failures;
+            ok = 0;
+        }
+        begin = next_bit(map, end, mirror->size);
+    }
+    return ok;
+}
+
+int master_mirror_sync(master_mirror_t *mirror)
+{
+    CHECK(mirror);
+
+    int64_t next_ns = timestamp_ns();
+
+    ++mirror->stats.syncs;
+    // writes first, reads never overwrite dirty bytes
+    const int wr_ok = sync_pass(mirror, 1, &next_ns);
+    const int rd_ok = sync_pass(mirror, 0, &next_ns);
+
+    return wr_ok && rd_ok;
+}
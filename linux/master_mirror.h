@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "master_impl.h"
+
+/* master side shadow copy of a slave byte memory window
+ *
+ * - master_mirror_write() updates the shadow, only bytes that really change
+ *   are marked dirty
+ * - master_mirror_invalidate() marks bytes stale (slave owned, e.g. inputs)
+ * - master_mirror_sync() pushes dirty bytes with FC66 and refreshes stale
+ *   bytes with FC65 (<= 249 bytes per frame), runs separated by at most gap
+ *   bytes are merged into one frame as long as resending/rereading the gap
+ *   is cheaper than another frame (request and reply headers, 3.5t), stale
+ *   bytes are never written back
+ * - bits of failed frames stay set, next sync retries them
+ *
+ * FC66 carries one byte per memory unit, FC16 would double the payload of
+ * the same window and is not used */
+
+typedef struct
+{
+    rtu_master_impl_t *impl;
+    modbus_rtu_addr_t addr;
+    // memory unit of data[0], host order
+    uint16_t mem_addr;
+    size_t size;
+    // shadow, read directly, write by master_mirror_write()
+    uint8_t *data;
+    // max merged gap of writes/reads, default: cost of frame overhead
+    size_t wr_gap;
+    size_t rd_gap;
+    // silent interval between frames (default 3.5t), can be overridden
+    int turnaround_us;
+    struct
+    {
+        uint32_t syncs;
+        uint32_t wr_frames;
+        uint32_t rd_frames;
+        // payload including merged gaps
+        size_t wr_bytes;
+        size_t rd_bytes;
+        uint32_t failures;
+    } stats;
+    // private, bitmaps of size bits
+    uint8_t *dirty;
+    uint8_t *stale;
+} master_mirror_t;
+
+/* shadow is zeroed and all bytes are stale (first sync reads whole window)
+ * mem_addr + size has to fit 16 bit memory address space */
+void master_mirror_init(
+    master_mirror_t *,
+    rtu_master_impl_t *,
+    modbus_rtu_addr_t,
+    uint16_t mem_addr,
+    size_t size);
+void master_mirror_deinit(master_mirror_t *);
+// offset is relative to mem_addr
+void master_mirror_write(
+    master_mirror_t *, size_t offset, const void *bytes, size_t count);
+void master_mirror_invalidate(master_mirror_t *, size_t offset, size_t count);
+// return: number of dirty/stale bytes
+size_t master_mirror_dirty(const master_mirror_t *);
+size_t master_mirror_stale(const master_mirror_t *);
+// return: 1 all frames succeeded, 0 otherwise
+int master_mirror_sync(master_mirror_t *);
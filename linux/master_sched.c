@@ -0,0 +1,229 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "check.h"
+#include "master_sched.h"
+#include "time_util.h"
+#include "util.h"
+
+static void overrun(
+    master_sched_t *sched,
+    master_sched_entry_t *entry,
+    master_sched_overrun_t what)
+{
+    if (sched->overrun_cb) sched->overrun_cb(entry, what);
+}
+
+static void complete(master_async_req_t *req)
+{
+    master_sched_entry_t *entry = req->user_data;
+    master_sched_t *sched       = entry->sched;
+
+    entry->pending   = 0;
+    entry->in_flight = 0;
+    ++entry->stats.completed;
+
+    if (req->timing.complete_ns > entry->deadline_ns)
+    {
+        ++entry->stats.deadline_misses;
+        overrun(sched, entry, MASTER_SCHED_deadline_miss);
+    }
+    if (entry->cb) entry->cb(entry);
+}
+
+void master_sched_init(
+    master_sched_t *sched,
+    master_async_t *engine,
+    master_sched_entry_t *entries,
+    size_t entries_num,
+    int64_t cycle_us)
+{
+    CHECK(sched);
+    CHECK(engine);
+    CHECK(entries || !entries_num);
+    CHECK(0 <= cycle_us);
+
+    memset(sched, 0, sizeof(master_sched_t));
+    sched->engine      = engine;
+    sched->entries     = entries;
+    sched->entries_num = entries_num;
+    sched->cycle_us    = cycle_us;
+
+    for (master_sched_entry_t *entry = entries;
+         entry != entries + entries_num; ++entry)
+    {
+        CHECK(entry->bus);
+        CHECK(0 < entry->period_us);
+        CHECK(entry->deadline_us <= entry->period_us);
+        CHECK(!cycle_us || !(entry->period_us % cycle_us));
+        if (!entry->deadline_us) entry->deadline_us = entry->period_us;
+
+        entry->sched         = sched;
+        entry->req.cb        = complete;
+        entry->req.user_data = entry;
+    }
+}
+
+void master_sched_deinit(master_sched_t *sched)
+{
+    if (!sched) return;
+    sched->engine = NULL;
+}
+
+void master_sched_start(master_sched_t *sched)
+{
+    CHECK(sched);
+    CHECK(sched->engine);
+
+    const int64_t now_ns = timestamp_ns();
+
+    sched->cycle_ns = now_ns;
+    memset(&sched->stats, 0, sizeof(sched->stats));
+
+    for (master_sched_entry_t *entry = sched->entries;
+         entry != sched->entries + sched->entries_num; ++entry)
+    {
+        CHECK(!entry->in_flight);
+        memset(&entry->stats, 0, sizeof(entry->stats));
+        entry->release_ns = now_ns;
+        entry->pending    = 0;
+    }
+}
+
+static int any_pending(const master_sched_t *sched)
+{
+    for (const master_sched_entry_t *entry = sched->entries;
+         entry != sched->entries + sched->entries_num; ++entry)
+    {
+        if (entry->pending) return 1;
+    }
+    return 0;
+}
+
+static void release(master_sched_t *sched, int64_t now_ns)
+{
+    for (; sched->cycle_us && now_ns >= sched->cycle_ns;
+         sched->cycle_ns += sched->cycle_us * 1000)
+    {
+        if (sched->stats.cycles++ && any_pending(sched))
+        {
+            ++sched->stats.cycle_overruns;
+            overrun(sched, NULL, MASTER_SCHED_cycle_overrun);
+        }
+    }
+
+    for (master_sched_entry_t *entry = sched->entries;
+         entry != sched->entries + sched->entries_num; ++entry)
+    {
+        if (now_ns < entry->release_ns) continue;
+
+        const int64_t period_ns = entry->period_us * 1000;
+        // releases that were missed completely (master was not running)
+        const int64_t skipped    = (now_ns - entry->release_ns) / period_ns;
+        const int64_t release_ns = entry->release_ns + skipped * period_ns;
+
+        entry->release_ns = release_ns + period_ns;
+
+        if (entry->pending || skipped)
+        {
+            entry->stats.overruns += (uint32_t)(skipped + entry->pending);
+            overrun(sched, entry, MASTER_SCHED_overrun);
+        }
+        if (entry->pending) continue;
+
+        ++entry->stats.releases;
+        entry->pending     = 1;
+        entry->deadline_ns = release_ns + entry->deadline_us * 1000;
+    }
+}
+
+// return: 1 if a should be executed before b
+static int before(
+    const master_sched_t *sched,
+    const master_sched_entry_t *a,
+    const master_sched_entry_t *b)
+{
+    if (!sched->cycle_us && a->deadline_ns != b->deadline_ns)
+        return a->deadline_ns < b->deadline_ns;
+    if (a->priority != b->priority) return a->priority < b->priority;
+    return a < b;
+}
+
+static void dispatch(master_sched_t *sched)
+{
+    struct
+    {
+        master_async_bus_t *bus;
+        master_sched_entry_t *next;
+    } buses[MASTER_SCHED_BUSES_MAX];
+    size_t buses_num = 0;
+
+    for (master_sched_entry_t *entry = sched->entries;
+         entry != sched->entries + sched->entries_num; ++entry)
+    {
+        if (!entry->pending || entry->in_flight) continue;
+        if (!master_async_bus_idle(entry->bus)) continue;
+
+        size_t i = 0;
+
+        while (i < buses_num && buses[i].bus != entry->bus) ++i;
+        if (i == buses_num)
+        {
+            CHECK(MASTER_SCHED_BUSES_MAX > buses_num);
+            buses[buses_num].bus  = entry->bus;
+            buses[buses_num].next = entry;
+            ++buses_num;
+        }
+        else if (before(sched, entry, buses[i].next))
+        {
+            buses[i].next = entry;
+        }
+    }
+
+    for (size_t i = 0; i < buses_num; ++i)
+    {
+        buses[i].next->in_flight = 1;
+        master_async_submit(buses[i].bus, &buses[i].next->req);
+    }
+}
+
+static int64_t next_release_ns(const master_sched_t *sched)
+{
+    int64_t next_ns = sched->cycle_us ? sched->cycle_ns : INT64_MAX;
+
+    for (const master_sched_entry_t *entry = sched->entries;
+         entry != sched->entries + sched->entries_num; ++entry)
+    {
+        next_ns = min(next_ns, entry->release_ns);
+    }
+    return next_ns;
+}
+
+int master_sched_run(master_sched_t *sched, int timeout_ms)
+{
+    CHECK(sched);
+    CHECK(sched->engine);
+
+    int64_t now_ns = timestamp_ns();
+
+    release(sched, now_ns);
+    dispatch(sched);
+
+    const int64_t next_ns = next_release_ns(sched);
+
+    if (INT64_MAX != next_ns)
+    {
+        // round up, waking up early would only spin
+        const int64_t wait_ms
+            = max(INT64_C(0), (next_ns - now_ns + 999999) / 1000000);
+
+        if (-1 == timeout_ms || wait_ms < timeout_ms) timeout_ms = (int)wait_ms;
+    }
+
+    const int completed = master_async_run(sched->engine, timeout_ms);
+
+    now_ns = timestamp_ns();
+    release(sched, now_ns);
+    dispatch(sched);
+    return completed;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "master_async.h"
+
+// max number of buses served by one scheduler
+#define MASTER_SCHED_BUSES_MAX 16
+
+/* cyclic poll list on top of master_async
+ *
+ * - every entry is released each period_us, the released instance has to be
+ *   completed within deadline_us (relative to release)
+ * - buses are independent, whenever a bus is idle the released entry with
+ *   earliest deadline (EDF, ties: lower priority value first) is submitted,
+ *   so slower entries fill the gaps left by faster ones
+ * - time triggered mode (cycle_us > 0): releases are aligned to a fixed
+ *   cycle grid (periods have to be multiples of cycle_us) and released
+ *   entries are executed in static order (priority, then table order)
+ * - overruns: release of an entry whose previous instance is still pending
+ *   (instance is not duplicated), deadline miss: instance completed after
+ *   its deadline, cycle overrun: released work not finished at the end of
+ *   cycle (time triggered mode) */
+
+typedef enum
+{
+    MASTER_SCHED_overrun,
+    MASTER_SCHED_deadline_miss,
+    MASTER_SCHED_cycle_overrun
+} master_sched_overrun_t;
+
+struct master_sched;
+struct master_sched_entry;
+
+typedef void (*master_sched_cb_t)(struct master_sched_entry *);
+
+typedef struct master_sched_entry
+{
+    master_async_bus_t *bus;
+    /* request: tx, tx_size, rx, rx_size have to be set, cb/user_data are
+     * owned by scheduler (see cb, user_data below) */
+    master_async_req_t req;
+    int64_t period_us;
+    // 0: period_us
+    int64_t deadline_us;
+    // lower value is more urgent
+    int priority;
+    // called on every completion (req.result, req.timing)
+    master_sched_cb_t cb;
+    void *user_data;
+    struct
+    {
+        uint32_t releases;
+        uint32_t completed;
+        uint32_t overruns;
+        uint32_t deadline_misses;
+    } stats;
+    // private
+    struct master_sched *sched;
+    int64_t release_ns;
+    int64_t deadline_ns;
+    // released, not completed yet
+    int pending;
+    // submitted to bus
+    int in_flight;
+} master_sched_entry_t;
+
+typedef void (*master_sched_overrun_cb_t)(
+    // NULL for MASTER_SCHED_cycle_overrun
+    master_sched_entry_t *,
+    master_sched_overrun_t);
+
+typedef struct master_sched
+{
+    master_async_t *engine;
+    master_sched_entry_t *entries;
+    size_t entries_num;
+    // 0: EDF, > 0: time triggered
+    int64_t cycle_us;
+    master_sched_overrun_cb_t overrun_cb;
+    struct
+    {
+        uint32_t cycles;
+        uint32_t cycle_overruns;
+    } stats;
+    // private
+    int64_t cycle_ns;
+} master_sched_t;
+
+/* entries: all buses have to be registered with engine, table has to stay
+ * valid until master_sched_deinit() */
+void master_sched_init(
+    master_sched_t *,
+    master_async_t *,
+    master_sched_entry_t *entries,
+    size_t entries_num,
+    int64_t cycle_us);
+// requests in flight are cancelled by master_async_bus_deinit()
+void master_sched_deinit(master_sched_t *);
+// first release of all entries is now (next cycle in time triggered mode)
+void master_sched_start(master_sched_t *);
+/* release and dispatch entries, wait for completions at most timeout_ms
+ * (-1 infinite, wakes up for next release)
+ * return: number of completed requests */
+int master_sched_run(master_sched_t *, int timeout_ms);
@@ -0,0 +1,360 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "log.h"
+#include "master_shared.h"
+#include "rtu_impl.h"
+#include "time_util.h"
+#include "util.h"
+
+typedef modbus_rtu_data16_t data16_t;
+
+#define RANGE_CHUNK_MAX 249
+
+static void signal_event(int fd)
+{
+    const uint64_t one = 1;
+
+    CHECK_ERRNO(sizeof(one) == write(fd, &one, sizeof(one)) || EAGAIN == errno);
+}
+
+static int is_range(master_shared_op_t op)
+{
+    return MASTER_SHARED_rd_range == op || MASTER_SHARED_wr_range == op;
+}
+
+void master_shared_init(master_shared_t *shared, rtu_master_impl_t *impl)
+{
+    CHECK(shared);
+    CHECK(impl);
+
+    memset(shared, 0, sizeof(master_shared_t));
+    shared->impl          = impl;
+    shared->turnaround_us = calc_3t5_us(impl->rate);
+    atomic_init(&shared->stop, 0);
+    atomic_init(&shared->submitted, NULL);
+    CHECK_ERRNO(
+        0 <= (shared->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)));
+    CHECK_ERRNO(!pthread_mutex_init(&shared->mutex, NULL));
+    CHECK_ERRNO(!pthread_cond_init(&shared->completed, NULL));
+}
+
+void master_shared_submit(master_shared_t *shared, master_shared_req_t *req)
+{
+    CHECK(shared);
+    CHECK(req);
+    CHECK(req->data || MASTER_SHARED_call == req->op);
+    CHECK(req->call || MASTER_SHARED_call != req->op);
+    CHECK(MASTER_SHARED_CLASS_NUM > req->prio_class);
+    CHECK(
+        !is_range(req->op)
+        || (req->count
+            && UINT32_C(0x10000) >= (uint32_t)req->mem_addr + req->count));
+
+    atomic_init(&req->result, MASTER_SHARED_pending);
+    req->ecode              = 0;
+    req->timing.submit_ns   = timestamp_ns();
+    req->timing.begin_ns    = -1;
+    req->timing.complete_ns = -1;
+    req->done               = 0;
+
+    master_shared_req_t *head
+        = atomic_load_explicit(&shared->submitted, memory_order_relaxed);
+
+    do
+    {
+        req->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &shared->submitted, &head, req, memory_order_release,
+        memory_order_relaxed));
+
+    // owner takes whole stack at once, only first push has to wake it up
+    if (!head) signal_event(shared->event_fd);
+}
+
+int master_shared_done(const master_shared_req_t *req)
+{
+    CHECK(req);
+    return MASTER_SHARED_pending
+        != atomic_load_explicit(&req->result, memory_order_acquire);
+}
+
+master_shared_result_t
+master_shared_wait(master_shared_t *shared, master_shared_req_t *req)
+{
+    CHECK(shared);
+    CHECK(req);
+
+    if (!master_shared_done(req))
+    {
+        CHECK_ERRNO(!pthread_mutex_lock(&shared->mutex));
+        while (!master_shared_done(req))
+        {
+            CHECK_ERRNO(
+                !pthread_cond_wait(&shared->completed, &shared->mutex));
+        }
+        CHECK_ERRNO(!pthread_mutex_unlock(&shared->mutex));
+    }
+    return (master_shared_result_t)atomic_load_explicit(
+        &req->result, memory_order_acquire);
+}
+
+static void complete(
+    master_shared_t *shared,
+    master_shared_req_t *req,
+    master_shared_result_t result)
+{
+    // req can be released by submitter as soon as result is stored
+    const int event_fd = req->event_fd;
+
+    req->timing.complete_ns = timestamp_ns();
+    atomic_store_explicit(&req->result, (int)result, memory_order_release);
+    if (0 <= event_fd) signal_event(event_fd);
+
+    CHECK_ERRNO(!pthread_mutex_lock(&shared->mutex));
+    CHECK_ERRNO(!pthread_cond_broadcast(&shared->completed));
+    CHECK_ERRNO(!pthread_mutex_unlock(&shared->mutex));
+}
+
+// classes in order of precedence
+static const master_shared_class_t precedence[] = {
+    MASTER_SHARED_CLASS_urgent, MASTER_SHARED_CLASS_normal,
+    MASTER_SHARED_CLASS_bulk};
+
+static void push_back(master_shared_t *shared, master_shared_req_t *req)
+{
+    master_shared_queue_t *const queue = &shared->pending[req->prio_class];
+
+    req->next = NULL;
+    if (queue->tail) queue->tail->next = req;
+    else queue->head = req;
+    queue->tail = req;
+}
+
+// unfinished range keeps its position in class
+static void push_front(master_shared_t *shared, master_shared_req_t *req)
+{
+    master_shared_queue_t *const queue = &shared->pending[req->prio_class];
+
+    req->next   = queue->head;
+    queue->head = req;
+    if (!queue->tail) queue->tail = req;
+}
+
+static int pending(const master_shared_t *shared)
+{
+    for (size_t i = 0; i < length_of(shared->pending); ++i)
+    {
+        if (shared->pending[i].head) return 1;
+    }
+    return 0;
+}
+
+static master_shared_req_t *pop_front(master_shared_t *shared)
+{
+    for (size_t i = 0; i < length_of(precedence); ++i)
+    {
+        master_shared_queue_t *const queue = &shared->pending[precedence[i]];
+        master_shared_req_t *const req     = queue->head;
+
+        if (!req) continue;
+
+        queue->head = req->next;
+        if (!queue->head) queue->tail = NULL;
+
+        // started ranges of lower classes wait for this frame
+        for (size_t j = i + 1; j < length_of(precedence); ++j)
+        {
+            const master_shared_req_t *const lower
+                = shared->pending[precedence[j]].head;
+
+            if (lower && lower->done)
+                ++shared->stats.classes[precedence[j]].preempted;
+        }
+        return req;
+    }
+    return NULL;
+}
+
+// move submitted requests to pending queues
+static void collect(master_shared_t *shared)
+{
+    master_shared_req_t *stack = atomic_exchange_explicit(
+        &shared->submitted, NULL, memory_order_acquire);
+    master_shared_req_t *fifo = NULL;
+
+    // stack is LIFO, restore submission order
+    while (stack)
+    {
+        master_shared_req_t *const next = stack->next;
+
+        stack->next = fifo;
+        fifo        = stack;
+        stack       = next;
+    }
+
+    while (fifo)
+    {
+        master_shared_req_t *const req = fifo;
+
+        fifo = fifo->next;
+        push_back(shared, req);
+    }
+}
+
+// return: frame succeeded
+static int transaction(rtu_master_impl_t *impl, master_shared_req_t *req)
+{
+    const modbus_rtu_mem_addr_t mem = WORD_TO_MEM_ADDR(req->mem_addr);
+
+    switch (req->op)
+    {
+    case MASTER_SHARED_rd_registers:
+        return !!rtu_master_rd_holding_registers(
+            impl, req->addr, mem, WORD_TO_COUNT(req->count), req->data);
+    case MASTER_SHARED_rd_bytes:
+        return !!rtu_master_rd_bytes(
+            impl, req->addr, mem, (uint8_t)req->count, req->data);
+    case MASTER_SHARED_wr_registers:
+        return !!rtu_master_wr_registers(
+            impl, req->addr, mem, WORD_TO_COUNT(req->count), req->data);
+    case MASTER_SHARED_wr_bytes:
+        return !!rtu_master_wr_bytes(
+            impl, req->addr, mem, (uint8_t)req->count, req->data);
+    case MASTER_SHARED_rd_range:
+    case MASTER_SHARED_wr_range:
+    {
+        const uint8_t size
+            = (uint8_t)min(req->count - req->done, (size_t)RANGE_CHUNK_MAX);
+        const modbus_rtu_mem_addr_t chunk
+            = WORD_TO_MEM_ADDR((uint16_t)(req->mem_addr + req->done));
+        uint8_t *const bytes = (uint8_t *)req->data + req->done;
+        int ok               = 0;
+
+        if (MASTER_SHARED_rd_range == req->op)
+            ok = !!rtu_master_rd_bytes(impl, req->addr, chunk, size, bytes);
+        else ok = !!rtu_master_wr_bytes(impl, req->addr, chunk, size, bytes);
+
+        if (ok) req->done += size;
+        return ok;
+    }
+    case MASTER_SHARED_call: return req->call(impl, req);
+    }
+    return 0;
+}
+
+// return: 1 request completed, 0 more frames to go
+static int execute(master_shared_t *shared, master_shared_req_t *req)
+{
+    rtu_master_impl_t *const impl = shared->impl;
+
+    if (-1 == req->timing.begin_ns)
+    {
+        master_shared_class_stats_t *const stats
+            = &shared->stats.classes[req->prio_class];
+
+        req->timing.begin_ns = timestamp_ns();
+
+        const int64_t delay_ns = req->timing.begin_ns - req->timing.submit_ns;
+
+        ++stats->requests;
+        stats->delay_total_ns += delay_ns;
+        stats->delay_max_ns = max(stats->delay_max_ns, delay_ns);
+    }
+
+    impl->ecode = 0;
+
+    const int ok = transaction(impl, req);
+
+    req->ecode = impl->ecode;
+    ++shared->stats.transactions;
+    logD(
+        "%d shared op %d addr %u class %d %s", impl->dev ? impl->dev->fd : -1,
+        (int)req->op, (unsigned)req->addr, (int)req->prio_class,
+        ok ? "ok" : "failed");
+
+    if (ok && is_range(req->op) && req->done != req->count) return 0;
+
+    complete(
+        shared, req,
+        ok            ? MASTER_SHARED_ok
+        : impl->ecode ? MASTER_SHARED_exception
+                      : MASTER_SHARED_failed);
+    return 1;
+}
+
+static void wait_event(master_shared_t *shared)
+{
+    struct pollfd event = {shared->event_fd, (short)POLLIN, (short)0};
+    uint64_t value;
+
+    CHECK_ERRNO(0 <= poll(&event, 1, -1) || EINTR == errno);
+    CHECK_ERRNO(
+        sizeof(value) == read(shared->event_fd, &value, sizeof(value))
+        || EAGAIN == errno);
+    ++shared->stats.wakeups;
+}
+
+static void *owner_thread(void *user_data)
+{
+    master_shared_t *const shared = user_data;
+    int64_t next_ns               = timestamp_ns();
+
+    while (!atomic_load_explicit(&shared->stop, memory_order_acquire))
+    {
+        collect(shared);
+
+        if (!pending(shared))
+        {
+            wait_event(shared);
+            continue;
+        }
+
+        // requests submitted during silent interval compete for next frame
+        sleep_until_ns(next_ns);
+        collect(shared);
+
+        master_shared_req_t *const req = pop_front(shared);
+
+        if (!execute(shared, req)) push_front(shared, req);
+        next_ns = timestamp_ns() + (int64_t)shared->turnaround_us * 1000;
+    }
+    return NULL;
+}
+
+void master_shared_start(master_shared_t *shared)
+{
+    CHECK(shared);
+    CHECK_ERRNO(
+        !pthread_create(&shared->thread, NULL, owner_thread, shared));
+}
+
+void master_shared_deinit(master_shared_t *shared)
+{
+    if (!shared) return;
+
+    if (shared->thread)
+    {
+        atomic_store_explicit(&shared->stop, 1, memory_order_release);
+        signal_event(shared->event_fd);
+        CHECK_ERRNO(!pthread_join(shared->thread, NULL));
+        shared->thread = 0;
+    }
+
+    collect(shared);
+    for (master_shared_req_t *req; (req = pop_front(shared));)
+    {
+        ++shared->stats.cancelled;
+        complete(shared, req, MASTER_SHARED_cancelled);
+    }
+
+    CHECK_ERRNO(!close(shared->event_fd));
+    shared->event_fd = -1;
+    CHECK_ERRNO(!pthread_cond_destroy(&shared->completed));
+    CHECK_ERRNO(!pthread_mutex_destroy(&shared->mutex));
+}
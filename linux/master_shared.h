@@ -0,0 +1,153 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "master_impl.h"
+
+/* thread safe master handle, bus is owned by a single thread
+ *
+ * - any thread submits requests: lock-free multi-producer push, never
+ *   blocks on bus I/O, owner thread is woken up by eventfd
+ * - owner thread executes requests one frame at a time on
+ *   rtu_master_impl_t, urgent class first, then normal, then bulk, FIFO
+ *   within class, requests submitted during a frame are considered at next
+ *   frame boundary
+ * - range requests are split into FC65/FC66 frames (249 bytes), between
+ *   frames they yield to requests of higher class (e.g. emergency stop does
+ *   not wait for bulk transfer)
+ * - completion: master_shared_done()/master_shared_wait() (future) and/or
+ *   eventfd of the request (counter incremented)
+ *
+ * addresses and counts are in memory units (register/byte), host order */
+
+typedef enum
+{
+    MASTER_SHARED_rd_registers,
+    MASTER_SHARED_rd_bytes,
+    MASTER_SHARED_wr_registers,
+    MASTER_SHARED_wr_bytes,
+    // arbitrary length (bytes), chunked
+    MASTER_SHARED_rd_range,
+    MASTER_SHARED_wr_range,
+    // call() is executed by owner thread with exclusive access to the bus
+    MASTER_SHARED_call
+} master_shared_op_t;
+
+typedef enum
+{
+    MASTER_SHARED_pending = 0,
+    MASTER_SHARED_ok,
+    MASTER_SHARED_failed,
+    // exception reply, see ecode
+    MASTER_SHARED_exception,
+    // request was queued when handle was deinitialized
+    MASTER_SHARED_cancelled
+} master_shared_result_t;
+
+typedef enum
+{
+    // polls, default
+    MASTER_SHARED_CLASS_normal = 0,
+    // operator commands, jump ahead of everything queued
+    MASTER_SHARED_CLASS_urgent,
+    // large transfers, run when nothing else is queued
+    MASTER_SHARED_CLASS_bulk,
+    MASTER_SHARED_CLASS_NUM
+} master_shared_class_t;
+
+struct master_shared_req;
+
+// return: 1 success, 0 failure (impl->ecode is reported as exception)
+typedef int (*master_shared_call_t)(
+    rtu_master_impl_t *, struct master_shared_req *);
+
+typedef struct master_shared_req
+{
+    master_shared_op_t op;
+    modbus_rtu_addr_t addr;
+    uint16_t mem_addr;
+    uint16_t count;
+    // registers: modbus_rtu_data16_t[count], bytes/range: uint8_t[count]
+    void *data;
+    master_shared_call_t call;
+    void *user_data;
+    master_shared_class_t prio_class;
+    // eventfd(2) signaled on completion, -1: none
+    int event_fd;
+    /* begin: completion */
+    // master_shared_result_t, written last (release)
+    atomic_int result;
+    modbus_rtu_ecode_t ecode;
+    // timestamp_ns(), begin: first frame
+    struct
+    {
+        int64_t submit_ns;
+        int64_t begin_ns;
+        int64_t complete_ns;
+    } timing;
+    /* end: completion */
+    // private
+    struct master_shared_req *next;
+    // range bytes transferred
+    size_t done;
+} master_shared_req_t;
+
+typedef struct
+{
+    master_shared_req_t *head;
+    master_shared_req_t *tail;
+} master_shared_queue_t;
+
+typedef struct
+{
+    uint32_t requests;
+    // queueing delay: submit -> first frame
+    int64_t delay_total_ns;
+    int64_t delay_max_ns;
+    // range chunk deferred for request of higher class
+    uint32_t preempted;
+} master_shared_class_stats_t;
+
+typedef struct
+{
+    rtu_master_impl_t *impl;
+    // silent interval between transactions (default 3.5t), can be overridden
+    int turnaround_us;
+    int event_fd;
+    pthread_t thread;
+    atomic_int stop;
+    // submitted requests, LIFO (pushed by producers, taken by owner)
+    _Alignas(64) _Atomic(master_shared_req_t *) submitted;
+    _Alignas(64) pthread_mutex_t mutex;
+    // completions, master_shared_wait()
+    pthread_cond_t completed;
+    // owner thread only, FIFO per class
+    master_shared_queue_t pending[MASTER_SHARED_CLASS_NUM];
+    // updated by owner thread, stable after master_shared_deinit()
+    struct
+    {
+        // frames (range request counts each chunk)
+        uint32_t transactions;
+        uint32_t wakeups;
+        uint32_t cancelled;
+        master_shared_class_stats_t classes[MASTER_SHARED_CLASS_NUM];
+    } stats;
+} master_shared_t;
+
+// handle is idle until master_shared_start()
+void master_shared_init(master_shared_t *, rtu_master_impl_t *);
+// spawn owner thread, impl must not be used directly until deinit
+void master_shared_start(master_shared_t *);
+/* stop owner thread (request in progress completes), queued requests are
+ * completed with MASTER_SHARED_cancelled */
+void master_shared_deinit(master_shared_t *);
+// thread safe, req has to stay valid until completion
+void master_shared_submit(master_shared_t *, master_shared_req_t *);
+// return: 1 request completed (result and outputs are valid)
+int master_shared_done(const master_shared_req_t *);
+// block until completion, return: result
+master_shared_result_t
+master_shared_wait(master_shared_t *, master_shared_req_t *);
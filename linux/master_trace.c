@@ -0,0 +1,141 @@
+#include <inttypes.h>
+#include <string.h>
+
+#include "check.h"
+#include "master_trace.h"
+#include "util.h"
+
+static const char *const phase_names[RTU_MASTER_PHASE_NUM] = {
+    [RTU_MASTER_PHASE_host]     = "host",
+    [RTU_MASTER_PHASE_tx]       = "tx",
+    [RTU_MASTER_PHASE_response] = "response",
+    [RTU_MASTER_PHASE_rx]       = "rx",
+    [RTU_MASTER_PHASE_total]    = "total"};
+
+void rtu_master_latency_init(rtu_master_latency_table_t *table)
+{
+    CHECK(table);
+    memset(table, 0, sizeof(rtu_master_latency_table_t));
+}
+
+static size_t bucket_of(int64_t us)
+{
+    size_t bucket = 0;
+
+    while (1 < us && RTU_MASTER_LATENCY_BUCKETS - 1 > bucket)
+    {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+static void sample(
+    rtu_master_latency_t *latency,
+    rtu_master_phase_t phase,
+    int64_t begin_ns,
+    int64_t end_ns)
+{
+    if (-1 == begin_ns || -1 == end_ns) return;
+
+    const int64_t us = max(INT64_C(0), end_ns - begin_ns) / 1000;
+
+    ++latency->histogram[phase][bucket_of(us)];
+    latency->max_us[phase] = max(latency->max_us[phase], us);
+}
+
+void rtu_master_latency_update(
+    rtu_master_latency_table_t *table, const rtu_master_trace_t *trace)
+{
+    CHECK(table);
+    CHECK(trace);
+
+    rtu_master_latency_t *const latency = &table->slaves[trace->addr];
+
+    ++latency->transactions;
+    if (!trace->ok) ++latency->failures;
+    latency->tx_bytes += trace->tx_bytes;
+    latency->rx_bytes += trace->rx_bytes;
+
+    sample(
+        latency, RTU_MASTER_PHASE_host, trace->tx_begin_ns, trace->tx_end_ns);
+    sample(
+        latency, RTU_MASTER_PHASE_tx, trace->tx_end_ns, trace->tx_drained_ns);
+    sample(
+        latency, RTU_MASTER_PHASE_response, trace->tx_drained_ns,
+        trace->rx_first_ns);
+    sample(
+        latency, RTU_MASTER_PHASE_rx, trace->rx_first_ns, trace->rx_last_ns);
+    sample(
+        latency, RTU_MASTER_PHASE_total, trace->tx_begin_ns,
+        trace->rx_last_ns);
+}
+
+static uint32_t samples_of(const uint32_t *histogram)
+{
+    uint32_t samples = 0;
+
+    for (size_t i = 0; i < RTU_MASTER_LATENCY_BUCKETS; ++i)
+        samples += histogram[i];
+    return samples;
+}
+
+int64_t rtu_master_latency_percentile_us(
+    const rtu_master_latency_t *latency, rtu_master_phase_t phase, int permille)
+{
+    CHECK(latency);
+    CHECK(RTU_MASTER_PHASE_NUM > phase);
+    CHECK(0 < permille && 1000 >= permille);
+
+    const uint32_t *const histogram = latency->histogram[phase];
+    const uint32_t samples          = samples_of(histogram);
+
+    if (!samples) return -1;
+
+    // rank of percentile sample, 1 based
+    const uint64_t rank = ((uint64_t)samples * (uint64_t)permille + 999) / 1000;
+    uint64_t seen       = 0;
+
+    for (size_t i = 0; i < RTU_MASTER_LATENCY_BUCKETS; ++i)
+    {
+        seen += histogram[i];
+        if (seen >= rank)
+            return min(latency->max_us[phase], (INT64_C(2) << i) - 1);
+    }
+    return latency->max_us[phase];
+}
+
+void rtu_master_latency_export(
+    const rtu_master_latency_table_t *table, FILE *file)
+{
+    CHECK(table);
+    CHECK(file);
+
+    fprintf(
+        file,
+        "addr,transactions,failures,tx_bytes,rx_bytes,phase,samples,p50_us,"
+        "p90_us,p99_us,max_us\n");
+
+    for (size_t addr = 0; addr < length_of(table->slaves); ++addr)
+    {
+        const rtu_master_latency_t *const latency = &table->slaves[addr];
+
+        if (!latency->transactions) continue;
+
+        for (int phase = 0; phase < RTU_MASTER_PHASE_NUM; ++phase)
+        {
+            fprintf(
+                file,
+                "%zu,%" PRIu32 ",%" PRIu32 ",%" PRIu64 ",%" PRIu64
+                ",%s,%" PRIu32 ",%" PRId64 ",%" PRId64 ",%" PRId64
+                ",%" PRId64 "\n",
+                addr, latency->transactions, latency->failures,
+                latency->tx_bytes, latency->rx_bytes, phase_names[phase],
+                samples_of(latency->histogram[phase]),
+                rtu_master_latency_percentile_us(latency, phase, 500),
+                rtu_master_latency_percentile_us(latency, phase, 900),
+                rtu_master_latency_percentile_us(latency, phase, 990),
+                latency->max_us[phase]);
+        }
+    }
+}
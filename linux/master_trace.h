@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rtu.h"
+
+/* master transaction phases (timestamp_ns(), -1: did not happen)
+ *
+ * tx_begin -> tx_end: host (request handed over to driver)
+ * tx_end -> tx_drained: adapter/wire (tcdrain(), last bit sent)
+ * tx_drained -> rx_first: slave response (incl. adapter rx latency)
+ * rx_first -> rx_last: reply on the wire
+ *
+ * NOTE: first reply byte is read separately while tracing */
+typedef struct
+{
+    modbus_rtu_addr_t addr;
+    modbus_rtu_fcode_t fcode;
+    // 1: valid reply, 0: failure or exception
+    int ok;
+    int64_t tx_begin_ns;
+    int64_t tx_end_ns;
+    int64_t tx_drained_ns;
+    int64_t rx_first_ns;
+    // complete reply (or exception) only
+    int64_t rx_last_ns;
+    size_t tx_bytes;
+    size_t rx_bytes;
+} rtu_master_trace_t;
+
+typedef enum
+{
+    RTU_MASTER_PHASE_host = 0,
+    RTU_MASTER_PHASE_tx,
+    RTU_MASTER_PHASE_response,
+    RTU_MASTER_PHASE_rx,
+    // tx_begin -> rx_last
+    RTU_MASTER_PHASE_total,
+    RTU_MASTER_PHASE_NUM
+} rtu_master_phase_t;
+
+// bucket i: [2^i, 2^(i + 1)) us, bucket 0 includes < 1us, last is open
+#define RTU_MASTER_LATENCY_BUCKETS 24
+
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t failures;
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint32_t histogram[RTU_MASTER_PHASE_NUM][RTU_MASTER_LATENCY_BUCKETS];
+    int64_t max_us[RTU_MASTER_PHASE_NUM];
+} rtu_master_latency_t;
+
+typedef struct
+{
+    rtu_master_latency_t slaves[256];
+} rtu_master_latency_table_t;
+
+void rtu_master_latency_init(rtu_master_latency_table_t *);
+// phases with both timestamps known are sampled
+void rtu_master_latency_update(
+    rtu_master_latency_table_t *, const rtu_master_trace_t *);
+/* permille: 1 .. 1000
+ * return: upper bound of bucket holding percentile (max_us at most),
+ *         -1 no samples */
+int64_t rtu_master_latency_percentile_us(
+    const rtu_master_latency_t *, rtu_master_phase_t, int permille);
+/* CSV, one row per slave with transactions and phase:
+ * addr,transactions,failures,tx_bytes,rx_bytes,phase,samples,p50_us,p90_us,
+ * p99_us,max_us */
+void rtu_master_latency_export(const rtu_master_latency_table_t *, FILE *);
@@ -1,12 +1,20 @@
+#include <fcntl.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "check.h"
+#include "gnu.h"
 #include "log.h"
+#include "pipe.h"
 #include "rtu_impl.h"
+#include "spsc.h"
 #include "time_util.h"
 #include "tty.h"
 #include "util.h"
@@ -54,10 +62,24 @@ exit:
     return dst_begin;
 }
 
+// power of 2
+#define RX_RING_CAPACITY 64
+
+typedef struct
+{
+    // taken right after read() returned
+    int64_t timestamp_us;
+    size_t size;
+    char data[ADU_CAPACITY];
+} rx_chunk_t;
+
 typedef struct rtu_impl
 {
     tty_dev_t *dev;
     speed_t rate;
+    /* time of event being processed (chunk arrival, timer expiry),
+     * -1: current time */
+    int64_t clock_us;
     struct
     {
         int timeout_1t5_us;
@@ -70,6 +92,48 @@ typedef struct rtu_impl
     } timer;
     modbus_rtu_pdu_cb_t pdu_cb;
     uintptr_t user_data;
+    // RTU_IMPL_FRAMING
+    int framing;
+    // RTU_IMPL_PARMRK
+    struct
+    {
+        int enabled;
+        tty_parmrk_t decoder;
+        /* frame corrupted by serial error was discarded, following bytes
+         * only restart 3.5t (until INIT -> IDLE) */
+        int resync;
+    } parmrk;
+    // RTU_IMPL_ASYNC_TX
+    struct
+    {
+        int enabled;
+        int pending;
+        // predicted completion
+        int64_t deadline_us;
+        // serial_sent_cb is fired even if output queue is not empty
+        int64_t limit_us;
+    } tx;
+    // split mode (RTU_IMPL_RX_THREAD)
+    struct
+    {
+        spsc_t ring;
+        pthread_t thread;
+        int cpu;
+        // reader wakes up protocol thread
+        pipe_t notify;
+        // protocol thread wakes up reader waiting for free slot
+        pipe_t freed;
+        // protocol thread stops reader
+        pipe_t stop;
+        // protocol thread sleeps, notify is required
+        atomic_int waiting;
+        // ring is full and reader sleeps, freed is required
+        atomic_int full;
+        // reader is between read() and push, chunk will show up
+        atomic_int busy;
+        // ring full events (reader had to wait for free slot)
+        uint64_t overrun_cntr;
+    } rx;
 } rtu_impl_t;
 
 /* 8 data_bits has 2x character
@@ -91,6 +155,7 @@ typedef struct rtu_impl
  *         = (10^6 x 11 x 7) / (4 x rate)
  *         = 19'250'000 / rate */
 
+/* above 19200bps spec. defines fixed 1.5t (750us) and 3.5t (1750us) */
 int calc_1t5_us(speed_t rate)
 {
     const int bps = tty_bps(rate);
@@ -113,14 +178,41 @@ int calc_tmin_ms(speed_t rate, size_t size)
      *     = (11 * size) / bps
      *
      * t_ms = 1000 * t_s
-     *      = (1000 * 11 * size) / bps */
-    const int bps = tty_bps(rate);
-    return (size * 11000) / bps;
+     *      = (1000 * 11 * size) / bps
+     *
+     * rounded up, at high rates (>= 1Mbps) short frames take < 1ms */
+    const int64_t bps = tty_bps(rate);
+    return (int)(((int64_t)size * 11000 + bps - 1) / bps);
 }
 
+// host scheduling and adapter (USB) latency
+#define TMAX_MARGIN_US 10000
+
 int calc_tmax_ms(speed_t rate, size_t size)
 {
-    return 10 + calc_tmin_ms(rate, size);
+    return TMAX_MARGIN_US / 1000 + calc_tmin_ms(rate, size);
+}
+
+int64_t calc_tmin_us(speed_t rate, size_t size)
+{
+    return calc_frame_us(rate, 11, size);
+}
+
+int64_t calc_tmax_us(speed_t rate, size_t size)
+{
+    return TMAX_MARGIN_US + calc_tmin_us(rate, size);
+}
+
+int64_t calc_frame_us(speed_t rate, int char_bits, size_t size)
+{
+    /* t_us = (10^6 * char_bits * size) / bps, rounded up */
+    const int64_t bps = tty_bps(rate);
+    return ((int64_t)size * char_bits * INT64_C(1000000) + bps - 1) / bps;
+}
+
+static int64_t now_us(const rtu_impl_t *impl)
+{
+    return -1 == impl->clock_us ? timestamp_us() : impl->clock_us;
 }
 
 static void timer_start_1t5(modbus_rtu_state_t *state)
@@ -129,7 +221,7 @@ static void timer_start_1t5(modbus_rtu_state_t *state)
     CHECK(state->user_data);
     rtu_impl_t *impl = (rtu_impl_t *)state->user_data;
     CHECK(-1 == impl->timer.timeout_us);
-    impl->timer.timestamp_us = timestamp_us();
+    impl->timer.timestamp_us = now_us(impl);
     impl->timer.timeout_us   = impl->timer.timeout_1t5_us;
     ++impl->timer.start_cntr;
 }
@@ -140,7 +232,7 @@ static void timer_start_3t5(modbus_rtu_state_t *state)
     CHECK(state->user_data);
     rtu_impl_t *impl = (rtu_impl_t *)state->user_data;
     CHECK(-1 == impl->timer.timeout_us);
-    impl->timer.timestamp_us = timestamp_us();
+    impl->timer.timestamp_us = now_us(impl);
     impl->timer.timeout_us   = impl->timer.timeout_3t5_us;
     ++impl->timer.start_cntr;
 }
@@ -163,7 +255,7 @@ static void timer_reset(modbus_rtu_state_t *state)
     CHECK(state->user_data);
     rtu_impl_t *impl = (rtu_impl_t *)state->user_data;
     CHECK(-1 != impl->timer.timeout_us);
-    impl->timer.timestamp_us = timestamp_us();
+    impl->timer.timestamp_us = now_us(impl);
     ++impl->timer.reset_cntr;
 }
 
@@ -183,12 +275,103 @@ static void send_impl(modbus_rtu_state_t *state)
 
     tty_logD(impl->dev);
     CHECK(end == curr);
+
+    if (impl->tx.enabled)
+    {
+        // serial_sent_cb is fired by tx_check()
+        const int64_t curr_us = timestamp_us();
+
+        impl->tx.pending     = 1;
+        impl->tx.deadline_us = curr_us + calc_tmin_us(impl->rate, size);
+        impl->tx.limit_us    = curr_us + calc_tmax_us(impl->rate, size);
+        return;
+    }
+
     tty_drain(dev->fd);
+    // timers started after transmission are relative to current time
+    impl->clock_us = -1;
     CHECK(state->serial_sent_cb);
     state->serial_sent_cb(state);
     modbus_rtu_event(state);
 }
 
+static void recv_bytes(
+    modbus_rtu_state_t *state,
+    rtu_impl_t *impl,
+    const char *begin,
+    const char *const end)
+{
+    for (; begin != end; ++begin)
+    {
+        uint8_t data = (uint8_t)*begin;
+
+        const tty_parmrk_result_t result = impl->parmrk.enabled
+            ? tty_parmrk_decode(&impl->parmrk.decoder, data, &data)
+            : TTY_PARMRK_data;
+
+        if (TTY_PARMRK_pending == result) continue;
+
+        if (impl->parmrk.resync)
+        {
+            // rest of corrupted frame, keep silent interval running
+            impl->timer.timestamp_us = now_us(impl);
+            continue;
+        }
+
+        if (TTY_PARMRK_error == result)
+        {
+            // discard frame immediately (RTU restarts with 3.5t)
+            logD("serial error 0x%02X", data);
+            CHECK(state->serial_recv_err_cb);
+            state->serial_recv_err_cb(state, data);
+            modbus_rtu_event(state);
+            impl->parmrk.resync = 1;
+            continue;
+        }
+
+        state->serial_recv_cb(state, data);
+        modbus_rtu_event(state);
+    }
+}
+
+static void tx_check(modbus_rtu_state_t *state, rtu_impl_t *impl)
+{
+    if (!impl->tx.pending) return;
+
+    const int64_t curr_us = timestamp_us();
+
+    if (impl->tx.deadline_us > curr_us) return;
+
+    const int pending = tty_tx_pending(impl->dev->fd);
+
+    if (pending && impl->tx.limit_us > curr_us)
+    {
+        // prediction was too optimistic, predict remaining bytes
+        impl->tx.deadline_us = curr_us + calc_tmin_us(impl->rate, pending);
+        return;
+    }
+
+    if (pending) logW("tx not completed, %d bytes pending", pending);
+
+    impl->tx.pending = 0;
+    impl->clock_us   = -1;
+    CHECK(state->serial_sent_cb);
+    state->serial_sent_cb(state);
+    modbus_rtu_event(state);
+}
+
+// earliest of timer expiry and predicted tx completion, -1: none
+static int64_t next_deadline_us(const rtu_impl_t *impl)
+{
+    const int64_t timer_us = -1 == impl->timer.timeout_us
+        ? -1
+        : impl->timer.timestamp_us + impl->timer.timeout_us;
+
+    if (!impl->tx.pending) return timer_us;
+    if (-1 == timer_us) return impl->tx.deadline_us;
+    return min(timer_us, impl->tx.deadline_us);
+}
+
 static int recv_impl(
     modbus_rtu_state_t *state,
     rtu_impl_t *impl,
@@ -199,18 +382,72 @@ static int recv_impl(
 
     memset(buf, 0, sizeof(buf));
 
-    const char *const end = -1 == impl->timer.timeout_us
+    const char *const end = impl->tx.pending
+        ? tty_read_until(
+            dev, buf, buf + sizeof(buf), next_deadline_us(impl) * 1000,
+            user_event)
+        : -1 == impl->timer.timeout_us
         ? tty_read(dev, buf, buf + sizeof(buf), -1, user_event)
         : tty_read_ll(dev, buf, buf + sizeof(buf), impl->timer.timeout_us);
 
     tty_logD(dev);
 
-    for (const char *begin = buf; begin != end; ++begin)
+    recv_bytes(state, impl, buf, end);
+
+    return !user_event ? 0 : user_event->events & user_event->revents;
+}
+
+/* number of bytes of request being received which are still expected
+ * (at least 1), based on fcode and byte count fields */
+static size_t frame_hint(const modbus_rtu_state_t *state)
+{
+    const uint8_t *const begin = state->rxbuf;
+    const size_t curr          = (size_t)(state->rxbuf_curr - begin);
+    size_t size                = ADU_MIN_SIZE;
+
+    if (2 <= curr)
     {
-        // TODO: handle serial errors (serial_recv_err_cb)
-        state->serial_recv_cb(state, *begin);
-        modbus_rtu_event(state);
+        switch (begin[1])
+        {
+        case FCODE_RD_COILS:
+        case FCODE_RD_INPUT:
+        case FCODE_RD_HOLDING_REGISTERS:
+        case FCODE_RD_IN_REGISTERS:
+        case FCODE_WR_COIL:
+        case FCODE_WR_REGISTER: size = 8; break;
+        case FCODE_RD_BYTES: size = 7; break;
+        // header: addr, fcode, mem_addr, count, byte count
+        case FCODE_WR_COILS:
+        case FCODE_WR_REGISTERS: size = 7 > curr ? 7 : 9 + begin[6]; break;
+        // header: addr, fcode, mem_addr, count
+        case FCODE_WR_BYTES: size = 5 > curr ? 5 : 7 + begin[4]; break;
+        // header: addr, fcode, rd/wr mem_addr, rd/wr count, byte count
+        case FCODE_RD_WR_REGISTERS:
+            size = 11 > curr ? 11 : 13 + begin[10];
+            break;
+        default: break;
+        }
     }
+    return size > curr ? size - curr : 1;
+}
+
+static int recv_framed(
+    modbus_rtu_state_t *state,
+    rtu_impl_t *impl,
+    tty_dev_t *dev,
+    struct pollfd *user_event)
+{
+    char buf[ADU_CAPACITY];
+
+    const int64_t deadline_us = next_deadline_us(impl);
+    const int64_t deadline_ns = -1 == deadline_us ? -1 : deadline_us * 1000;
+    const size_t hint         = min(frame_hint(state), sizeof(buf));
+    const char *const end
+        = tty_read_until(dev, buf, buf + hint, deadline_ns, user_event);
+
+    tty_logD(dev);
+
+    recv_bytes(state, impl, buf, end);
 
     return !user_event ? 0 : user_event->events & user_event->revents;
 }
@@ -224,12 +461,215 @@ static void timeout_impl(modbus_rtu_state_t *state, rtu_impl_t *impl)
     if (elapsed >= impl->timer.timeout_us)
     {
         logD("timeout %" PRId64 "us", elapsed);
+        impl->parmrk.resync = 0;
         CHECK(state->timer_cb);
         state->timer_cb(state);
         modbus_rtu_event(state);
     }
 }
 
+/* fire timers expired until now_us, timers (re)started from callbacks are
+ * relative to expiry of the previous one (1.5t -> 3.5t) */
+static void expire_until(
+    modbus_rtu_state_t *state, rtu_impl_t *impl, int64_t now_us)
+{
+    while (-1 != impl->timer.timeout_us)
+    {
+        const int64_t expiry_us
+            = impl->timer.timestamp_us + impl->timer.timeout_us;
+
+        if (expiry_us > now_us) break;
+
+        logD("timeout %" PRId64 "us", now_us - impl->timer.timestamp_us);
+        impl->clock_us      = expiry_us;
+        impl->parmrk.resync = 0;
+        CHECK(state->timer_cb);
+        state->timer_cb(state);
+        modbus_rtu_event(state);
+    }
+    impl->clock_us = -1;
+}
+
+/* ring full: data stays in kernel buffer until protocol thread frees a slot
+ * return: 0 stop requested */
+static int rx_wait_slot(rtu_impl_t *impl)
+{
+    struct pollfd events[]
+        = {{impl->rx.freed.reader, (short)POLLIN, (short)0},
+           {impl->rx.stop.reader, (short)POLLIN, (short)0}};
+
+    for (;;)
+    {
+        atomic_store(&impl->rx.full, 1);
+        if (spsc_push_begin(&impl->rx.ring)) break;
+
+        validate_syscall_result(poll(events, length_of(events), -1));
+        if (events[1].revents) return 0;
+
+        char drain[16];
+        while (0 < read(impl->rx.freed.reader, drain, sizeof(drain))) { }
+    }
+    atomic_store(&impl->rx.full, 0);
+    return 1;
+}
+
+static void *rx_thread(void *user_data)
+{
+    rtu_impl_t *impl = (rtu_impl_t *)user_data;
+
+    if (-1 != impl->rx.cpu)
+    {
+        const int err = gnu_pin_thread(impl->rx.cpu);
+        if (err) logW("pin to cpu %d failed %s", impl->rx.cpu, strerror(err));
+    }
+
+    struct pollfd events[]
+        = {{impl->dev->fd, (short)POLLIN, (short)0},
+           {impl->rx.stop.reader, (short)POLLIN, (short)0}};
+
+    for (;;)
+    {
+        validate_syscall_result(poll(events, length_of(events), -1));
+
+        if (events[1].revents) break;
+        if (!(events[0].revents & POLLIN)) continue;
+
+        rx_chunk_t *chunk = spsc_push_begin(&impl->rx.ring);
+
+        if (!chunk)
+        {
+            ++impl->rx.overrun_cntr;
+            if (!rx_wait_slot(impl)) break;
+            continue;
+        }
+
+        atomic_store(&impl->rx.busy, 1);
+
+        const ssize_t r = read(impl->dev->fd, chunk->data, sizeof(chunk->data));
+
+        chunk->timestamp_us = timestamp_us();
+        validate_syscall_result(r);
+
+        if (0 < r)
+        {
+            chunk->size = (size_t)r;
+            spsc_push_commit(&impl->rx.ring);
+        }
+
+        atomic_store(&impl->rx.busy, 0);
+
+        if (atomic_exchange(&impl->rx.waiting, 0))
+            CHECK_ERRNO(1 == write(impl->rx.notify.writer, "", 1));
+    }
+    return NULL;
+}
+
+static void rx_consume(modbus_rtu_state_t *state, rtu_impl_t *impl)
+{
+    for (rx_chunk_t *chunk; (chunk = spsc_pop_begin(&impl->rx.ring));)
+    {
+        // timer expired before chunk arrived fires first
+        expire_until(state, impl, chunk->timestamp_us);
+
+        impl->clock_us = chunk->timestamp_us;
+
+        recv_bytes(state, impl, chunk->data, chunk->data + chunk->size);
+
+        impl->clock_us = -1;
+        spsc_pop_commit(&impl->rx.ring);
+
+        if (atomic_exchange(&impl->rx.full, 0))
+            CHECK_ERRNO(1 == write(impl->rx.freed.writer, "", 1));
+    }
+}
+
+// ring is empty and reader is not in the middle of read()
+static int rx_quiet(rtu_impl_t *impl)
+{
+    return !atomic_load(&impl->rx.busy) && !spsc_pop_begin(&impl->rx.ring);
+}
+
+static void run_split(
+    modbus_rtu_state_t *state,
+    rtu_impl_t *impl,
+    const rtu_impl_opts_t *opts,
+    struct pollfd *user_event)
+{
+    int flags = O_CLOEXEC | O_NONBLOCK;
+
+    spsc_init(&impl->rx.ring, RX_RING_CAPACITY, sizeof(rx_chunk_t));
+    pipe_open(&impl->rx.notify, &flags);
+    pipe_open(&impl->rx.freed, &flags);
+    pipe_open(&impl->rx.stop, NULL);
+    atomic_init(&impl->rx.waiting, 0);
+    atomic_init(&impl->rx.full, 0);
+    atomic_init(&impl->rx.busy, 0);
+    impl->rx.cpu          = opts->rx_thread_cpu;
+    impl->rx.overrun_cntr = 0;
+
+    CHECK_ERRNO(!pthread_create(&impl->rx.thread, NULL, rx_thread, impl));
+
+    struct pollfd events[]
+        = {{impl->rx.notify.reader, (short)POLLIN, (short)0},
+           {user_event ? user_event->fd : -1,
+            user_event ? user_event->events : (short)0, (short)0}};
+
+    for (;;)
+    {
+        rx_consume(state, impl);
+
+        /* no chunk with timestamp older than now_us can show up later, safe
+         * to fire timers based on current time */
+        const int64_t curr_us = timestamp_us();
+
+        if (!rx_quiet(impl))
+        {
+            sched_yield();
+            continue;
+        }
+
+        expire_until(state, impl, curr_us);
+        tx_check(state, impl);
+
+        atomic_store(&impl->rx.waiting, 1);
+
+        if (!rx_quiet(impl))
+        {
+            atomic_store(&impl->rx.waiting, 0);
+            continue;
+        }
+
+        const int64_t deadline_us = next_deadline_us(impl);
+        const struct timespec timeout
+            = ns_to_timespec((deadline_us - timestamp_us()) * 1000);
+
+        validate_syscall_result(gnu_ppoll(
+            events, length_of(events), -1 == deadline_us ? NULL : &timeout));
+
+        atomic_store(&impl->rx.waiting, 0);
+
+        char drain[16];
+        while (0 < read(impl->rx.notify.reader, drain, sizeof(drain))) { }
+
+        if (events[1].events & events[1].revents)
+        {
+            user_event->revents = events[1].revents;
+            break;
+        }
+    }
+
+    CHECK_ERRNO(1 == write(impl->rx.stop.writer, "", 1));
+    CHECK_ERRNO(!pthread_join(impl->rx.thread, NULL));
+
+    if (impl->rx.overrun_cntr)
+        logW("rx ring overrun %" PRIu64, impl->rx.overrun_cntr);
+
+    pipe_close(&impl->rx.stop);
+    pipe_close(&impl->rx.freed);
+    pipe_close(&impl->rx.notify);
+    spsc_deinit(&impl->rx.ring);
+}
+
 static uint8_t *pdu_cb_proxy(
     modbus_rtu_state_t *state,
     modbus_rtu_addr_t addr,
@@ -258,11 +698,13 @@ void modbus_rtu_run(
     int timeout_3t5_us,
     modbus_rtu_pdu_cb_t pdu_cb,
     uintptr_t user_data,
-    struct pollfd *user_event)
+    struct pollfd *user_event,
+    const rtu_impl_opts_t *opts)
 {
     rtu_impl_t impl
-        = {.dev  = dev,
-           .rate = rate,
+        = {.dev      = dev,
+           .rate     = rate,
+           .clock_us = -1,
            .timer
            = {.timeout_1t5_us
               = -1 == timeout_1t5_us ? calc_1t5_us(rate) : timeout_1t5_us,
@@ -289,9 +731,37 @@ void modbus_rtu_run(
 
     modbus_rtu_event(&state);
 
+    const int flags = opts ? opts->flags : 0;
+
+    impl.tx.enabled = !!(flags & RTU_IMPL_ASYNC_TX);
+
+    if (flags & RTU_IMPL_PARMRK)
+    {
+        tty_parmrk_on(dev);
+        impl.parmrk.enabled = 1;
+    }
+
+    if (flags & RTU_IMPL_RX_THREAD)
+    {
+        // reader thread owns read() chunking, VMIN would delay timestamps
+        CHECK(!(flags & RTU_IMPL_FRAMING));
+        run_split(&state, &impl, opts, user_event);
+        return;
+    }
+
+    if (flags & RTU_IMPL_FRAMING)
+    {
+        tty_framing_on(dev, RTU_IMPL_FRAMING_VTIME);
+        impl.framing = 1;
+    }
+
     for (int stop = 0; !stop;)
     {
-        stop = recv_impl(&state, &impl, dev, user_event);
+        stop = impl.framing ? recv_framed(&state, &impl, dev, user_event)
+                            : recv_impl(&state, &impl, dev, user_event);
         timeout_impl(&state, &impl);
+        tx_check(&state, &impl);
     }
+
+    if (impl.framing) tty_framing_off(dev);
 }
@@ -45,10 +45,54 @@ uint8_t *rtu_memory_impl_pdu_cb(
 
 int calc_1t5_us(speed_t rate);
 int calc_3t5_us(speed_t rate);
-// time required to transfer payload (size)
+/* time required to transfer payload (size), tmax adds fixed 10ms margin
+ * for host scheduling and adapter (USB) latency to tmin, _us variants are
+ * not rounded to whole ms */
 int calc_tmin_ms(speed_t, size_t size);
 int calc_tmax_ms(speed_t, size_t size);
+int64_t calc_tmin_us(speed_t, size_t size);
+int64_t calc_tmax_us(speed_t, size_t size);
+/* time required to transfer payload (size) with given character size
+ * (tty_char_bits()), calc_tmin_us() assumes worst case 11 bits */
+int64_t calc_frame_us(speed_t, int char_bits, size_t size);
 
+/* split mode: dedicated reader thread timestamps every read() chunk and
+ * passes it to the protocol thread via lock-free SPSC ring, 1.5t/3.5t
+ * decisions are based on chunk timestamps (not on protocol thread load) */
+#define RTU_IMPL_RX_THREAD (1 << 0)
+/* kernel framing (see tty_framing_on()): VMIN is set to the number of bytes
+ * still expected for the request being received (derived from fcode), so
+ * request is returned by 1-3 read() calls instead of one per chunk. Timers
+ * only confirm end of frame. Not supported in split mode (aborts).
+ * VMIN is changed (tcsetattr) only when expected size differs from the
+ * previous read: none for FC1-FC6, 2-3 for other requests.
+ * NOTE: point-to-point links only (single slave). Expected size is derived
+ * from request layout, on multi-drop bus replies of other slaves can be
+ * shorter, read() then blocks up to RTU_IMPL_FRAMING_VTIME and the next
+ * request is returned in the same chunk (3.5t gap is lost, request is
+ * dropped as corrupted frame) */
+#define RTU_IMPL_FRAMING (1 << 1)
+// [0.1s]
+#define RTU_IMPL_FRAMING_VTIME 1
+/* reply is written without waiting for transmission (tcdrain), completion is
+ * predicted from character time and confirmed by output queue (TIOCOUTQ,
+ * TIOCSERGETLSR) from event loop, then serial_sent_cb is fired */
+#define RTU_IMPL_ASYNC_TX (1 << 2)
+/* serial errors (parity, framing, break) are reported by line discipline
+ * (PARMRK) and passed to serial_recv_err_cb, corrupted frame is discarded
+ * immediately and rest of it only restarts 3.5t, so request following it
+ * is not lost */
+#define RTU_IMPL_PARMRK (1 << 3)
+
+typedef struct
+{
+    // RTU_IMPL_* flags
+    int flags;
+    // reader thread CPU affinity, -1: not pinned
+    int rx_thread_cpu;
+} rtu_impl_opts_t;
+
+// opts: NULL - defaults (single thread)
 void modbus_rtu_run(
     tty_dev_t *dev,
     speed_t rate,
@@ -56,4 +100,5 @@ void modbus_rtu_run(
     int timeout_3t5_us,
     modbus_rtu_pdu_cb_t pdu_cb,
     uintptr_t user_data,
-    struct pollfd *user_event);
+    struct pollfd *user_event,
+    const rtu_impl_opts_t *opts);
@@ -13,24 +13,15 @@
 static void help(const char *argv0, const char *message);
 
 static const speed_t supported_rates[]
-    = {B1200, B2400, B4800, B9600, B19200, B57600, B115200};
-
-static const char *supported_rates_str[]
-    = {"1200", "2400", "4800", "9600", "19200", "57600", "115200"};
-
-STATIC_ASSERT(
-    length_of(supported_rates) == length_of(supported_rates_str),
-    "supported rates mismatch");
+    = {B1200,   B2400,   B4800,   B9600,    B19200,   B57600,  B115200,
+       B230400, B460800, B921600, B1000000, B2000000, B4000000};
 
 static speed_t parse_speed(const char *str)
 {
-    if (!str) goto fallback;
+    const int bps = str ? atoi(str) : 0;
 
-    for (size_t i = 0; i < length_of(supported_rates_str); ++i)
-    {
-        if (0 == strcmp(str, supported_rates_str[i])) return supported_rates[i];
-    }
-fallback:
+    // non-standard rates are configured with termios2 (BOTHER)
+    if (0 < bps) return tty_speed(bps);
     logW("unsupported rate %s, fallback to 19200", str ? str : "NULL");
     return B19200;
 }
@@ -57,18 +48,24 @@ void help(const char *argv0, const char *message)
         " [-p parity E/O/N (E)]"
         " [-t custom 1.5t timeout us]"
         " [-T custom 3.5t timeout us]"
+        " [-R dedicated reader thread cpu (-1 not pinned)]"
+        " [-F kernel framing (VMIN/VTIME), requires -P, not with -R]"
+        " [-P point-to-point link (no other slaves on the bus)]"
+        " [-A async transmit completion (no tcdrain)]"
+        " [-E report serial errors (PARMRK)]"
         " [-D tty_debug_size (0)]\n",
         argv0);
 
-    printf("%s: supported rates:\n", argv0);
-
-    const int rates_num = length_of(supported_rates_str);
+    printf(
+        "%s: standard rates (any other rate is configured with BOTHER):\n",
+        argv0);
 
-    for (int i = 0; i < rates_num; ++i)
+    for (size_t i = 0u; i < length_of(supported_rates); ++i)
     {
         printf(
-            "%9sbps 1.5t % 6dus 3.5t % 6dus\n", supported_rates_str[i],
-            calc_1t5_us(supported_rates[i]), calc_3t5_us(supported_rates[i]));
+            "%9sbps 1.5t % 6dus 3.5t % 6dus\n",
+            tty_rate_str(supported_rates[i]), calc_1t5_us(supported_rates[i]),
+            calc_3t5_us(supported_rates[i]));
     }
 
     exit(message ? EXIT_FAILURE : EXIT_SUCCESS);
@@ -83,12 +80,24 @@ int main(int argc, const char *argv[])
     int addr         = -1;
     int timeout_1t5  = -1;
     int timeout_3t5  = -1;
+    int p2p          = 0;
+
+    rtu_impl_opts_t opts = {.flags = 0, .rx_thread_cpu = -1};
 
-    for (int c; -1 != (c = getopt(argc, (char **)argv, "D:T:a:d:hp:r:t:"));)
+    for (int c;
+         -1 != (c = getopt(argc, (char **)argv, "AD:EFPR:T:a:d:hp:r:t:"));)
     {
         switch (c)
         {
+        case 'A': opts.flags |= RTU_IMPL_ASYNC_TX; break;
         case 'D': debug_size = optarg ? atoi(optarg) : 0; break;
+        case 'E': opts.flags |= RTU_IMPL_PARMRK; break;
+        case 'F': opts.flags |= RTU_IMPL_FRAMING; break;
+        case 'P': p2p = 1; break;
+        case 'R':
+            opts.flags        |= RTU_IMPL_RX_THREAD;
+            opts.rx_thread_cpu = optarg ? atoi(optarg) : -1;
+            break;
         case 'T': timeout_3t5 = optarg ? atoi(optarg) : -1; break;
         case 'a': addr = optarg ? atoi(optarg) : -1; break;
         case 'd': path = optarg ? strdup(optarg) : NULL; break;
@@ -104,6 +113,12 @@ int main(int argc, const char *argv[])
 
     if (!path) help(argv[0], "device path missing");
     if (-1 == addr) help(argv[0], "address missing");
+    /* expected size is derived from the request layout, on multi-drop bus
+     * shorter replies of other slaves make the next request get lost */
+    if ((opts.flags & RTU_IMPL_FRAMING) && !p2p)
+        help(argv[0], "-F requires point-to-point link (-P)");
+    if ((opts.flags & RTU_IMPL_FRAMING) && (opts.flags & RTU_IMPL_RX_THREAD))
+        help(argv[0], "-F is not supported in split mode (-R)");
 
     rtu_memory_impl_t memory_impl;
 
@@ -124,7 +139,7 @@ int main(int argc, const char *argv[])
 
     modbus_rtu_run(
         &dev, rate, timeout_1t5, timeout_3t5, rtu_memory_impl_pdu_cb,
-        (uintptr_t)&memory_impl, NULL);
+        (uintptr_t)&memory_impl, NULL, &opts);
 
     tty_close(&dev);
     tty_deinit(&dev);
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "spsc.h"
+
+void spsc_init(spsc_t *ring, size_t capacity, size_t slot_size)
+{
+    CHECK(ring);
+    CHECK(capacity && !(capacity & (capacity - 1)));
+    CHECK(slot_size);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->mask      = capacity - 1;
+    ring->slot_size = slot_size;
+    ring->slots     = calloc(capacity, slot_size);
+    CHECK_ERRNO(ring->slots);
+}
+
+void spsc_deinit(spsc_t *ring)
+{
+    if (!ring) return;
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+void *spsc_push_begin(spsc_t *ring)
+{
+    const size_t tail
+        = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const size_t head
+        = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail - head > ring->mask) return NULL;
+    return ring->slots + (tail & ring->mask) * ring->slot_size;
+}
+
+void spsc_push_commit(spsc_t *ring)
+{
+    const size_t tail
+        = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void *spsc_pop_begin(spsc_t *ring)
+{
+    const size_t head
+        = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    const size_t tail
+        = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head == tail) return NULL;
+    return ring->slots + (head & ring->mask) * ring->slot_size;
+}
+
+void spsc_pop_commit(spsc_t *ring)
+{
+    const size_t head
+        = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
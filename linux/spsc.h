@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/* lock-free single-producer/single-consumer ring of fixed size slots
+ *
+ * producer: slot = spsc_push_begin(), fill slot, spsc_push_commit()
+ * consumer: slot = spsc_pop_begin(), use slot, spsc_pop_commit() */
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct
+{
+    // consumer position
+    _Alignas(SPSC_CACHE_LINE) atomic_size_t head;
+    // producer position
+    _Alignas(SPSC_CACHE_LINE) atomic_size_t tail;
+    _Alignas(SPSC_CACHE_LINE) size_t mask;
+    size_t slot_size;
+    char *slots;
+} spsc_t;
+
+// capacity: power of 2
+void spsc_init(spsc_t *, size_t capacity, size_t slot_size);
+void spsc_deinit(spsc_t *);
+// return: free slot, NULL if ring is full
+void *spsc_push_begin(spsc_t *);
+void spsc_push_commit(spsc_t *);
+// return: oldest slot, NULL if ring is empty
+void *spsc_pop_begin(spsc_t *);
+void spsc_pop_commit(spsc_t *);
@@ -0,0 +1,32 @@
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+#include "check.h"
+#include "log.h"
+#include "termios2.h"
+
+void termios2_set_bps(int fd, int bps)
+{
+    CHECK(-1 != fd);
+    CHECK(0 < bps);
+
+    struct termios2 config;
+
+    CHECK_ERRNO(-1 != ioctl(fd, TCGETS2, &config));
+    config.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    config.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    config.c_ispeed = (speed_t)bps;
+    config.c_ospeed = (speed_t)bps;
+    CHECK_ERRNO(-1 != ioctl(fd, TCSETS2, &config));
+    logT("%d %dbps", fd, bps);
+}
+
+int termios2_get_bps(int fd)
+{
+    CHECK(-1 != fd);
+
+    struct termios2 config;
+
+    CHECK_ERRNO(-1 != ioctl(fd, TCGETS2, &config));
+    return (int)config.c_ospeed;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+/* arbitrary rates (BOTHER + c_ispeed/c_ospeed) via termios2 ioctls
+ *
+ * <asm/termbits.h> conflicts with <termios.h>, so termios2 is kept in
+ * separate translation unit with primitive arguments only */
+
+void termios2_set_bps(int fd, int bps);
+int termios2_get_bps(int fd);
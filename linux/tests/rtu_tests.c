@@ -3,15 +3,26 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sys/eventfd.h>
 
 #include "check.h"
+#include "crc.h"
 #include "log.h"
 #include "master.h"
+#include "master_async.h"
+#include "master_bits.h"
+#include "master_coalesce.h"
+#include "master_decode.h"
 #include "master_impl.h"
+#include "master_mirror.h"
+#include "master_shared.h"
+#include "master_sched.h"
 #include "pipe.h"
 #include "rtu_impl.h"
+#include "time_util.h"
 #include "tty.h"
 #include "tty_pair.h"
 #include "utest.h"
@@ -33,6 +44,45 @@
 static const speed_t supported_rates[]
     = {B1200, B2400, B4800, B9600, B19200, B57600, B115200};
 
+/* RTU modes (rtu_impl_opts_t.flags) other than single thread: split mode
+ * (dedicated reader thread), kernel framing, async tx completion, serial
+ * errors (PARMRK, \377 data bytes are escaped) */
+static const int rtu_modes[]
+    = {RTU_IMPL_RX_THREAD,
+       RTU_IMPL_FRAMING,
+       RTU_IMPL_ASYNC_TX,
+       RTU_IMPL_RX_THREAD | RTU_IMPL_ASYNC_TX | RTU_IMPL_PARMRK,
+       RTU_IMPL_FRAMING | RTU_IMPL_ASYNC_TX,
+       RTU_IMPL_PARMRK};
+
+// character based 1.5t/3.5t and fixed 750/1750us
+static const speed_t rtu_mode_rates[] = {B19200, B115200};
+
+/* TestFixture configurations (utest_index): single thread RTU at every
+ * supported rate, then every other mode at each of rtu_mode_rates
+ * NOTE: utest pastes index count into names, UTEST_I() takes a literal */
+#define FIXTURE_CONFIGS 19
+
+STATIC_ASSERT(
+    FIXTURE_CONFIGS
+        == length_of(supported_rates)
+               + length_of(rtu_modes) * length_of(rtu_mode_rates),
+    "fixture configurations mismatch");
+
+static void fixture_config(size_t index, speed_t *rate, int *flags)
+{
+    if (length_of(supported_rates) > index)
+    {
+        *rate  = supported_rates[index];
+        *flags = 0;
+        return;
+    }
+
+    index -= length_of(supported_rates);
+    *rate  = rtu_mode_rates[index % length_of(rtu_mode_rates)];
+    *flags = rtu_modes[index / length_of(rtu_mode_rates)];
+}
+
 typedef modbus_rtu_addr_t addr_t;
 typedef modbus_rtu_fcode_t fcode_t;
 typedef modbus_rtu_ecode_t ecode_t;
@@ -72,6 +122,7 @@ typedef struct
     int timeout_1t5_us;
     int timeout_3t5_us;
     struct pollfd event;
+    rtu_impl_opts_t opts;
 } rtu_config_t;
 
 struct TestFixture
@@ -89,6 +140,18 @@ int is_hw_test(const struct TestFixture *tf)
     return NULL != tf->config->dev_path;
 }
 
+/* time for RTU to transition from BUSY to IDLE after reply (reply_size),
+ * pty delivers reply at once, with async tx RTU is busy for predicted wire
+ * time */
+static int rtu_turnaround_us(const struct TestFixture *tf, size_t reply_size)
+{
+    const int turnaround_us = 50000;
+
+    if (!(RTU_IMPL_ASYNC_TX & tf->rtu_config.opts.flags)) return turnaround_us;
+    return turnaround_us
+        + (int)calc_tmin_us(tf->rtu_config.rate, reply_size);
+}
+
 static char *master_read(struct TestFixture *tf, char *begin, const char *end)
 {
     const int tmax_ms = calc_tmax_ms(tf->config->rate, (size_t)(end - begin))
@@ -132,7 +195,7 @@ static void *async_run_rtu(void *user_data)
     modbus_rtu_run(
         config->dev, config->rate, config->timeout_1t5_us,
         config->timeout_3t5_us, config->pdu_cb,
-        (uintptr_t)(&config->memory_impl), &config->event);
+        (uintptr_t)(&config->memory_impl), &config->event, &config->opts);
     return NULL;
 }
 
@@ -180,7 +243,7 @@ static void serial_deinit(tty_dev_t *master, tty_dev_t *slave)
 
 UTEST_I_SETUP(TestFixture)
 {
-    ASSERT_TRUE(length_of(supported_rates) > utest_index);
+    ASSERT_TRUE(FIXTURE_CONFIGS > utest_index);
     struct TestFixture *tf = utest_fixture;
     ASSERT_TRUE(tf);
 
@@ -189,12 +252,16 @@ UTEST_I_SETUP(TestFixture)
     ASSERT_TRUE(g_test_config);
     tf->config = g_test_config;
 
-    const speed_t rate
-        = is_hw_test(tf) ? tf->config->rate : supported_rates[utest_index];
+    speed_t rate = B19200;
+    int flags    = 0;
+
+    fixture_config(utest_index, &rate, &flags);
+    if (is_hw_test(tf)) rate = tf->config->rate;
 
     logD(
-        "%d %dbps 1.5t %dus 3.5t %dus", (int)utest_index, tty_bps(rate),
-        tf->config->timeout_1t5_us, tf->config->timeout_3t5_us);
+        "%d %dbps flags 0x%X 1.5t %dus 3.5t %dus", (int)utest_index,
+        tty_bps(rate), (unsigned)flags, tf->config->timeout_1t5_us,
+        tf->config->timeout_3t5_us);
 
     serial_init(tf);
     serial_config(&tf->master, &tf->slave, rate, tf->config->parity);
@@ -214,6 +281,9 @@ UTEST_I_SETUP(TestFixture)
     tf->rtu_config.event.fd       = tf->channel.reader;
     tf->rtu_config.event.events   = POLLIN;
 
+    tf->rtu_config.opts.flags         = flags;
+    tf->rtu_config.opts.rx_thread_cpu = -1;
+
     pthread_mutex_init(&tf->rtu_config.sync.mutex, NULL);
     pthread_mutex_lock(&tf->rtu_config.sync.mutex);
 
@@ -248,7 +318,7 @@ UTEST_I_TEARDOWN(TestFixture)
     serial_deinit(&tf->master, &tf->slave);
 }
 
-UTEST_I(TestFixture, read_bytes_21, 7)
+UTEST_I(TestFixture, read_bytes_21, 19)
 {
     enum
     {
@@ -291,7 +361,7 @@ UTEST_I(TestFixture, read_bytes_21, 7)
     }
 }
 
-UTEST_I(TestFixture, write_bytes_func_STR, 7)
+UTEST_I(TestFixture, write_bytes_func_STR, 19)
 {
     struct TestFixture *tf = utest_fixture;
     ASSERT_TRUE(tf);
@@ -324,7 +394,7 @@ UTEST_I(TestFixture, write_bytes_func_STR, 7)
     }
 }
 
-UTEST_I(TestFixture, write_bytes_struct_STR, 7)
+UTEST_I(TestFixture, write_bytes_struct_STR, 19)
 {
     struct TestFixture *tf = utest_fixture;
     ASSERT_TRUE(tf);
@@ -402,7 +472,298 @@ UTEST(rtu_tests, wr_bytes_request)
     EXPECT_EQ(0, memcmp(&reqA, reqB, sizeof(reqA)));
 }
 
-UTEST_I(TestFixture, read_holding_registers_33, 7)
+UTEST(rtu_tests, crc_continue)
+{
+    const uint8_t data[]     = "data split between several buffers";
+    const uint8_t *const end = data + sizeof(data);
+    const crc_t expected     = modbus_rtu_calc_crc(data, end);
+    crc_t crc                = MODBUS_RTU_CRC_INIT;
+
+    crc = modbus_rtu_crc_continue(crc, data, data + 3);
+    crc = modbus_rtu_crc_continue(crc, data + 3, data + 3);
+    crc = modbus_rtu_crc_continue(crc, data + 3, end);
+    EXPECT_EQ(expected.low, crc.low);
+    EXPECT_EQ(expected.high, crc.high);
+}
+
+UTEST(rtu_tests, bits_pack_unpack)
+{
+    enum
+    {
+        BITS = 2000
+    };
+    const master_bits_isa_t best = master_bits_isa();
+    uint8_t states[BITS], unpacked[BITS];
+    uint8_t bits_ref[(BITS + 7) / 8], bits[(BITS + 7) / 8];
+
+    // any non zero state is ON
+    for (size_t i = 0; i < BITS; ++i)
+        states[i] = (uint8_t)(i % 3 ? 0 : i % 256);
+
+    const master_bits_isa_t isas[] = {
+        MASTER_BITS_ISA_scalar, MASTER_BITS_ISA_swar, MASTER_BITS_ISA_bmi2};
+
+    for (size_t k = 0; k < length_of(isas); ++k)
+    {
+        if (!master_bits_select_isa(isas[k])) continue;
+
+        for (size_t count = 0; count <= BITS; count += 1 + count / 64)
+        {
+            const size_t size = (count + 7) / 8;
+
+            memset(bits_ref, 0, sizeof(bits_ref));
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (states[i]) bits_ref[i / 8] |= (uint8_t)(1u << (i % 8));
+            }
+
+            // unused bits of last byte are cleared
+            memset(bits, 0xFF, sizeof(bits));
+            EXPECT_EQ(bits + size, master_bits_pack(bits, states, count));
+            EXPECT_EQ(0, memcmp(bits_ref, bits, size));
+
+            EXPECT_EQ(
+                unpacked + count, master_bits_unpack(unpacked, bits, count));
+            for (size_t i = 0; i < count; ++i)
+                EXPECT_EQ(!!states[i], unpacked[i]);
+        }
+    }
+    ASSERT_TRUE(master_bits_select_isa(best));
+}
+
+UTEST(rtu_tests, decode_registers)
+{
+    // 0x12345678 (ABCD), -2.5f (ABCD), "AB", "C"
+    const data16_t known[] = {
+        {0x12, 0x34}, {0x56, 0x78}, {0xC0, 0x20}, {0x00, 0x00},
+        {'A', 'B'},   {'C', '\0'}};
+    const master_decode_isa_t best = master_decode_isa();
+    uint32_t u32[4];
+    float f32;
+    char str[2 * length_of(known) + 1];
+
+    master_decode_u32(u32, known, 1, MASTER_DECODE_ABCD);
+    EXPECT_EQ(0x12345678u, u32[0]);
+    master_decode_u32(u32, known, 1, MASTER_DECODE_CDAB);
+    EXPECT_EQ(0x56781234u, u32[0]);
+    master_decode_u32(u32, known, 1, MASTER_DECODE_BADC);
+    EXPECT_EQ(0x34127856u, u32[0]);
+    master_decode_u32(u32, known, 1, MASTER_DECODE_DCBA);
+    EXPECT_EQ(0x78563412u, u32[0]);
+    master_decode_f32(&f32, known + 2, 1, MASTER_DECODE_ABCD);
+    EXPECT_EQ(-2.5f, f32);
+    EXPECT_EQ(3u, master_decode_str(str, known + 4, 2, 0));
+    EXPECT_EQ(0, strcmp("ABC", str));
+    EXPECT_EQ(2u, master_decode_str(str, known + 4, 1, 1));
+    EXPECT_EQ(0, strcmp("BA", str));
+
+    // vector kernels have to match scalar code, all lengths cover tails
+    enum
+    {
+        REGISTERS = 130
+    };
+    data16_t src[REGISTERS];
+    uint16_t u16_ref[REGISTERS], u16[REGISTERS];
+    uint32_t u32_ref[REGISTERS / 2], u32_v[REGISTERS / 2];
+    char str_ref[2 * REGISTERS + 1], str_v[2 * REGISTERS + 1];
+
+    for (size_t i = 0; i < REGISTERS; ++i)
+    {
+        src[i].high = (uint8_t)(i * 7 + 1);
+        src[i].low  = (uint8_t)(i * 13 + 5);
+    }
+
+    const master_decode_isa_t isas[] = {
+        MASTER_DECODE_ISA_ssse3, MASTER_DECODE_ISA_avx2};
+
+    for (size_t k = 0; k < length_of(isas); ++k)
+    {
+        for (size_t count = 0; count <= REGISTERS; ++count)
+        {
+            ASSERT_TRUE(master_decode_select_isa(MASTER_DECODE_ISA_scalar));
+            master_decode_u16(u16_ref, src, count);
+            master_decode_str(str_ref, src, count, count % 2);
+            if (!master_decode_select_isa(isas[k])) break;
+            master_decode_u16(u16, src, count);
+            master_decode_str(str_v, src, count, count % 2);
+            EXPECT_EQ(0, memcmp(u16_ref, u16, count * sizeof(uint16_t)));
+            EXPECT_EQ(0, strcmp(str_ref, str_v));
+
+            for (int order = 0; order <= MASTER_DECODE_DCBA; ++order)
+            {
+                ASSERT_TRUE(
+                    master_decode_select_isa(MASTER_DECODE_ISA_scalar));
+                master_decode_u32(u32_ref, src, count / 2, order);
+                ASSERT_TRUE(master_decode_select_isa(isas[k]));
+                master_decode_u32(u32_v, src, count / 2, order);
+                EXPECT_EQ(
+                    0, memcmp(u32_ref, u32_v, count / 2 * sizeof(uint32_t)));
+            }
+        }
+    }
+    ASSERT_TRUE(master_decode_select_isa(best));
+}
+
+typedef struct
+{
+    // blocking call: 0 -> 1 (bus held) -> 2 (released by test)
+    atomic_int *gate;
+    int *order;
+    size_t *order_size;
+} shared_call_t;
+
+static int shared_call(rtu_master_impl_t *impl, master_shared_req_t *req)
+{
+    shared_call_t *call = req->user_data;
+
+    if (call->gate)
+    {
+        atomic_store(call->gate, 1);
+        while (2 != atomic_load(call->gate)) sched_yield();
+    }
+    call->order[(*call->order_size)++] = req->prio_class;
+    return 1;
+}
+
+UTEST(rtu_tests, master_shared_priority)
+{
+    rtu_master_impl_t impl = {.dev = NULL, .rate = B115200};
+    master_shared_t shared;
+    atomic_int gate;
+    int order[8];
+    size_t order_size          = 0;
+    const master_shared_class_t classes[] = {
+        MASTER_SHARED_CLASS_bulk, MASTER_SHARED_CLASS_urgent,
+        MASTER_SHARED_CLASS_normal, MASTER_SHARED_CLASS_urgent,
+        MASTER_SHARED_CLASS_bulk};
+    shared_call_t blocking     = {&gate, order, &order_size};
+    shared_call_t call         = {NULL, order, &order_size};
+    master_shared_req_t first  = {
+         .op        = MASTER_SHARED_call,
+         .call      = shared_call,
+         .user_data = &blocking,
+         .event_fd  = -1};
+    master_shared_req_t reqs[length_of(classes)];
+    const int event_fd = eventfd(0, EFD_CLOEXEC);
+
+    ASSERT_LE(0, event_fd);
+    atomic_init(&gate, 0);
+    master_shared_init(&shared, &impl);
+    shared.turnaround_us = 0;
+    master_shared_start(&shared);
+    master_shared_submit(&shared, &first);
+    while (1 != atomic_load(&gate)) sched_yield();
+
+    // queued while bus is busy
+    for (size_t i = 0; i < length_of(reqs); ++i)
+    {
+        reqs[i] = (master_shared_req_t){
+            .op         = MASTER_SHARED_call,
+            .call       = shared_call,
+            .user_data  = &call,
+            .prio_class = classes[i],
+            .event_fd   = i ? -1 : event_fd};
+        master_shared_submit(&shared, &reqs[i]);
+    }
+    atomic_store(&gate, 2);
+
+    for (size_t i = 0; i < length_of(reqs); ++i)
+        EXPECT_EQ(MASTER_SHARED_ok, master_shared_wait(&shared, &reqs[i]));
+
+    // urgent, normal, bulk, FIFO within class
+    const int expected[] = {
+        MASTER_SHARED_CLASS_normal, MASTER_SHARED_CLASS_urgent,
+        MASTER_SHARED_CLASS_urgent, MASTER_SHARED_CLASS_normal,
+        MASTER_SHARED_CLASS_bulk,   MASTER_SHARED_CLASS_bulk};
+
+    ASSERT_EQ(length_of(expected), order_size);
+    EXPECT_EQ(0, memcmp(expected, order, sizeof(expected)));
+    EXPECT_LT(reqs[1].timing.complete_ns, reqs[3].timing.begin_ns);
+    EXPECT_LT(reqs[0].timing.complete_ns, reqs[4].timing.begin_ns);
+
+    uint64_t value = 0;
+
+    EXPECT_EQ((ssize_t)sizeof(value), read(event_fd, &value, sizeof(value)));
+    EXPECT_EQ((uint64_t)1, value);
+    master_shared_deinit(&shared);
+    EXPECT_EQ((uint32_t)6, shared.stats.transactions);
+
+    const master_shared_class_stats_t *stats = shared.stats.classes;
+
+    for (size_t i = 0; i < MASTER_SHARED_CLASS_NUM; ++i)
+        EXPECT_EQ((uint32_t)2, stats[i].requests);
+    // bulk waited for all others
+    EXPECT_LE(
+        stats[MASTER_SHARED_CLASS_urgent].delay_max_ns,
+        stats[MASTER_SHARED_CLASS_bulk].delay_max_ns);
+
+    // not started, queued requests are cancelled
+    master_shared_init(&shared, &impl);
+    master_shared_submit(&shared, &reqs[0]);
+    EXPECT_FALSE(master_shared_done(&reqs[0]));
+    master_shared_deinit(&shared);
+    EXPECT_TRUE(master_shared_done(&reqs[0]));
+    EXPECT_EQ(MASTER_SHARED_cancelled, atomic_load(&reqs[0].result));
+    EXPECT_EQ((uint32_t)1, shared.stats.cancelled);
+    close(event_fd);
+}
+
+UTEST(rtu_tests, coils_rd_wr_registers_request)
+{
+    // examples of MODBUS Application Protocol Specification V1.1b3
+    char req[ADU_CAPACITY];
+    const char *req_end = NULL;
+
+    // FC15: 10 coils from 20 (0x13): CD 01
+    const uint8_t coils[] = {0xCD, 0x01};
+    const char wr_coils_pdu[]
+        = {0x0F, 0x00, 0x13, 0x00, 0x0A, 0x02, (char)0xCD, 0x01};
+
+    req_end = make_request_wr_coils(
+        0x11, WORD_TO_MEM_ADDR(0x13), coils, WORD_TO_COUNT(10), req,
+        sizeof(req));
+    ASSERT_NE(NULL, req_end);
+    EXPECT_EQ(
+        1 + sizeof(wr_coils_pdu) + sizeof(crc_t), (size_t)(req_end - req));
+    EXPECT_EQ(0, memcmp(req + 1, wr_coils_pdu, sizeof(wr_coils_pdu)));
+    EXPECT_TRUE(valid_crc(req, (size_t)(req_end - req)));
+    // max 1968 coils
+    EXPECT_EQ(
+        NULL,
+        make_request_wr_coils(
+            0x11, WORD_TO_MEM_ADDR(0x13), coils, WORD_TO_COUNT(1969), req,
+            sizeof(req)));
+
+    // FC23: read 6 from 3, write 3 to 14 (0x0E)
+    const data16_t wr_data[]
+        = {WORD_TO_DATA16(0x00FF), WORD_TO_DATA16(0x00FF),
+           WORD_TO_DATA16(0x00FF)};
+    const char rd_wr_pdu[] = {
+        0x17, 0x00, 0x03, 0x00, 0x06, 0x00, 0x0E,       0x00,
+        0x03, 0x06, 0x00, (char)0xFF, 0x00, (char)0xFF, 0x00, (char)0xFF};
+
+    req_end = make_request_rd_wr_registers(
+        0x11, WORD_TO_MEM_ADDR(0x03), WORD_TO_COUNT(6), WORD_TO_MEM_ADDR(0x0E),
+        wr_data, WORD_TO_COUNT(length_of(wr_data)), req, sizeof(req));
+    ASSERT_NE(NULL, req_end);
+    EXPECT_EQ(1 + sizeof(rd_wr_pdu) + sizeof(crc_t), (size_t)(req_end - req));
+    EXPECT_EQ(0, memcmp(req + 1, rd_wr_pdu, sizeof(rd_wr_pdu)));
+
+    // FC1 reply: 19 coils, CD 6B 05
+    char reply[] = {0x11, 0x01, 0x03, (char)0xCD, 0x6B, 0x05, 0x00, 0x00};
+
+    ASSERT_NE(NULL, implace_crc(reply, sizeof(reply)));
+
+    const modbus_rtu_rd_coils_reply_t *rep
+        = parse_reply_rd_coils(reply, sizeof(reply));
+
+    ASSERT_NE(NULL, rep);
+    EXPECT_EQ(3, rep->header.byte_count);
+    EXPECT_EQ(0x05, rep->bits[2]);
+    EXPECT_EQ(NULL, parse_reply_rd_coils(reply, sizeof(reply) - 1));
+}
+
+UTEST_I(TestFixture, read_holding_registers_33, 19)
 {
     enum
     {
@@ -459,7 +820,7 @@ UTEST_I(TestFixture, read_holding_registers_33, 7)
     }
 }
 
-UTEST_I(TestFixture, read_wr_register_struct_0x00AB_offset_32, 7)
+UTEST_I(TestFixture, read_wr_register_struct_0x00AB_offset_32, 19)
 {
     struct TestFixture *tf = utest_fixture;
     ASSERT_TRUE(tf);
@@ -493,7 +854,7 @@ UTEST_I(TestFixture, read_wr_register_struct_0x00AB_offset_32, 7)
     }
 }
 
-UTEST_I(TestFixture, read_wr_register_func_0x00CD_offset_50, 7)
+UTEST_I(TestFixture, read_wr_register_func_0x00CD_offset_50, 19)
 {
     struct TestFixture *tf = utest_fixture;
     ASSERT_TRUE(tf);
@@ -528,7 +889,7 @@ UTEST_I(TestFixture, read_wr_register_func_0x00CD_offset_50, 7)
     }
 }
 
-UTEST_I(TestFixture, master_write_read_bytes, 7)
+UTEST_I(TestFixture, master_write_read_bytes, 19)
 {
     struct TestFixture *tf = utest_fixture;
     ASSERT_TRUE(tf);
@@ -560,7 +921,7 @@ UTEST_I(TestFixture, master_write_read_bytes, 7)
     EXPECT_EQ(0, memcmp(rx_buf, tx_buf, sizeof(rx_buf)));
 }
 
-UTEST_I(TestFixture, master_write_read_holding_registers, 7)
+UTEST_I(TestFixture, master_write_read_holding_registers, 19)
 {
     struct TestFixture *tf = utest_fixture;
     ASSERT_TRUE(tf);
@@ -595,16 +956,1243 @@ UTEST_I(TestFixture, master_write_read_holding_registers, 7)
     EXPECT_EQ(0, memcmp(tx_data, rx_data, sizeof(rx_data)));
 }
 
-static speed_t parse_speed(const char *str)
+UTEST_I(TestFixture, master_rd_wr_registers, 19)
 {
-    if (!str) goto fallback;
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms};
+    const data16_t wr_data[]
+        = {WORD_TO_DATA16(0x0011), WORD_TO_DATA16(0x0022),
+           WORD_TO_DATA16(0x0033)};
+    data16_t rd_data[6];
+
+    memset(rd_data, 0, sizeof(rd_data));
 
-    for (size_t i = 0; i < length_of(supported_rates); ++i)
+    // setpoint update and read back of surrounding registers in one round trip
+    data16_t *const rd_data_end = rtu_master_rd_wr_registers(
+        &impl, tf->config->rtu_addr, WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR),
+        WORD_TO_COUNT(length_of(rd_data)), rd_data,
+        WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR + 2),
+        WORD_TO_COUNT(length_of(wr_data)), wr_data);
+
+    ASSERT_EQ(rd_data_end, rd_data + length_of(rd_data));
+    // write is executed before read, rest is memory fill pattern
+    EXPECT_EQ(0, DATA16_TO_WORD(rd_data[0]));
+    EXPECT_EQ(1, DATA16_TO_WORD(rd_data[1]));
+    EXPECT_EQ(0, memcmp(rd_data + 2, wr_data, sizeof(wr_data)));
+    EXPECT_EQ(5, DATA16_TO_WORD(rd_data[5]));
+
+    usleep((useconds_t)rtu_turnaround_us(tf, ADU_CAPACITY));
+
+    // coils are not supported by RTU memory
+    uint8_t bits[2];
+
+    EXPECT_FALSE(rtu_master_rd_coils(
+        &impl, tf->config->rtu_addr, WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR),
+        WORD_TO_COUNT(10), bits));
+    EXPECT_EQ(ECODE_ILLEGAL_FUNCTION, impl.ecode);
+}
+
+UTEST_I(TestFixture, master_prepared_poll, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms};
+    rtu_master_prepared_t registers;
+    rtu_master_prepared_t bytes;
+
+    ASSERT_TRUE(rtu_master_prepare(
+        &registers, FCODE_RD_HOLDING_REGISTERS, tf->config->rtu_addr,
+        WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR + 4), WORD_TO_COUNT(8)));
+    ASSERT_TRUE(rtu_master_prepare(
+        &bytes, FCODE_RD_BYTES, tf->config->rtu_addr,
+        WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR + 16), WORD_TO_COUNT(32)));
+    EXPECT_EQ(16, registers.payload_size);
+    EXPECT_EQ(32, bytes.payload_size);
+
+    // same bytes as built per call
+    char req[ADU_CAPACITY];
+    const char *const req_end = make_request_rd_holding_registers(
+        tf->config->rtu_addr, WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR + 4),
+        WORD_TO_COUNT(8), req, sizeof(req));
+
+    ASSERT_EQ((size_t)registers.tx_size, (size_t)(req_end - req));
+    EXPECT_EQ(0, memcmp(registers.tx, req, registers.tx_size));
+
+    // unsupported function code, count out of range
+    EXPECT_FALSE(rtu_master_prepare(
+        &bytes, FCODE_WR_REGISTERS, tf->config->rtu_addr,
+        WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR), WORD_TO_COUNT(1)));
+    EXPECT_FALSE(rtu_master_prepare(
+        &bytes, FCODE_RD_BYTES, tf->config->rtu_addr,
+        WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR), WORD_TO_COUNT(250)));
+    ASSERT_TRUE(rtu_master_prepare(
+        &bytes, FCODE_RD_BYTES, tf->config->rtu_addr,
+        WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR + 16), WORD_TO_COUNT(32)));
+
+    const useconds_t turnaround_us
+        = (useconds_t)rtu_turnaround_us(tf, ADU_CAPACITY);
+
+    for (int cycle = 0; cycle < 3; ++cycle)
     {
-        const speed_t rate = supported_rates[i];
-        if (0 == strcmp(str, tty_rate_str(rate))) return supported_rates[i];
+        data16_t data[8];
+        uint8_t rx_bytes[32];
+
+        memset(data, 0xFF, sizeof(data));
+        memset(rx_bytes, 0xFF, sizeof(rx_bytes));
+
+        EXPECT_EQ(
+            (void *)(data + length_of(data)),
+            rtu_master_poll(&impl, &registers, data));
+        usleep(turnaround_us);
+        EXPECT_EQ(
+            (void *)(rx_bytes + sizeof(rx_bytes)),
+            rtu_master_poll(&impl, &bytes, rx_bytes));
+        usleep(turnaround_us);
+
+        // memory fill pattern
+        for (size_t i = 0; i < length_of(data); ++i)
+            EXPECT_EQ(4 + i, DATA16_TO_WORD(data[i]));
+        for (size_t i = 0; i < sizeof(rx_bytes); ++i)
+            EXPECT_EQ(16 + i, rx_bytes[i]);
     }
-fallback:
+}
+
+UTEST_I(TestFixture, master_pacing, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_pacing_t pacing;
+    rtu_master_trace_t trace;
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms,
+           .pacing          = &pacing,
+           .trace           = &trace};
+    const int frames = 5;
+
+    rtu_master_pacing_init(&pacing, tf->config->rate);
+    EXPECT_EQ((int64_t)calc_3t5_us(tf->config->rate), pacing.min_gap_us);
+    // RTU needs time to transition from BUSY to IDLE
+    pacing.margin_us[tf->config->rtu_addr]
+        = rtu_turnaround_us(tf, ADU_CAPACITY);
+
+    const int64_t begin_ns = timestamp_ns();
+
+    // back-to-back, no sleeps in between
+    for (int i = 0; i < frames; ++i)
+    {
+        data16_t data[4];
+
+        ASSERT_EQ(
+            data + length_of(data),
+            rtu_master_rd_holding_registers(
+                &impl, tf->config->rtu_addr, WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR),
+                WORD_TO_COUNT(length_of(data)), data));
+        EXPECT_EQ(3, DATA16_TO_WORD(data[3]));
+    }
+
+    const int64_t gap_us
+        = pacing.min_gap_us + pacing.margin_us[tf->config->rtu_addr];
+
+    EXPECT_EQ((uint32_t)frames, pacing.stats.transactions);
+    EXPECT_EQ((uint32_t)(frames - 1), pacing.stats.waits);
+    EXPECT_LE((frames - 1) * gap_us, (timestamp_ns() - begin_ns) / 1000);
+    // next request is not allowed before silent interval after reply
+    EXPECT_LE(trace.rx_last_ns + gap_us * 1000, pacing.next_tx_ns);
+    usleep((useconds_t)gap_us);
+}
+
+static void master_async_count_cb(master_async_req_t *req)
+{
+    ++*(int *)req->user_data;
+}
+
+UTEST_I(TestFixture, master_async, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const uint8_t message[] = "async master";
+    const speed_t rate
+        = is_hw_test(tf) ? tf->config->rate : tf->rtu_config.rate;
+
+    master_async_t engine;
+    master_async_bus_t bus;
+
+    master_async_init(&engine);
+    master_async_bus_init(
+        &bus, &engine, &tf->master, rate,
+        max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS));
+    // for RTU to transition from BUSY to IDLE state (see usleep above)
+    bus.turnaround_us = 100000;
+
+    char wr_tx[ADU_CAPACITY], wr_rx[sizeof(modbus_rtu_wr_bytes_reply_t)];
+    char rd_tx[ADU_CAPACITY], rd_rx[ADU_CAPACITY];
+    char na_tx[ADU_CAPACITY], na_rx[ADU_CAPACITY];
+    char ex_tx[ADU_CAPACITY], ex_rx[ADU_CAPACITY];
+    const size_t rd_rx_size
+        = sizeof(modbus_rtu_rd_bytes_reply_header_t) + sizeof(message) + 2;
+    int completed = 0;
+
+    master_async_req_t reqs[] = {
+        {.tx      = wr_tx,
+         .tx_size = (size_t)(make_request_wr_bytes(
+                                 tf->config->rtu_addr,
+                                 WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR), message,
+                                 sizeof(message), wr_tx, sizeof(wr_tx))
+                             - wr_tx),
+         .rx      = wr_rx,
+         .rx_size = sizeof(wr_rx)},
+        {.tx      = rd_tx,
+         .tx_size = (size_t)(make_request_rd_bytes(
+                                 tf->config->rtu_addr,
+                                 WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR),
+                                 sizeof(message), rd_tx, sizeof(rd_tx))
+                             - rd_tx),
+         .rx      = rd_rx,
+         .rx_size = rd_rx_size},
+        // nobody is listening on this address
+        {.tx      = na_tx,
+         .tx_size = (size_t)(make_request_rd_bytes(
+                                 (addr_t)(tf->config->rtu_addr + 1),
+                                 WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR),
+                                 sizeof(message), na_tx, sizeof(na_tx))
+                             - na_tx),
+         .rx      = na_rx,
+         .rx_size = rd_rx_size},
+        // outside of rtu_memory, exception reply
+        {.tx      = ex_tx,
+         .tx_size = (size_t)(make_request_rd_bytes(
+                                 tf->config->rtu_addr,
+                                 WORD_TO_MEM_ADDR(
+                                     RTU_MEMORY_ADDR + RTU_MEMORY_SIZE),
+                                 sizeof(message), ex_tx, sizeof(ex_tx))
+                             - ex_tx),
+         .rx      = ex_rx,
+         .rx_size = rd_rx_size}};
+
+    for (master_async_req_t *req = reqs; req != reqs + length_of(reqs); ++req)
+    {
+        req->cb        = master_async_count_cb;
+        req->user_data = &completed;
+        master_async_submit(&bus, req);
+    }
+
+    for (int i = 0; i < 100 && (int)length_of(reqs) > completed; ++i)
+        master_async_run(&engine, 1000);
+
+    ASSERT_EQ((int)length_of(reqs), completed);
+    EXPECT_EQ(MASTER_ASYNC_ok, reqs[0].result);
+    EXPECT_EQ(MASTER_ASYNC_ok, reqs[1].result);
+    EXPECT_EQ(MASTER_ASYNC_timeout, reqs[2].result);
+    EXPECT_EQ((size_t)0, reqs[2].rx_received);
+    EXPECT_EQ(MASTER_ASYNC_exception, reqs[3].result);
+    EXPECT_EQ(ECODE_ILLEGAL_DATA_ADDRESS, reqs[3].ecode);
+    EXPECT_EQ((size_t)5, reqs[3].rx_received);
+    // completed by reply, not by response timer
+    EXPECT_GT(
+        reqs[3].timing.tx_end_ns
+            + (calc_tmin_us(rate, reqs[3].tx_size)
+               + calc_tmax_us(rate, rd_rx_size))
+                  * INT64_C(1000)
+            + max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS)
+                  * INT64_C(1000000),
+        reqs[3].timing.complete_ns);
+
+    const modbus_rtu_rd_bytes_reply_t *rep
+        = parse_reply_rd_bytes(rd_rx, reqs[1].rx_received);
+
+    ASSERT_TRUE(rep);
+    EXPECT_EQ(rep->header.count, sizeof(message));
+    EXPECT_EQ(0, memcmp(rep->bytes, message, sizeof(message)));
+
+    for (master_async_req_t *req = reqs; req != reqs + length_of(reqs); ++req)
+    {
+        EXPECT_LE(req->timing.submit_ns, req->timing.tx_begin_ns);
+        EXPECT_LE(req->timing.tx_begin_ns, req->timing.tx_end_ns);
+        EXPECT_LE(req->timing.tx_end_ns, req->timing.complete_ns);
+    }
+    EXPECT_LE(reqs[1].timing.tx_end_ns, reqs[1].timing.rx_begin_ns);
+    // requests are serialized with turnaround in between
+    EXPECT_LE(
+        reqs[0].timing.complete_ns + bus.turnaround_us * INT64_C(1000),
+        reqs[1].timing.tx_begin_ns);
+
+    master_async_bus_deinit(&bus);
+    master_async_deinit(&engine);
+}
+
+UTEST(rtu_tests, master_async_hangup)
+{
+    tty_pair_t pair;
+
+    tty_pair_init(&pair);
+    tty_pair_create(&pair, TTY_DEFAULT_MULTIPLEXOR, NULL);
+
+    const int pts = open(pair.slave_path, O_RDWR | O_NOCTTY);
+
+    ASSERT_LE(0, pts);
+
+    tty_dev_t dev;
+    master_async_t engine;
+    master_async_bus_t bus;
+    const char tx[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x01, 0x84, 0x0A};
+    char rx[8];
+    int completed = 0;
+    master_async_req_t reqs[2];
+
+    tty_init(&dev, 0);
+    dev.fd = pair.master_fd;
+    master_async_init(&engine);
+    master_async_bus_init(&bus, &engine, &dev, B115200, 10);
+
+    for (size_t i = 0; i < length_of(reqs); ++i)
+    {
+        reqs[i] = (master_async_req_t){
+            .tx        = tx,
+            .tx_size   = sizeof(tx),
+            .rx        = rx,
+            .rx_size   = sizeof(rx),
+            .cb        = master_async_count_cb,
+            .user_data = &completed};
+        master_async_submit(&bus, &reqs[i]);
+    }
+
+    // request in progress waits for reply, other side hangs up
+    close(pts);
+    for (int i = 0; i < 10 && (int)length_of(reqs) > completed; ++i)
+        master_async_run(&engine, 100);
+
+    ASSERT_EQ((int)length_of(reqs), completed);
+    EXPECT_EQ(MASTER_ASYNC_bus_error, reqs[0].result);
+    EXPECT_EQ(MASTER_ASYNC_bus_error, reqs[1].result);
+
+    // tty is not polled anymore, no busy loop
+    EXPECT_EQ(0, master_async_run(&engine, 10));
+
+    // later requests fail too
+    master_async_submit(&bus, &reqs[0]);
+    EXPECT_EQ(1, master_async_run(&engine, 100));
+    EXPECT_EQ(MASTER_ASYNC_bus_error, reqs[0].result);
+
+    master_async_bus_deinit(&bus);
+    master_async_deinit(&engine);
+    close(pair.master_fd);
+    dev.fd = -1;
+    tty_deinit(&dev);
+    tty_pair_deinit(&pair);
+}
+
+UTEST_I(TestFixture, master_sched, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const uint8_t message[] = "scheduled";
+    const speed_t rate
+        = is_hw_test(tf) ? tf->config->rate : tf->rtu_config.rate;
+
+    master_async_t engine;
+    master_async_bus_t bus;
+
+    master_async_init(&engine);
+    master_async_bus_init(
+        &bus, &engine, &tf->master, rate,
+        max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS));
+    // RTU BUSY -> IDLE, see master_async
+    bus.turnaround_us = 50000;
+
+    char wr_tx[ADU_CAPACITY], wr_rx[sizeof(modbus_rtu_wr_bytes_reply_t)];
+    char rd_tx[ADU_CAPACITY], rd_rx[ADU_CAPACITY];
+
+    master_sched_entry_t entries[] = {
+        {.bus = &bus,
+         .req
+         = {.tx      = rd_tx,
+            .tx_size = (size_t)(make_request_rd_bytes(
+                                    tf->config->rtu_addr,
+                                    WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR),
+                                    sizeof(message), rd_tx, sizeof(rd_tx))
+                                - rd_tx),
+            .rx      = rd_rx,
+            .rx_size = sizeof(modbus_rtu_rd_bytes_reply_header_t)
+                     + sizeof(message) + 2},
+         .period_us = 200000},
+        {.bus = &bus,
+         .req
+         = {.tx      = wr_tx,
+            .tx_size = (size_t)(make_request_wr_bytes(
+                                    tf->config->rtu_addr,
+                                    WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR), message,
+                                    sizeof(message), wr_tx, sizeof(wr_tx))
+                                - wr_tx),
+            .rx      = wr_rx,
+            .rx_size = sizeof(wr_rx)},
+         .period_us = 400000}};
+
+    master_sched_t sched;
+
+    master_sched_init(&sched, &engine, entries, length_of(entries), 0);
+    master_sched_start(&sched);
+
+    const int64_t end_ns = timestamp_ns() + INT64_C(1000000000);
+
+    while (timestamp_ns() < end_ns) master_sched_run(&sched, 100);
+
+    for (master_sched_entry_t *entry = entries;
+         entry != entries + length_of(entries); ++entry)
+    {
+        EXPECT_EQ(MASTER_ASYNC_ok, entry->req.result);
+        EXPECT_EQ(0u, entry->stats.overruns);
+        EXPECT_EQ(0u, entry->stats.deadline_misses);
+        EXPECT_LE(entry->stats.releases, entry->stats.completed + 1);
+    }
+    EXPECT_LE(5u, entries[0].stats.completed);
+    EXPECT_LE(2u, entries[1].stats.completed);
+
+    master_async_bus_deinit(&bus);
+    master_sched_deinit(&sched);
+    master_async_deinit(&engine);
+}
+
+UTEST_I(TestFixture, master_exception, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    // long enough to tell early termination from timeout
+    const int timeout_exec_ms = 1000;
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms};
+    data16_t rx_data[8];
+
+    const int64_t begin_ns = timestamp_ns();
+    // out of RTU memory
+    data16_t *const rx_data_end = rtu_master_rd_holding_registers(
+        &impl, tf->config->rtu_addr,
+        WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR + RTU_MEMORY_SIZE),
+        WORD_TO_COUNT(length_of(rx_data)), rx_data);
+    const int64_t elapsed_ms = (timestamp_ns() - begin_ns) / 1000000;
+
+    EXPECT_FALSE(rx_data_end);
+    EXPECT_EQ(ECODE_ILLEGAL_DATA_ADDRESS, impl.ecode);
+    EXPECT_LT(elapsed_ms, timeout_exec_ms / 2);
+}
+
+UTEST_I(TestFixture, master_trace, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_latency_table_t *latency
+        = calloc(1, sizeof(rtu_master_latency_table_t));
+    rtu_master_trace_t trace;
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms,
+           .trace           = &trace,
+           .latency         = latency};
+    const addr_t addr = tf->config->rtu_addr;
+    const useconds_t turnaround_us
+        = (useconds_t)rtu_turnaround_us(tf, ADU_CAPACITY);
+    data16_t data[8];
+
+    ASSERT_TRUE(latency);
+    rtu_master_latency_init(latency);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_EQ(
+            data + length_of(data),
+            rtu_master_rd_holding_registers(
+                &impl, addr, WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR),
+                WORD_TO_COUNT(length_of(data)), data));
+        usleep(turnaround_us);
+
+        EXPECT_TRUE(trace.ok);
+        EXPECT_EQ(addr, trace.addr);
+        EXPECT_EQ(FCODE_RD_HOLDING_REGISTERS, trace.fcode);
+        EXPECT_EQ(
+            sizeof(modbus_rtu_rd_holding_registers_request_t), trace.tx_bytes);
+        EXPECT_EQ(5 + sizeof(data), trace.rx_bytes);
+        // phases are ordered
+        EXPECT_LE(trace.tx_begin_ns, trace.tx_end_ns);
+        EXPECT_LE(trace.tx_end_ns, trace.tx_drained_ns);
+        EXPECT_LE(trace.tx_drained_ns, trace.rx_first_ns);
+        EXPECT_LE(trace.rx_first_ns, trace.rx_last_ns);
+    }
+
+    // exception reply is complete, but not ok
+    EXPECT_FALSE(rtu_master_rd_holding_registers(
+        &impl, addr, WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR + RTU_MEMORY_SIZE),
+        WORD_TO_COUNT(length_of(data)), data));
+    usleep(turnaround_us);
+    EXPECT_FALSE(trace.ok);
+    EXPECT_EQ((size_t)5, trace.rx_bytes);
+    EXPECT_NE(-1, trace.rx_last_ns);
+
+    const rtu_master_latency_t *slave = &latency->slaves[addr];
+
+    EXPECT_EQ((uint32_t)4, slave->transactions);
+    EXPECT_EQ((uint32_t)1, slave->failures);
+    EXPECT_EQ(4 * trace.tx_bytes, slave->tx_bytes);
+
+    const int64_t p50_us = rtu_master_latency_percentile_us(
+        slave, RTU_MASTER_PHASE_total, 500);
+    const int64_t p100_us = rtu_master_latency_percentile_us(
+        slave, RTU_MASTER_PHASE_total, 1000);
+
+    EXPECT_LE(0, p50_us);
+    EXPECT_LE(p50_us, p100_us);
+    EXPECT_EQ(slave->max_us[RTU_MASTER_PHASE_total], p100_us);
+    EXPECT_EQ(
+        -1,
+        rtu_master_latency_percentile_us(
+            &latency->slaves[addr + 1], RTU_MASTER_PHASE_total, 500));
+
+    char *csv        = NULL;
+    size_t csv_size  = 0;
+    FILE *const file = open_memstream(&csv, &csv_size);
+    size_t rows      = 0;
+
+    ASSERT_TRUE(file);
+    rtu_master_latency_export(latency, file);
+    fclose(file);
+
+    for (const char *c = csv; *c; ++c) rows += '\n' == *c;
+    // header + phases of single slave
+    EXPECT_EQ((size_t)(1 + RTU_MASTER_PHASE_NUM), rows);
+    EXPECT_EQ(0, strncmp("addr,transactions,", csv, 18));
+    free(csv);
+    free(latency);
+}
+
+UTEST_I(TestFixture, master_adaptive_timeout, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int64_t max_us = 1000000;
+    rtu_master_rtt_table_t rtt;
+
+    // floor absorbs scheduling jitter of loaded runner
+    rtu_master_rtt_init(&rtt, 100000, max_us);
+
+    rtu_master_impl_t impl
+        = {.dev = &tf->master, .rate = tf->config->rate, .rtt = &rtt};
+    const addr_t addr = tf->config->rtu_addr;
+    uint8_t rx_buf[16];
+
+    EXPECT_EQ(max_us, rtu_master_rtt_timeout_us(&rtt, addr));
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i) usleep(100000); // for RTU to transition from BUSY to IDLE
+        ASSERT_TRUE(rtu_master_rd_bytes(
+            &impl, addr, WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR), length_of(rx_buf),
+            rx_buf));
+    }
+
+    EXPECT_EQ(4u, rtt.slaves[addr].samples);
+    // pty + software RTU answer within few ms
+    EXPECT_LT(rtu_master_rtt_timeout_us(&rtt, addr), max_us / 2);
+    EXPECT_EQ(0u, rtt.slaves[(addr_t)(addr + 1)].samples);
+}
+
+typedef struct
+{
+    tty_dev_t *dev;
+    // reply delay (first byte latency)
+    atomic_int latency_us;
+    atomic_int stop;
+} delayed_slave_t;
+
+/* FC3 single register slave, value of register is its address (exception
+ * above 0x7FFF), requests received while busy are lost */
+static void *delayed_slave(void *user_data)
+{
+    delayed_slave_t *slave = user_data;
+    const int fd           = slave->dev->fd;
+    uint8_t req[8];
+    size_t size = 0;
+
+    while (!atomic_load(&slave->stop))
+    {
+        struct pollfd event = {fd, (short)POLLIN, (short)0};
+
+        // silence, start of next frame
+        if (1 != poll(&event, 1, 10))
+        {
+            size = 0;
+            continue;
+        }
+
+        const ssize_t r = read(fd, req + size, sizeof(req) - size);
+
+        if (0 >= r) continue;
+        size += (size_t)r;
+        if (sizeof(req) != size) continue;
+        size = 0;
+        if (!valid_crc(req, sizeof(req))) continue;
+
+        uint8_t rep[7] = {req[0], req[1], 2, req[2], req[3]};
+        // exception: function code | 0x80, exception code, CRC
+        const size_t rep_size = 0x80 & req[2] ? 5 : sizeof(rep);
+
+        if (5 == rep_size)
+        {
+            rep[1] |= 0x80;
+            rep[2] = ECODE_ILLEGAL_DATA_ADDRESS;
+        }
+        usleep((useconds_t)atomic_load(&slave->latency_us));
+        implace_crc(rep, rep_size);
+        CHECK_ERRNO((ssize_t)rep_size == write(fd, rep, rep_size));
+        tty_flush_rx(fd);
+    }
+    return NULL;
+}
+
+UTEST(rtu_tests, master_rtt_backoff)
+{
+    tty_pair_t pair;
+    tty_dev_t master, slave;
+
+    tty_pair_init(&pair);
+    tty_pair_create(&pair, TTY_DEFAULT_MULTIPLEXOR, NULL);
+    tty_init(&master, 0);
+    tty_init(&slave, 0);
+    tty_adopt(&master, pair.master_fd);
+    tty_open(&slave, pair.slave_path, NULL);
+    tty_pair_deinit(&pair);
+    serial_config(&master, &slave, B115200, PARITY_none);
+
+    const addr_t addr       = 1;
+    const int64_t max_us    = 1000000;
+    const int latency_us    = 100000;
+    delayed_slave_t delayed = {.dev = &slave};
+    rtu_master_rtt_table_t rtt;
+    rtu_master_impl_t impl = {.dev = &master, .rate = B115200, .rtt = &rtt};
+    pthread_t thread;
+    data16_t value;
+
+    atomic_init(&delayed.latency_us, 0);
+    atomic_init(&delayed.stop, 0);
+    ASSERT_EQ(0, pthread_create(&thread, NULL, delayed_slave, &delayed));
+    // floor absorbs scheduling jitter of loaded runner
+    rtu_master_rtt_init(&rtt, 10000, max_us);
+
+    for (uint16_t reg = 0; reg < 4; ++reg)
+    {
+        if (rtu_master_rd_holding_registers(
+                &impl, addr, WORD_TO_MEM_ADDR(reg), WORD_TO_COUNT(1), &value))
+            EXPECT_EQ(reg, DATA16_TO_WORD(value));
+    }
+
+    const int64_t learned_us = rtu_master_rtt_timeout_us(&rtt, addr);
+
+    ASSERT_LT(0u, rtt.slaves[addr].samples);
+    ASSERT_LT(learned_us, (int64_t)latency_us / 2);
+
+    // slave slows down above learned timeout
+    atomic_store(&delayed.latency_us, latency_us);
+    EXPECT_FALSE(rtu_master_rd_holding_registers(
+        &impl, addr, WORD_TO_MEM_ADDR(100), WORD_TO_COUNT(1), &value));
+    EXPECT_LT(learned_us, rtu_master_rtt_timeout_us(&rtt, addr));
+
+    int recovered = 0;
+
+    for (uint16_t reg = 101; reg < 120 && !recovered; ++reg)
+    {
+        // poll cycle, late reply arrives between requests
+        usleep((useconds_t)(2 * latency_us));
+        if (!rtu_master_rd_holding_registers(
+                &impl, addr, WORD_TO_MEM_ADDR(reg), WORD_TO_COUNT(1), &value))
+            continue;
+        // late reply of earlier request is flushed
+        EXPECT_EQ(reg, DATA16_TO_WORD(value));
+        recovered = 1;
+    }
+    EXPECT_TRUE(recovered);
+
+    atomic_store(&delayed.stop, 1);
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+    serial_deinit(&master, &slave);
+}
+
+UTEST(rtu_tests, master_uring)
+{
+    tty_pair_t pair;
+    tty_dev_t master, slave;
+
+    tty_pair_init(&pair);
+    tty_pair_create(&pair, TTY_DEFAULT_MULTIPLEXOR, NULL);
+    tty_init(&master, 0);
+    tty_init(&slave, 0);
+    tty_adopt(&master, pair.master_fd);
+    tty_open(&slave, pair.slave_path, NULL);
+    tty_pair_deinit(&pair);
+    serial_config(&master, &slave, B115200, PARITY_none);
+
+    rtu_master_uring_t uring;
+
+    // io_uring may be disabled (kernel config, seccomp), nothing to test
+    if (rtu_master_uring_init(&uring, &master))
+    {
+        serial_deinit(&master, &slave);
+        return;
+    }
+
+    const addr_t addr       = 1;
+    delayed_slave_t delayed = {.dev = &slave};
+    rtu_master_trace_t trace;
+    rtu_master_impl_t impl
+        = {.dev             = &master,
+           .rate            = B115200,
+           .timeout_exec_ms = TIMEOUT_EXEC_MS,
+           .trace           = &trace,
+           .uring           = &uring};
+    pthread_t thread;
+    data16_t value;
+
+    atomic_init(&delayed.latency_us, 0);
+    atomic_init(&delayed.stop, 0);
+    ASSERT_EQ(0, pthread_create(&thread, NULL, delayed_slave, &delayed));
+
+    for (uint16_t reg = 0; reg < 4; ++reg)
+    {
+        ASSERT_TRUE(rtu_master_rd_holding_registers(
+            &impl, addr, WORD_TO_MEM_ADDR(reg), WORD_TO_COUNT(1), &value));
+        EXPECT_EQ(reg, DATA16_TO_WORD(value));
+        EXPECT_LE(trace.tx_end_ns, trace.rx_first_ns);
+        EXPECT_LE(trace.rx_first_ns, trace.rx_last_ns);
+    }
+
+    // exception reply is recognized
+    EXPECT_FALSE(rtu_master_rd_holding_registers(
+        &impl, addr, WORD_TO_MEM_ADDR(0x8000), WORD_TO_COUNT(1), &value));
+    EXPECT_EQ(ECODE_ILLEGAL_DATA_ADDRESS, impl.ecode);
+
+    // late reply is flushed, next transaction gets its own
+    atomic_store(&delayed.latency_us, 2 * TIMEOUT_EXEC_MS * 1000);
+    EXPECT_FALSE(rtu_master_rd_holding_registers(
+        &impl, addr, WORD_TO_MEM_ADDR(10), WORD_TO_COUNT(1), &value));
+    EXPECT_EQ(0, impl.ecode);
+    atomic_store(&delayed.latency_us, 0);
+    usleep(2 * TIMEOUT_EXEC_MS * 1000);
+    ASSERT_TRUE(rtu_master_rd_holding_registers(
+        &impl, addr, WORD_TO_MEM_ADDR(11), WORD_TO_COUNT(1), &value));
+    EXPECT_EQ(11, DATA16_TO_WORD(value));
+
+    EXPECT_EQ(7u, uring.stats.transactions);
+    // request write and reply wait share io_uring_enter() calls
+    EXPECT_GE(3 * uring.stats.transactions, uring.stats.enters);
+
+    atomic_store(&delayed.stop, 1);
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+    rtu_master_uring_deinit(&uring);
+    serial_deinit(&master, &slave);
+}
+
+UTEST_I(TestFixture, master_circuit_breaker, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const rtu_master_health_policy_t policy
+        = {.retries          = 1,
+           .failures_to_open = 2,
+           .backoff_min_us   = 200000,
+           .backoff_max_us   = 1000000};
+    rtu_master_health_table_t health;
+
+    rtu_master_health_init(&health, &policy);
+
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = tf->config->timeout_exec_ms,
+           .health          = &health};
+    // nobody is listening on this address
+    const addr_t addr                = (addr_t)(tf->config->rtu_addr + 1);
+    const rtu_master_health_t *slave = &health.slaves[addr];
+    const mem_addr_t mem_addr        = WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR);
+    uint8_t rx_buf[4];
+
+    // 2 failed transactions (with retry) open the circuit
+    for (int i = 0; i < 2; ++i)
+    {
+        EXPECT_FALSE(
+            rtu_master_rd_bytes(&impl, addr, mem_addr, sizeof(rx_buf), rx_buf));
+    }
+    EXPECT_EQ(RTU_MASTER_HEALTH_open, slave->state);
+    EXPECT_EQ(2u, slave->stats.retries);
+    EXPECT_EQ(1u, slave->stats.opened);
+
+    // rejected without touching the bus
+    const int64_t begin_ns = timestamp_ns();
+
+    EXPECT_FALSE(
+        rtu_master_rd_bytes(&impl, addr, mem_addr, sizeof(rx_buf), rx_buf));
+    EXPECT_LT(timestamp_ns() - begin_ns, INT64_C(1000000));
+    EXPECT_EQ(1u, slave->stats.rejected);
+
+    // failed probe doubles backoff
+    usleep((useconds_t)policy.backoff_min_us);
+    EXPECT_FALSE(
+        rtu_master_rd_bytes(&impl, addr, mem_addr, sizeof(rx_buf), rx_buf));
+    EXPECT_EQ(1u, slave->stats.probes);
+    EXPECT_EQ(2u, slave->stats.retries);
+    EXPECT_EQ(RTU_MASTER_HEALTH_open, slave->state);
+    EXPECT_EQ(2 * policy.backoff_min_us, slave->backoff_us);
+
+    // healthy slave is not affected
+    impl.timeout_exec_ms = max(impl.timeout_exec_ms, TIMEOUT_EXEC_MS);
+    EXPECT_TRUE(rtu_master_rd_bytes(
+        &impl, tf->config->rtu_addr, mem_addr, sizeof(rx_buf), rx_buf));
+    EXPECT_EQ(
+        RTU_MASTER_HEALTH_closed,
+        health.slaves[tf->config->rtu_addr].state);
+}
+
+UTEST_I(TestFixture, master_range, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms};
+    rtu_master_range_t range
+        = {.retries = 1, .turnaround_us = rtu_turnaround_us(tf, ADU_CAPACITY)};
+    const mem_addr_t mem_addr = WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR);
+    uint8_t tx_buf[RTU_MEMORY_SIZE];
+    uint8_t rx_buf[RTU_MEMORY_SIZE];
+
+    for (size_t i = 0; i < sizeof(tx_buf); ++i) tx_buf[i] = (uint8_t)(i * 7);
+    memset(rx_buf, 0, sizeof(rx_buf));
+
+    // 249 bytes per frame
+    const uint32_t frames = (RTU_MEMORY_SIZE + 248) / 249;
+
+    EXPECT_EQ(
+        (const void *)(tx_buf + sizeof(tx_buf)),
+        rtu_master_write_range(
+            &impl, tf->config->rtu_addr, mem_addr, sizeof(tx_buf), tx_buf,
+            &range));
+    EXPECT_EQ(frames, range.stats.frames);
+    EXPECT_EQ(sizeof(tx_buf), range.stats.bytes);
+
+    usleep((useconds_t)range.turnaround_us);
+
+    EXPECT_EQ(
+        (void *)(rx_buf + sizeof(rx_buf)),
+        rtu_master_read_range(
+            &impl, tf->config->rtu_addr, mem_addr, sizeof(rx_buf), rx_buf,
+            &range));
+    EXPECT_EQ(frames, range.stats.frames);
+    EXPECT_LT(0, range.stats.bytes_per_s);
+    EXPECT_EQ(0, memcmp(tx_buf, rx_buf, sizeof(rx_buf)));
+
+    // nobody is listening: chunk is retried once, then transfer fails
+    EXPECT_FALSE(rtu_master_read_range(
+        &impl, (addr_t)(tf->config->rtu_addr + 1), mem_addr, 8, rx_buf,
+        &range));
+    EXPECT_EQ(2u, range.stats.frames);
+    EXPECT_EQ(1u, range.stats.retries);
+    EXPECT_EQ((size_t)0, range.stats.bytes);
+
+    // exception is final, not retried
+    EXPECT_FALSE(rtu_master_read_range(
+        &impl, tf->config->rtu_addr,
+        WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR + RTU_MEMORY_SIZE), 8, rx_buf,
+        &range));
+    EXPECT_EQ(1u, range.stats.frames);
+    EXPECT_EQ(ECODE_ILLEGAL_DATA_ADDRESS, impl.ecode);
+}
+
+static master_coalesce_req_t coalesce_req(
+    master_coalesce_op_t op, uint16_t offset, uint16_t count, void *data)
+{
+    return (master_coalesce_req_t){
+        .op       = op,
+        .addr     = g_test_config->rtu_addr,
+        .mem_addr = RTU_MEMORY_ADDR + offset,
+        .count    = count,
+        .data     = data};
+}
+
+UTEST_I(TestFixture, master_coalesce, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = tf->config->timeout_exec_ms};
+    master_coalesce_t coalesce;
+
+    master_coalesce_init(&coalesce, &impl, 1);
+    // for RTU to transition from BUSY to IDLE state (see usleep above)
+    coalesce.turnaround_us = 100000;
+
+    data16_t wr_data[4];
+    uint8_t wr_bytes[] = {0xA0, 0xA1, 0xA2, 0xA3};
+    data16_t rd_data[2][2];
+    uint8_t rd_bytes[2][2];
+    master_coalesce_req_t reqs[] = {
+        // single register writes -> FC16
+        coalesce_req(MASTER_COALESCE_wr_registers, 2, 1, &wr_data[2]),
+        coalesce_req(MASTER_COALESCE_wr_registers, 0, 1, &wr_data[0]),
+        coalesce_req(MASTER_COALESCE_wr_registers, 1, 1, &wr_data[1]),
+        coalesce_req(MASTER_COALESCE_wr_registers, 3, 1, &wr_data[3]),
+        // adjacent byte writes -> FC66
+        coalesce_req(MASTER_COALESCE_wr_bytes, 10, 2, &wr_bytes[0]),
+        coalesce_req(MASTER_COALESCE_wr_bytes, 12, 2, &wr_bytes[2]),
+        // reads with gap of 1 -> FC3
+        coalesce_req(MASTER_COALESCE_rd_registers, 0, 2, rd_data[0]),
+        coalesce_req(MASTER_COALESCE_rd_registers, 3, 1, rd_data[1]),
+        // overlapping reads -> FC65
+        coalesce_req(MASTER_COALESCE_rd_bytes, 11, 2, rd_bytes[0]),
+        coalesce_req(MASTER_COALESCE_rd_bytes, 12, 2, rd_bytes[1])};
+
+    for (size_t i = 0; i < length_of(wr_data); ++i)
+        wr_data[i] = WORD_TO_DATA16(0x10 + i);
+
+    for (size_t i = 0; i < length_of(reqs); ++i)
+        master_coalesce_submit(&coalesce, &reqs[i]);
+
+    EXPECT_EQ((size_t)4, master_coalesce_flush(&coalesce));
+    EXPECT_EQ(length_of(reqs), coalesce.stats.requests);
+
+    for (size_t i = 0; i < length_of(reqs); ++i) EXPECT_TRUE(reqs[i].ok);
+
+    EXPECT_EQ(0, memcmp(rd_data[0], &wr_data[0], sizeof(rd_data[0])));
+    EXPECT_EQ(0, memcmp(rd_data[1], &wr_data[3], sizeof(data16_t)));
+    EXPECT_EQ(0, memcmp(rd_bytes[0], &wr_bytes[1], sizeof(rd_bytes[0])));
+    EXPECT_EQ(0, memcmp(rd_bytes[1], &wr_bytes[2], sizeof(rd_bytes[1])));
+}
+
+UTEST_I(TestFixture, master_coalesce_order, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms};
+    master_coalesce_t coalesce;
+
+    master_coalesce_init(&coalesce, &impl, 0);
+    coalesce.turnaround_us = rtu_turnaround_us(tf, ADU_CAPACITY);
+
+    // FC66 followed by FC16 to same bytes, later (register) write wins
+    {
+        const uint8_t wr_bytes[] = {0xB0, 0xB1, 0xB2, 0xB3};
+        const data16_t wr_data[] = {WORD_TO_DATA16(0x11), WORD_TO_DATA16(0x22)};
+        const uint8_t expected[] = {0x11, 0x22, 0xB2, 0xB3};
+        uint8_t rd_bytes[sizeof(expected)];
+        master_coalesce_req_t reqs[] = {
+            coalesce_req(MASTER_COALESCE_wr_bytes, 20, 4, (void *)wr_bytes),
+            coalesce_req(MASTER_COALESCE_wr_registers, 20, 2, (void *)wr_data),
+            coalesce_req(MASTER_COALESCE_rd_bytes, 20, 4, rd_bytes)};
+
+        for (size_t i = 0; i < length_of(reqs); ++i)
+            master_coalesce_submit(&coalesce, &reqs[i]);
+
+        EXPECT_EQ((size_t)3, master_coalesce_flush(&coalesce));
+        for (size_t i = 0; i < length_of(reqs); ++i) EXPECT_TRUE(reqs[i].ok);
+        EXPECT_EQ(0, memcmp(expected, rd_bytes, sizeof(expected)));
+    }
+
+    usleep(coalesce.turnaround_us);
+
+    /* earlier write [100, 250) and later write [0, 120) do not fit into
+     * single FC66, later write is executed last although lower address */
+    {
+        uint8_t earlier[150];
+        uint8_t later[120];
+        uint8_t rd_bytes[40];
+        master_coalesce_req_t reqs[] = {
+            coalesce_req(MASTER_COALESCE_wr_bytes, 100, 150, earlier),
+            coalesce_req(MASTER_COALESCE_wr_bytes, 0, 120, later),
+            coalesce_req(MASTER_COALESCE_rd_bytes, 90, 40, rd_bytes)};
+
+        memset(earlier, 0xBB, sizeof(earlier));
+        memset(later, 0xAA, sizeof(later));
+
+        for (size_t i = 0; i < length_of(reqs); ++i)
+            master_coalesce_submit(&coalesce, &reqs[i]);
+
+        EXPECT_EQ((size_t)3, master_coalesce_flush(&coalesce));
+        for (size_t i = 0; i < length_of(reqs); ++i) EXPECT_TRUE(reqs[i].ok);
+        // [90, 120) later write, [120, 130) earlier write
+        for (size_t i = 0; i < sizeof(rd_bytes); ++i)
+            EXPECT_EQ(30 > i ? 0xAA : 0xBB, rd_bytes[i]);
+    }
+}
+
+UTEST_I(TestFixture, master_mirror, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms};
+    master_mirror_t mirror;
+    uint8_t image[64];
+
+    master_mirror_init(
+        &mirror, &impl, tf->config->rtu_addr, RTU_MEMORY_ADDR, sizeof(image));
+    mirror.turnaround_us = rtu_turnaround_us(tf, ADU_CAPACITY);
+
+    // whole window is stale initially, one read
+    EXPECT_TRUE(master_mirror_sync(&mirror));
+    EXPECT_EQ(0u, mirror.stats.wr_frames);
+    EXPECT_EQ(1u, mirror.stats.rd_frames);
+    EXPECT_EQ((size_t)0, master_mirror_stale(&mirror));
+    memcpy(image, mirror.data, sizeof(image));
+
+    // unchanged bytes are not dirty
+    master_mirror_write(&mirror, 0, image, sizeof(image));
+    EXPECT_EQ((size_t)0, master_mirror_dirty(&mirror));
+
+    const uint8_t a[] = {0x5A, 0x5B};
+    const uint8_t b   = 0x5C;
+    const uint8_t c   = 0x5D;
+
+    // [2, 11) in one frame (gap cheaper than header), 60 in another
+    master_mirror_write(&mirror, 2, a, sizeof(a));
+    master_mirror_write(&mirror, 10, &b, 1);
+    master_mirror_write(&mirror, 60, &c, 1);
+    // slave owned byte in between, refreshed, never written
+    master_mirror_invalidate(&mirror, 40, 1);
+    EXPECT_EQ((size_t)4, master_mirror_dirty(&mirror));
+
+    usleep((useconds_t)mirror.turnaround_us);
+    EXPECT_TRUE(master_mirror_sync(&mirror));
+    EXPECT_EQ(2u, mirror.stats.wr_frames);
+    EXPECT_EQ((size_t)(9 + 1), mirror.stats.wr_bytes);
+    EXPECT_EQ(2u, mirror.stats.rd_frames);
+    EXPECT_EQ((size_t)0, master_mirror_dirty(&mirror));
+    EXPECT_EQ((size_t)0, master_mirror_stale(&mirror));
+
+    memcpy(image + 2, a, sizeof(a));
+    image[10] = b;
+    image[60] = c;
+    EXPECT_EQ(0, memcmp(image, mirror.data, sizeof(image)));
+
+    uint8_t rx_buf[sizeof(image)];
+
+    usleep((useconds_t)mirror.turnaround_us);
+    EXPECT_TRUE(rtu_master_rd_bytes(
+        &impl, tf->config->rtu_addr, WORD_TO_MEM_ADDR(RTU_MEMORY_ADDR),
+        sizeof(rx_buf), rx_buf));
+    EXPECT_EQ(0, memcmp(image, rx_buf, sizeof(image)));
+
+    // nothing to do
+    EXPECT_TRUE(master_mirror_sync(&mirror));
+    EXPECT_EQ(3u, mirror.stats.syncs);
+    EXPECT_EQ(2u, mirror.stats.wr_frames);
+
+    master_mirror_deinit(&mirror);
+}
+
+typedef struct
+{
+    master_shared_t *shared;
+    modbus_rtu_addr_t addr;
+    uint16_t offset;
+    int failures;
+} shared_producer_t;
+
+static void *shared_producer(void *user_data)
+{
+    shared_producer_t *producer = user_data;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        data16_t wr_data[2] = {
+            WORD_TO_DATA16(producer->offset + i),
+            WORD_TO_DATA16(0x80 + producer->offset + i)};
+        data16_t rd_data[2];
+        master_shared_req_t wr = {
+            .op         = MASTER_SHARED_wr_registers,
+            .addr       = producer->addr,
+            .mem_addr   = RTU_MEMORY_ADDR + producer->offset,
+            .count      = length_of(wr_data),
+            .data       = wr_data,
+            .prio_class = i % 2 ? MASTER_SHARED_CLASS_urgent
+                                : MASTER_SHARED_CLASS_normal,
+            .event_fd   = -1};
+        master_shared_req_t rd = wr;
+
+        rd.op   = MASTER_SHARED_rd_registers;
+        rd.data = rd_data;
+        // both queued at once, FIFO within class keeps write first
+        master_shared_submit(producer->shared, &wr);
+        master_shared_submit(producer->shared, &rd);
+
+        if (MASTER_SHARED_ok != master_shared_wait(producer->shared, &wr)
+            || MASTER_SHARED_ok != master_shared_wait(producer->shared, &rd)
+            || memcmp(wr_data, rd_data, sizeof(wr_data)))
+            ++producer->failures;
+    }
+    return NULL;
+}
+
+UTEST_I(TestFixture, master_shared, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms};
+    master_shared_t shared;
+    pthread_t threads[4];
+    shared_producer_t producers[length_of(threads)];
+
+    master_shared_init(&shared, &impl);
+    shared.turnaround_us = rtu_turnaround_us(tf, ADU_CAPACITY);
+    master_shared_start(&shared);
+
+    for (size_t i = 0; i < length_of(threads); ++i)
+    {
+        producers[i] = (shared_producer_t){
+            .shared   = &shared,
+            .addr     = tf->config->rtu_addr,
+            .offset   = (uint16_t)(2 * i),
+            .failures = 0};
+        ASSERT_EQ(
+            0,
+            pthread_create(&threads[i], NULL, shared_producer, &producers[i]));
+    }
+
+    for (size_t i = 0; i < length_of(threads); ++i)
+    {
+        ASSERT_EQ(0, pthread_join(threads[i], NULL));
+        EXPECT_EQ(0, producers[i].failures);
+    }
+
+    master_shared_deinit(&shared);
+    EXPECT_EQ(
+        (uint32_t)(length_of(threads) * 4 * 2), shared.stats.transactions);
+}
+
+UTEST_I(TestFixture, master_shared_bulk, 19)
+{
+    struct TestFixture *tf = utest_fixture;
+    ASSERT_TRUE(tf);
+
+    const int timeout_exec_ms
+        = max(tf->config->timeout_exec_ms, TIMEOUT_EXEC_MS);
+    rtu_master_impl_t impl
+        = {.dev             = &tf->master,
+           .rate            = tf->config->rate,
+           .timeout_exec_ms = timeout_exec_ms};
+    master_shared_t shared;
+    // 3 frames
+    uint8_t bulk_data[600];
+    uint8_t stop = 0xE5;
+    master_shared_req_t bulk = {
+        .op         = MASTER_SHARED_rd_range,
+        .addr       = tf->config->rtu_addr,
+        .mem_addr   = RTU_MEMORY_ADDR,
+        .count      = sizeof(bulk_data),
+        .data       = bulk_data,
+        .prio_class = MASTER_SHARED_CLASS_bulk,
+        .event_fd   = -1};
+    master_shared_req_t urgent = {
+        .op         = MASTER_SHARED_wr_bytes,
+        .addr       = tf->config->rtu_addr,
+        .mem_addr   = RTU_MEMORY_ADDR + sizeof(bulk_data),
+        .count      = sizeof(stop),
+        .data       = &stop,
+        .prio_class = MASTER_SHARED_CLASS_urgent,
+        .event_fd   = -1};
+    atomic_int gate;
+    int order[1];
+    size_t order_size         = 0;
+    shared_call_t blocking    = {&gate, order, &order_size};
+    master_shared_req_t first = {
+        .op        = MASTER_SHARED_call,
+        .call      = shared_call,
+        .user_data = &blocking,
+        .event_fd  = -1};
+
+    atomic_init(&gate, 0);
+    master_shared_init(&shared, &impl);
+    shared.turnaround_us = rtu_turnaround_us(tf, ADU_CAPACITY);
+    master_shared_start(&shared);
+    master_shared_submit(&shared, &first);
+    while (1 != atomic_load(&gate)) sched_yield();
+
+    // first bulk chunk starts one turnaround after barrier is released
+    master_shared_submit(&shared, &bulk);
+    atomic_store(&gate, 2);
+    EXPECT_EQ(MASTER_SHARED_ok, master_shared_wait(&shared, &first));
+    // submitted during first chunk or silent interval after it
+    usleep((useconds_t)(shared.turnaround_us * 3 / 2));
+    master_shared_submit(&shared, &urgent);
+
+    EXPECT_EQ(MASTER_SHARED_ok, master_shared_wait(&shared, &urgent));
+    EXPECT_EQ(MASTER_SHARED_ok, master_shared_wait(&shared, &bulk));
+    master_shared_deinit(&shared);
+
+    // urgent write is done between bulk frames
+    EXPECT_LT(bulk.timing.begin_ns, urgent.timing.begin_ns);
+    EXPECT_LT(urgent.timing.complete_ns, bulk.timing.complete_ns);
+    EXPECT_EQ(sizeof(bulk_data), bulk.done);
+    EXPECT_EQ((uint32_t)5, shared.stats.transactions);
+    EXPECT_EQ(
+        (uint32_t)1, shared.stats.classes[MASTER_SHARED_CLASS_bulk].preempted);
+
+    for (size_t i = 0; i < sizeof(bulk_data); ++i)
+        EXPECT_EQ((uint8_t)i, bulk_data[i]);
+}
+
+static speed_t parse_speed(const char *str)
+{
+    const int bps = str ? atoi(str) : 0;
+
+    // non-standard rates are configured with termios2 (BOTHER)
+    if (0 < bps) return tty_speed(bps);
     logW("unsupported rate %s, fallback to 19200", str ? str : "NULL");
     return B19200;
 }
@@ -4,14 +4,18 @@
 #include <string.h>
 
 #include <pthread.h>
+#include <sys/uio.h>
 #include <termios.h>
 
 #include "utest.h"
 
 #include "buf.h"
 #include "log.h"
+#include "termios2.h"
+#include "time_util.h"
 #include "tty.h"
 #include "tty_pair.h"
+#include "tty_uring.h"
 #include "util.h"
 
 #define DEBUG_SIZE 1024
@@ -83,6 +87,191 @@ UTEST(tty_dev, write_then_read)
     deinit(&master, &slave);
 }
 
+UTEST(tty_dev, writev_then_readv)
+{
+    tty_dev_t master, slave;
+
+    init(&master, &slave);
+    config(&master, &slave, B57600, PARITY_none);
+
+    char header[]  = "header:";
+    char payload[] = "payload in caller memory";
+    char trailer[] = "!";
+    const struct iovec tx[]
+        = {{.iov_base = header, .iov_len = strlen(header)},
+           {.iov_base = payload, .iov_len = strlen(payload)},
+           {.iov_base = trailer, .iov_len = strlen(trailer)}};
+    const size_t size = strlen(header) + strlen(payload) + strlen(trailer);
+    const int64_t deadline_ns = timestamp_ns() + INT64_C(100000000);
+
+    EXPECT_EQ(
+        size, tty_writev_until(&master, tx, length_of(tx), deadline_ns, NULL));
+
+    // segments split differently than sent
+    char rx_header[3];
+    char rx_payload[sizeof(payload)];
+    const struct iovec rx[]
+        = {{.iov_base = rx_header, .iov_len = sizeof(rx_header)},
+           {.iov_base = rx_payload, .iov_len = size - sizeof(rx_header)}};
+
+    EXPECT_EQ(
+        size, tty_readv_until(&slave, rx, length_of(rx), deadline_ns, NULL));
+    EXPECT_EQ(0, memcmp("hea", rx_header, sizeof(rx_header)));
+    EXPECT_EQ(0, memcmp("der:payload", rx_payload, 11));
+    EXPECT_EQ('!', rx_payload[size - sizeof(rx_header) - 1]);
+
+    // nothing more to read: deadline
+    EXPECT_EQ(
+        (size_t)0,
+        tty_readv_until(
+            &slave, rx, length_of(rx), timestamp_ns() + INT64_C(10000000),
+            NULL));
+
+    deinit(&master, &slave);
+}
+
+UTEST(tty_dev, high_and_arbitrary_rates)
+{
+    tty_dev_t master, slave;
+
+    init(&master, &slave);
+
+    EXPECT_EQ((speed_t)B1000000, tty_speed(1000000));
+    EXPECT_EQ(1000000, tty_bps(B1000000));
+    EXPECT_EQ(4000000, tty_bps(tty_speed(4000000)));
+
+    const speed_t rates[] = {B921600, B4000000, tty_speed(250000)};
+
+    for (const speed_t *rate = rates; rate != rates + length_of(rates); ++rate)
+    {
+        tty_configure(&slave, *rate, PARITY_none, DATA_BITS_8, STOP_BITS_2);
+        EXPECT_EQ(tty_bps(*rate), termios2_get_bps(slave.fd));
+    }
+
+    // arbitrary rate survives reconfiguration of VMIN/VTIME
+    tty_configure_read(&slave, 1, 1);
+    EXPECT_EQ(250000, termios2_get_bps(slave.fd));
+    EXPECT_STREQ("250000", tty_rate_str(tty_speed(250000)));
+    EXPECT_STREQ("921600", tty_rate_str(B921600));
+
+    deinit(&master, &slave);
+}
+
+UTEST(tty_dev, char_bits)
+{
+    struct termios config;
+
+    memset(&config, 0, sizeof(config));
+    tty_configure_term(&config, B9600, PARITY_none, DATA_BITS_8, STOP_BITS_1);
+    EXPECT_EQ(10, tty_char_bits(&config));
+    tty_configure_term(&config, B9600, PARITY_even, DATA_BITS_8, STOP_BITS_1);
+    EXPECT_EQ(11, tty_char_bits(&config));
+    tty_configure_term(&config, B9600, PARITY_none, DATA_BITS_8, STOP_BITS_2);
+    EXPECT_EQ(11, tty_char_bits(&config));
+    tty_configure_term(&config, B9600, PARITY_odd, DATA_BITS_7, STOP_BITS_2);
+    EXPECT_EQ(11, tty_char_bits(&config));
+}
+
+UTEST(tty_dev, parmrk_decode)
+{
+    // a, \377 (escaped), b, parity error on X, c, break, \377 (split)
+    const uint8_t in[]
+        = {'a', 0377, 0377, 'b', 0377, 0, 'X', 'c', 0377, 0, 0, 0377};
+    const tty_parmrk_result_t expected[]
+        = {TTY_PARMRK_data,    TTY_PARMRK_pending, TTY_PARMRK_data,
+           TTY_PARMRK_data,    TTY_PARMRK_pending, TTY_PARMRK_pending,
+           TTY_PARMRK_error,   TTY_PARMRK_data,    TTY_PARMRK_pending,
+           TTY_PARMRK_pending, TTY_PARMRK_error,   TTY_PARMRK_pending};
+    const uint8_t out[] = {'a', 0, 0377, 'b', 0, 0, 'X', 'c', 0, 0, 0, 0};
+    tty_parmrk_t parmrk = {.escape = 0};
+
+    for (size_t i = 0; i < length_of(in); ++i)
+    {
+        uint8_t data = 0;
+
+        EXPECT_EQ(expected[i], tty_parmrk_decode(&parmrk, in[i], &data));
+        EXPECT_EQ(out[i], data);
+    }
+
+    // sequence continues in next read()
+    uint8_t data = 0;
+
+    EXPECT_EQ(TTY_PARMRK_data, tty_parmrk_decode(&parmrk, 0377, &data));
+    EXPECT_EQ(0377, data);
+}
+
+UTEST(tty_dev, read_until_deadline)
+{
+    tty_dev_t master, slave;
+
+    init(&master, &slave);
+    config(&master, &slave, B57600, PARITY_none);
+
+    const int64_t timeout_ns  = 20 * INT64_C(1000000);
+    const int64_t start_ns    = timestamp_ns();
+    const int64_t deadline_ns = start_ns + timeout_ns;
+    char buf[16];
+    char *const end = buf + sizeof(buf);
+
+    // nothing was written, must return exactly at deadline
+    EXPECT_TRUE(buf == tty_read_until(&slave, buf, end, deadline_ns, NULL));
+
+    const int64_t elapsed_ns = timestamp_ns() - start_ns;
+
+    EXPECT_TRUE(timeout_ns <= elapsed_ns);
+    // missed deadline only, loaded runner can wake up late
+    EXPECT_TRUE(timeout_ns + 500 * INT64_C(1000000) > elapsed_ns);
+
+    deinit(&master, &slave);
+}
+
+static void *async_write_halves(void *user_data)
+{
+    tty_dev_t *dev         = user_data;
+    const char frame[]     = "0123456789";
+    const char *const half = frame + sizeof(frame) / 2;
+    const char *const end  = frame + sizeof(frame);
+
+    CHECK(half == tty_write(dev, frame, half, 100, NULL));
+    usleep(5000);
+    CHECK(end == tty_write(dev, half, end, 100, NULL));
+    return NULL;
+}
+
+UTEST(tty_dev, framing_read)
+{
+    tty_dev_t master, slave;
+
+    init(&master, &slave);
+    config(&master, &slave, B57600, PARITY_none);
+    tty_framing_on(&slave, 1);
+
+    char buf[16];
+    pthread_t writer;
+
+    /* frame written in 2 chunks (gap < VTIME) is returned by single read
+     * (deadline -1: return after first read) */
+    CHECK_ERRNO(
+        0 == pthread_create(&writer, NULL, async_write_halves, &master));
+
+    char *curr = tty_read_until(&slave, buf, buf + 11, -1, NULL);
+
+    CHECK_ERRNO(0 == pthread_join(writer, NULL));
+    EXPECT_TRUE(buf + 11 == curr);
+    EXPECT_TRUE(0 == memcmp(buf, "0123456789", 11));
+
+    // frame shorter than requested is returned after inter-byte timeout
+    const int64_t start_ns = timestamp_ns();
+
+    EXPECT_TRUE(tty_write(&master, "abc", "abc" + 3, 100, NULL));
+    curr = tty_read_until(&slave, buf, buf + 8, -1, NULL);
+    EXPECT_TRUE(buf + 3 == curr);
+    EXPECT_TRUE(50 * INT64_C(1000000) < timestamp_ns() - start_ns);
+
+    tty_framing_off(&slave);
+    deinit(&master, &slave);
+}
+
 typedef struct async_data
 {
     tty_dev_t *dev;
@@ -211,6 +400,110 @@ UTEST(tty_dev, async_echo)
     deinit(&master, &slave);
 }
 
+UTEST(tty_dev, uring_write_then_read)
+{
+    tty_uring_t uring;
+
+    // io_uring may be disabled (kernel config, seccomp), nothing to test
+    if (tty_uring_init(&uring, 8, 64, 4)) return;
+
+    tty_dev_t master, slave;
+
+    init(&master, &slave);
+    config(&master, &slave, B57600, PARITY_none);
+    // VMIN = 0 would complete reads with 0 bytes instead of waiting for data
+    tty_configure_read(&slave, 1, 0);
+
+    const char message[]     = "hello on other side via io_uring!";
+    const char *const begin  = message;
+    const char *const end    = begin + length_of(message);
+    const size_t size        = end - begin;
+    const uint64_t master_id = 1;
+    const uint64_t slave_id  = 2;
+
+    tty_uring_read(&uring, &slave, slave_id);
+    tty_uring_write(&uring, &master, begin, end, 100000, master_id);
+
+    char buf[255];
+    char *curr  = buf;
+    int written = 0;
+
+    for (int i = 0; i < 100 && (!written || size != (size_t)(curr - buf)); ++i)
+    {
+        tty_uring_event_t events[4];
+
+        tty_uring_submit(&uring, 1, 100000);
+
+        const size_t num
+            = tty_uring_reap(&uring, events, events + length_of(events));
+
+        for (tty_uring_event_t *event = events; event != events + num;
+             ++event)
+        {
+            if (master_id == event->user_data)
+            {
+                EXPECT_EQ(TTY_URING_OP_WRITE, event->op);
+                EXPECT_EQ((int)size, event->result);
+                written = 1;
+                continue;
+            }
+
+            ASSERT_EQ(slave_id, event->user_data);
+            ASSERT_EQ(TTY_URING_OP_READ, event->op);
+            ASSERT_TRUE(0 < event->result);
+            ASSERT_TRUE(buf + sizeof(buf) >= curr + event->result);
+            memcpy(curr, event->data, event->result);
+            curr += event->result;
+            tty_uring_release(&uring, event);
+            if (!event->more) tty_uring_read(&uring, &slave, slave_id);
+        }
+    }
+
+    EXPECT_TRUE(written);
+    EXPECT_TRUE((size_t)(curr - buf) == size);
+    EXPECT_TRUE(0 == memcmp(message, buf, size));
+
+    deinit(&master, &slave);
+    tty_uring_deinit(&uring);
+}
+
+UTEST(tty_dev, uring_cq_overflow)
+{
+    tty_uring_t uring;
+
+    // single SQ entry, CQ holds 2 completions
+    if (tty_uring_init(&uring, 1, 64, 4)) return;
+
+    tty_dev_t master, slave;
+
+    init(&master, &slave);
+    config(&master, &slave, B57600, PARITY_none);
+
+    const char message[] = "x";
+    const int writes     = 8;
+
+    // every write pushes previous one to the kernel
+    for (int i = 0; i < writes; ++i)
+        tty_uring_write(
+            &uring, &master, message, message + 1, -1, (uint64_t)i);
+    tty_uring_submit(&uring, 0, 0);
+
+    tty_uring_event_t events[16];
+    // pty writes complete inline, held back completions are not lost
+    const size_t num
+        = tty_uring_reap(&uring, events, events + length_of(events));
+
+    ASSERT_EQ((size_t)writes, num);
+    for (size_t i = 0; i < num; ++i)
+    {
+        EXPECT_EQ((uint64_t)i, events[i].user_data);
+        EXPECT_EQ(1, events[i].result);
+    }
+
+    deinit(&master, &slave);
+    tty_uring_deinit(&uring);
+}
+
 atomic_int usr1_cntr = 0;
 
 static void handle_USR1(int sig_no)
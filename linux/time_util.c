@@ -1,10 +1,12 @@
 #include "time_util.h"
 
+#include <errno.h>
+
 int64_t timestamp_ns(void)
 {
     struct timespec ts;
 
-    (void)clock_gettime(CLOCK_REALTIME, &ts);
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
     return (int64_t)ts.tv_sec * INT64_C(1000000000) + (int64_t)ts.tv_nsec;
 }
 
@@ -18,3 +20,19 @@ int64_t timespec_to_ms(struct timespec value)
 {
     return timespec_to_us(value) / INT64_C(1000);
 }
+
+struct timespec ns_to_timespec(int64_t value)
+{
+    if (0 > value) value = 0;
+    return (struct timespec){.tv_sec  = value / INT64_C(1000000000),
+                             .tv_nsec = value % INT64_C(1000000000)};
+}
+
+void sleep_until_ns(int64_t deadline_ns)
+{
+    const struct timespec deadline = ns_to_timespec(deadline_ns);
+
+    while (EINTR
+           == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL))
+        ;
+}
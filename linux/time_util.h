@@ -3,8 +3,13 @@
 #include <stdint.h>
 #include <time.h>
 
+// CLOCK_MONOTONIC, suitable for intervals and absolute deadlines
 int64_t timestamp_ns(void);
 #define timestamp_us() (timestamp_ns() / INT64_C(1000))
 #define timestamp_ms() (timestamp_ns() / INT64_C(1000000))
 int64_t timespec_to_us(struct timespec);
 int64_t timespec_to_ms(struct timespec);
+// negative values are clamped to 0
+struct timespec ns_to_timespec(int64_t);
+// sleep until absolute timestamp_ns() deadline (EINTR is resumed)
+void sleep_until_ns(int64_t deadline_ns);
@@ -8,10 +8,13 @@
 #include <linux/serial.h>
 #include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "check.h"
+#include "gnu.h"
 #include "log.h"
+#include "termios2.h"
 #include "time_util.h"
 #include "tty.h"
 #include "util.h"
@@ -190,21 +193,128 @@ void tty_configure(
     memset(&dev->config, 0, sizeof(dev->config));
     tty_configure_term(&dev->config, rate, parity, data_bits, stop_bits);
     tty_set_term_config(dev->fd, &dev->config);
+
+    if (TTY_SPEED_BOTHER & rate)
+    {
+        /* BOTHER is kept in c_cflag, subsequent tcsetattr() calls preserve
+         * c_ispeed/c_ospeed */
+        termios2_set_bps(dev->fd, tty_bps(rate));
+        tty_get_term_config(dev->fd, &dev->config);
+    }
     logT("%d %dbps %s", dev->fd, tty_bps(rate), tty_parity_str(parity));
 }
 
+void tty_configure_read(tty_dev_t *dev, uint8_t vmin, uint8_t vtime)
+{
+    CHECK(dev);
+    dev->config.c_cc[VMIN]  = vmin;
+    dev->config.c_cc[VTIME] = vtime;
+    tty_set_term_config(dev->fd, &dev->config);
+    logT("%d VMIN %u VTIME %u", dev->fd, vmin, vtime);
+}
+
+void tty_parmrk_on(tty_dev_t *dev)
+{
+    CHECK(dev);
+    dev->config.c_iflag |= PARMRK;
+    dev->config.c_iflag &= ~(IGNPAR | ISTRIP);
+    tty_set_term_config(dev->fd, &dev->config);
+    logT("%d", dev->fd);
+}
+
+tty_parmrk_result_t
+tty_parmrk_decode(tty_parmrk_t *parmrk, uint8_t in, uint8_t *out)
+{
+    CHECK(parmrk);
+    CHECK(out);
+
+    switch (parmrk->escape)
+    {
+    case 0:
+        if (UINT8_C(0377) == in)
+        {
+            parmrk->escape = 1;
+            return TTY_PARMRK_pending;
+        }
+        *out = in;
+        return TTY_PARMRK_data;
+    case 1:
+        parmrk->escape = 0;
+        *out           = in;
+        if (UINT8_C(0377) == in) return TTY_PARMRK_data;
+        if (UINT8_C(0) != in) return TTY_PARMRK_error; // invalid sequence
+        parmrk->escape = 2;
+        return TTY_PARMRK_pending;
+    default:
+        parmrk->escape = 0;
+        *out           = in;
+        return TTY_PARMRK_error;
+    }
+}
+
+void tty_framing_on(tty_dev_t *dev, uint8_t vtime)
+{
+    CHECK(dev);
+    CHECK(-1 != dev->fd);
+    CHECK(vtime);
+
+    const int flags = fcntl(dev->fd, F_GETFL);
+
+    CHECK_ERRNO(-1 != flags);
+    CHECK_ERRNO(-1 != fcntl(dev->fd, F_SETFL, flags & ~O_NONBLOCK));
+    tty_configure_read(dev, 1, vtime);
+    dev->framing_vtime = vtime;
+}
+
+void tty_framing_off(tty_dev_t *dev)
+{
+    CHECK(dev);
+    CHECK(-1 != dev->fd);
+
+    const int flags = fcntl(dev->fd, F_GETFL);
+
+    CHECK_ERRNO(-1 != flags);
+    CHECK_ERRNO(-1 != fcntl(dev->fd, F_SETFL, flags | O_NONBLOCK));
+    tty_configure_read(dev, 0, 0);
+    dev->framing_vtime = 0;
+}
+
+// framing: read() returns after size bytes (or inter-byte timeout)
+static void framing_vmin(tty_dev_t *dev, size_t size)
+{
+    const uint8_t vmin = (uint8_t)min(size, UINT8_MAX);
+
+    if (vmin == dev->config.c_cc[VMIN]) return;
+    tty_configure_read(dev, vmin, dev->framing_vtime);
+}
+
 void validate_syscall_result(int r)
 {
     CHECK_ERRNO(-1 != r || -1 == r && EINTR == errno);
     if (-1 == r) logT("%s", strerror(errno));
 }
 
+static int64_t to_deadline_ns(int timeout)
+{
+    return 0 > timeout ? -1 : timestamp_ns() + (int64_t)timeout * 1000000;
+}
+
 char *tty_read(
     tty_dev_t *dev,
     char *const begin,
     const char *const end,
     const int timeout,
     struct pollfd *aux)
+{
+    return tty_read_until(dev, begin, end, to_deadline_ns(timeout), aux);
+}
+
+char *tty_read_until(
+    tty_dev_t *dev,
+    char *const begin,
+    const char *const end,
+    const int64_t deadline_ns,
+    struct pollfd *aux)
 {
     CHECK(dev);
     CHECK(begin);
@@ -215,28 +325,31 @@ char *tty_read(
         = {{dev->fd, (short)POLLIN, (short)0},
            {aux ? aux->fd : -1, aux ? aux->events : (short)0, (short)0}};
 
-    const int64_t start_ts = timestamp_us();
-    int64_t elapsed        = 0;
-    int elapsed_ms         = 0;
+    const int64_t start_ns = timestamp_ns();
     char *curr             = begin;
 
-    while (curr != end && (0 > timeout || timeout >= elapsed_ms))
+    // at least single attempt, even if deadline already expired
+    for (int attempt = 0; curr != end
+         && (!attempt || 0 > deadline_ns || deadline_ns > timestamp_ns());
+         ++attempt)
     {
-        int r = poll(events, length_of(events), timeout - elapsed_ms);
+        const struct timespec timeout
+            = ns_to_timespec(deadline_ns - timestamp_ns());
+        int r = gnu_ppoll(
+            events, length_of(events), 0 > deadline_ns ? NULL : &timeout);
 
         validate_syscall_result(r);
-        elapsed    = timestamp_us() - start_ts;
-        elapsed_ms = elapsed / 1000;
 
-        if (0 == r) continue; // poll timeout
+        if (0 >= r) continue; // timeout or interrupted
 
         if (events[0].revents & POLLIN)
         {
+            if (dev->framing_vtime) framing_vmin(dev, (size_t)(end - curr));
             r = read(dev->fd, curr, end - curr);
             validate_syscall_result(r);
             CHECK(0 != r);
-            curr += r;
-            if (0 > timeout) break;
+            if (0 < r) curr += r;
+            if (0 > deadline_ns) break;
         }
 
         if (events[1].events & events[1].revents)
@@ -246,8 +359,11 @@ char *tty_read(
         }
     }
 
+    const int64_t timeout_us
+        = 0 > deadline_ns ? -1 : (deadline_ns - start_ns) / 1000;
+
     debug(
-        dev, __FUNCTION__, (int64_t)timeout * 1000, timestamp_us() - start_ts,
+        dev, __FUNCTION__, timeout_us, (timestamp_ns() - start_ns) / 1000,
         begin, end, curr);
     return curr;
 }
@@ -262,6 +378,7 @@ char *tty_read_ll(
     CHECK(begin);
     CHECK(end);
     CHECK(-1 != dev->fd);
+    CHECK(!dev->framing_vtime);
     const int64_t start_us = timestamp_us();
     int64_t elapsed_us     = 0;
     char *curr             = begin;
@@ -298,6 +415,16 @@ const char *tty_write(
     const char *const end,
     const int timeout,
     struct pollfd *aux)
+{
+    return tty_write_until(dev, begin, end, to_deadline_ns(timeout), aux);
+}
+
+const char *tty_write_until(
+    tty_dev_t *dev,
+    const char *begin,
+    const char *const end,
+    const int64_t deadline_ns,
+    struct pollfd *aux)
 {
     CHECK(dev);
     CHECK(begin);
@@ -308,27 +435,29 @@ const char *tty_write(
         = {{dev->fd, (short)POLLOUT, (short)0},
            {aux ? aux->fd : -1, aux ? aux->events : (short)0, (short)0}};
 
-    const int64_t start_ts = timestamp_us();
-    int64_t elapsed        = 0;
-    int elapsed_ms         = 0;
+    const int64_t start_ns = timestamp_ns();
     const char *curr       = begin;
 
-    while (curr != end && (0 > timeout || timeout >= elapsed_ms))
+    // at least single attempt, even if deadline already expired
+    for (int attempt = 0; curr != end
+         && (!attempt || 0 > deadline_ns || deadline_ns > timestamp_ns());
+         ++attempt)
     {
-        int r = poll(events, length_of(events), timeout - elapsed_ms);
+        const struct timespec timeout
+            = ns_to_timespec(deadline_ns - timestamp_ns());
+        int r = gnu_ppoll(
+            events, length_of(events), 0 > deadline_ns ? NULL : &timeout);
 
         validate_syscall_result(r);
-        elapsed    = timestamp_us() - start_ts;
-        elapsed_ms = elapsed / 1000;
 
-        if (0 == r) continue; // poll timeout
+        if (0 >= r) continue; // timeout or interrupted
 
         if (events[0].revents & POLLOUT)
         {
             r = write(dev->fd, curr, end - curr);
             validate_syscall_result(r);
             CHECK(0 != r);
-            curr += r;
+            if (0 < r) curr += r;
         }
 
         if (events[1].events & events[1].revents)
@@ -338,12 +467,138 @@ const char *tty_write(
         }
     }
 
+    const int64_t timeout_us
+        = 0 > deadline_ns ? -1 : (deadline_ns - start_ns) / 1000;
+
     debug(
-        dev, __FUNCTION__, (int64_t)timeout * 1000, timestamp_us() - start_ts,
+        dev, __FUNCTION__, timeout_us, (timestamp_ns() - start_ns) / 1000,
         begin, end, curr);
     return curr;
 }
 
+size_t tty_iov_size(const struct iovec *iov, int iovcnt)
+{
+    size_t size = 0;
+
+    for (int i = 0; i < iovcnt; ++i) size += iov[i].iov_len;
+    return size;
+}
+
+// return: index of first segment not transferred completely
+static int iov_advance(struct iovec *iov, int first, int iovcnt, size_t n)
+{
+    for (; first < iovcnt && n >= iov[first].iov_len; ++first)
+        n -= iov[first].iov_len;
+    if (first < iovcnt)
+    {
+        iov[first].iov_base = (char *)iov[first].iov_base + n;
+        iov[first].iov_len -= n;
+    }
+    return first;
+}
+
+static size_t transfer_v(
+    tty_dev_t *dev,
+    const char *tag,
+    const struct iovec *iov,
+    const int iovcnt,
+    const int64_t deadline_ns,
+    struct pollfd *aux,
+    const int write_dir)
+{
+    CHECK(dev);
+    CHECK(iov);
+    CHECK(0 < iovcnt && TTY_IOV_MAX >= iovcnt);
+    CHECK(-1 != dev->fd);
+
+    struct pollfd events[]
+        = {{dev->fd, (short)(write_dir ? POLLOUT : POLLIN), (short)0},
+           {aux ? aux->fd : -1, aux ? aux->events : (short)0, (short)0}};
+    struct iovec curr[TTY_IOV_MAX];
+
+    memcpy(curr, iov, sizeof(struct iovec) * (size_t)iovcnt);
+
+    const int64_t start_ns = timestamp_ns();
+    const size_t size      = tty_iov_size(iov, iovcnt);
+    size_t done            = 0;
+    int first              = iov_advance(curr, 0, iovcnt, 0);
+
+    // at least single attempt, even if deadline already expired
+    for (int attempt = 0; done != size
+         && (!attempt || 0 > deadline_ns || deadline_ns > timestamp_ns());
+         ++attempt)
+    {
+        const struct timespec timeout
+            = ns_to_timespec(deadline_ns - timestamp_ns());
+        int r = gnu_ppoll(
+            events, length_of(events), 0 > deadline_ns ? NULL : &timeout);
+
+        validate_syscall_result(r);
+
+        if (0 >= r) continue; // timeout or interrupted
+
+        if (events[0].revents & events[0].events)
+        {
+            if (!write_dir && dev->framing_vtime)
+                framing_vmin(dev, size - done);
+            r = (int)(write_dir
+                          ? writev(dev->fd, curr + first, iovcnt - first)
+                          : readv(dev->fd, curr + first, iovcnt - first));
+            validate_syscall_result(r);
+            CHECK(0 != r);
+            if (0 < r)
+            {
+                done += (size_t)r;
+                first = iov_advance(curr, first, iovcnt, (size_t)r);
+            }
+            if (!write_dir && 0 > deadline_ns) break;
+        }
+
+        if (events[1].events & events[1].revents)
+        {
+            if (aux) aux->revents = events[1].revents;
+            break;
+        }
+    }
+
+    const int64_t timeout_us
+        = 0 > deadline_ns ? -1 : (deadline_ns - start_ns) / 1000;
+    const int64_t duration_us = (timestamp_ns() - start_ns) / 1000;
+    size_t logged             = done;
+
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        const char *const base = iov[i].iov_base;
+        const size_t n         = min(logged, iov[i].iov_len);
+
+        debug(
+            dev, tag, timeout_us, duration_us, base, base + iov[i].iov_len,
+            base + n);
+        logged -= n;
+    }
+    return done;
+}
+
+size_t tty_readv_until(
+    tty_dev_t *dev,
+    const struct iovec *iov,
+    int iovcnt,
+    int64_t deadline_ns,
+    struct pollfd *aux)
+{
+    return transfer_v(dev, __FUNCTION__, iov, iovcnt, deadline_ns, aux, 0);
+}
+
+size_t tty_writev_until(
+    tty_dev_t *dev,
+    const struct iovec *iov,
+    int iovcnt,
+    int64_t deadline_ns,
+    struct pollfd *aux)
+{
+    return transfer_v(dev, __FUNCTION__, iov, iovcnt, deadline_ns, aux, 1);
+}
+
 void tty_flush_rx(int fd)
 {
     if (-1 == fd) return;
@@ -372,6 +627,19 @@ void tty_drain(int fd)
     logT("%d", fd);
 }
 
+int tty_tx_pending(int fd)
+{
+    CHECK(-1 != fd);
+
+    int outq         = 0;
+    unsigned int lsr = 0;
+
+    CHECK_ERRNO(-1 != ioctl(fd, TIOCOUTQ, &outq));
+    // not supported by all drivers (pty, some USB adapters)
+    if (-1 != ioctl(fd, TIOCSERGETLSR, &lsr) && !(lsr & TIOCSER_TEMT)) ++outq;
+    return outq;
+}
+
 void tty_exclusive_on(int fd)
 {
     if (-1 == fd) return;
@@ -426,6 +694,8 @@ void tty_configure_term(
 
     // rate
     {
+        // arbitrary rate is set by tty_configure() (termios2)
+        if (TTY_SPEED_BOTHER & speed) speed = B38400;
         cfsetispeed(config, speed);
         cfsetospeed(config, speed);
     }
@@ -491,8 +761,58 @@ void tty_configure_term(
     }
 }
 
+speed_t tty_speed(int bps)
+{
+    CHECK(0 < bps);
+
+    switch (bps)
+    {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 576000: return B576000;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 1152000: return B1152000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    case 2500000: return B2500000;
+    case 3000000: return B3000000;
+    case 3500000: return B3500000;
+    case 4000000: return B4000000;
+    default: return TTY_SPEED_BOTHER | (speed_t)bps;
+    }
+}
+
+int tty_char_bits(const struct termios *config)
+{
+    CHECK(config);
+
+    int data_bits = 8;
+
+    switch (config->c_cflag & CSIZE)
+    {
+    case CS5: data_bits = 5; break;
+    case CS6: data_bits = 6; break;
+    case CS7: data_bits = 7; break;
+    }
+
+    return 1 + data_bits + (config->c_cflag & PARENB ? 1 : 0)
+        + (config->c_cflag & CSTOPB ? 2 : 1);
+}
+
 int tty_bps(speed_t rate)
 {
+    if (TTY_SPEED_BOTHER & rate) return (int)(rate & ~TTY_SPEED_BOTHER);
+
     switch (rate)
     {
     case B1200: return 1200;
@@ -503,12 +823,33 @@ int tty_bps(speed_t rate)
     case B38400: return 38400;
     case B57600: return 57600;
     case B115200: return 115200;
+    case B230400: return 230400;
+    case B460800: return 460800;
+    case B500000: return 500000;
+    case B576000: return 576000;
+    case B921600: return 921600;
+    case B1000000: return 1000000;
+    case B1152000: return 1152000;
+    case B1500000: return 1500000;
+    case B2000000: return 2000000;
+    case B2500000: return 2500000;
+    case B3000000: return 3000000;
+    case B3500000: return 3500000;
+    case B4000000: return 4000000;
     default: CHECK(0 && "unsupported rate"); return -1;
     }
 }
 
 const char *tty_rate_str(speed_t rate)
 {
+    static _Thread_local char str[sizeof("-2147483648")];
+
+    if (TTY_SPEED_BOTHER & rate)
+    {
+        snprintf(str, sizeof(str), "%d", tty_bps(rate));
+        return str;
+    }
+
     switch (rate)
     {
     case B1200: return "1200";
@@ -519,6 +860,19 @@ const char *tty_rate_str(speed_t rate)
     case B38400: return "38400";
     case B57600: return "57600";
     case B115200: return "115200";
+    case B230400: return "230400";
+    case B460800: return "460800";
+    case B500000: return "500000";
+    case B576000: return "576000";
+    case B921600: return "921600";
+    case B1000000: return "1000000";
+    case B1152000: return "1152000";
+    case B1500000: return "1500000";
+    case B2000000: return "2000000";
+    case B2500000: return "2500000";
+    case B3000000: return "3000000";
+    case B3500000: return "3500000";
+    case B4000000: return "4000000";
     default: return "unsupported_rate";
     }
 }
@@ -5,6 +5,7 @@
 
 #include <termios.h>
 
+struct iovec;
 struct pollfd;
 
 /* speed_t
@@ -16,7 +17,25 @@ struct pollfd;
  * B19200,
  * B38400,
  * B57600,
- * B115200 */
+ * B115200,
+ * B230400,
+ * B460800,
+ * B500000,
+ * B576000,
+ * B921600,
+ * B1000000,
+ * B1152000,
+ * B1500000,
+ * B2000000,
+ * B2500000,
+ * B3000000,
+ * B3500000,
+ * B4000000
+ *
+ * any other rate: TTY_SPEED_BOTHER | bps (see tty_speed()), configured with
+ * termios2 (BOTHER) */
+
+#define TTY_SPEED_BOTHER UINT32_C(0x40000000)
 
 typedef enum
 {
@@ -44,6 +63,8 @@ typedef struct tty_dev
     int fd;
     char *path;
     struct termios config;
+    // kernel framing (see tty_framing_on()), VTIME [0.1s], 0: off
+    uint8_t framing_vtime;
     struct
     {
         char *begin;
@@ -59,8 +80,53 @@ void tty_open(tty_dev_t *, const char *path, int *user_flags);
 void tty_adopt(tty_dev_t *, int fd);
 void tty_close(tty_dev_t *);
 void tty_configure(tty_dev_t *, speed_t, parity_t, data_bits_t, stop_bits_t);
+/* VMIN/VTIME (default 0/0: read returns immediately)
+ * NOTE: tty_read_ll() requires VMIN == 0 */
+void tty_configure_read(tty_dev_t *, uint8_t vmin, uint8_t vtime);
+/* PARMRK: bytes received with parity/framing error are marked by line
+ * discipline as \377 \0 X (break as \377 \0 \0), \377 data byte is
+ * escaped as \377 \377, use tty_parmrk_decode() to decode read bytes
+ * NOTE: call after tty_configure() */
+void tty_parmrk_on(tty_dev_t *);
+
+typedef struct
+{
+    // 0: none, 1: \377 received, 2: \377 \0 received
+    uint8_t escape;
+} tty_parmrk_t;
+
+typedef enum
+{
+    // byte is part of escape sequence
+    TTY_PARMRK_pending = 0,
+    TTY_PARMRK_data    = 1,
+    // byte received with parity/framing error (or break)
+    TTY_PARMRK_error = 2
+} tty_parmrk_result_t;
+
+// stateful, escape sequences can be split between read() calls
+tty_parmrk_result_t
+tty_parmrk_decode(tty_parmrk_t *, uint8_t in, uint8_t *out);
+
+/* kernel framing: fd is switched to blocking mode and VMIN is set before
+ * every read() to number of bytes requested, so frame is returned by single
+ * read() unless gap between bytes exceeds vtime [0.1s] (line discipline
+ * inter-byte timer). Deadlines of tty_read*() are checked before read(),
+ * read() itself can extend them by vtime.
+ * NOTE: call after tty_configure(), tty_read_ll() is not supported */
+void tty_framing_on(tty_dev_t *, uint8_t vtime);
+void tty_framing_off(tty_dev_t *);
+/* timeout [ms], -1: wait infinitely and return after first chunk received */
 char *tty_read(
     tty_dev_t *, char *begin, const char *end, int timeout, struct pollfd *aux);
+/* deadline_ns: absolute timestamp_ns() value, -1: wait infinitely and return
+ * after first chunk received */
+char *tty_read_until(
+    tty_dev_t *,
+    char *begin,
+    const char *end,
+    int64_t deadline_ns,
+    struct pollfd *aux);
 // low latency
 char *tty_read_ll(tty_dev_t *, char *begin, const char *end, int delay_us);
 const char *tty_write(
@@ -69,6 +135,30 @@ const char *tty_write(
     const char *end,
     int timeout,
     struct pollfd *aux);
+const char *tty_write_until(
+    tty_dev_t *,
+    const char *begin,
+    const char *end,
+    int64_t deadline_ns,
+    struct pollfd *aux);
+/* scatter/gather variants of tty_read_until()/tty_write_until(), segments
+ * are filled/sent in order as if they were one buffer (iov is not modified)
+ * return: number of bytes transferred */
+#define TTY_IOV_MAX 8
+size_t tty_readv_until(
+    tty_dev_t *,
+    const struct iovec *iov,
+    int iovcnt,
+    int64_t deadline_ns,
+    struct pollfd *aux);
+size_t tty_writev_until(
+    tty_dev_t *,
+    const struct iovec *iov,
+    int iovcnt,
+    int64_t deadline_ns,
+    struct pollfd *aux);
+// total length of segments
+size_t tty_iov_size(const struct iovec *iov, int iovcnt);
 /* discards data, received but not read (rx), written but not transmitted (tx)
  */
 void tty_flush_rx(int fd);
@@ -76,6 +166,11 @@ void tty_flush_tx(int fd);
 void tty_flush(int fd);
 // wait until all data written is transmitted
 void tty_drain(int fd);
+/* number of bytes written but not yet transmitted (non-blocking):
+ * TIOCOUTQ + transmitter shift register (TIOCSERGETLSR, if supported) */
+int tty_tx_pending(int fd);
+// abort on syscall failure (-1), EINTR is tolerated
+void validate_syscall_result(int r);
 /* request exclusive mode, open on same fd will result in EBUSY */
 void tty_exclusive_on(int fd);
 void tty_exclusive_off(int fd);
@@ -83,7 +178,12 @@ void tty_get_term_config(int fd, struct termios *);
 void tty_set_term_config(int fd, const struct termios *);
 void tty_configure_term(
     struct termios *, speed_t, parity_t, data_bits_t, stop_bits_t);
+// Bxxx if bps is standard rate, TTY_SPEED_BOTHER | bps otherwise
+speed_t tty_speed(int bps);
 int tty_bps(speed_t);
+// bits per character on the wire: start + data + parity + stop
+int tty_char_bits(const struct termios *);
+// NOTE: arbitrary rates are formatted into thread local buffer
 const char *tty_rate_str(speed_t);
 const char *tty_parity_str(parity_t);
 void tty_logD(tty_dev_t *);
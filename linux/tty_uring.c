@@ -0,0 +1,453 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "log.h"
+#include "tty.h"
+#include "tty_uring.h"
+#include "util.h"
+
+/* not present in older kernel headers (since Linux 6.7) */
+#define OP_READ_MULTISHOT 49
+
+#define USER_DATA_SHIFT 2
+#define USER_DATA_OP    UINT64_C(0x3)
+
+#define load_acquire(ptr)                                                      \
+    atomic_load_explicit((_Atomic uint32_t *)(ptr), memory_order_acquire)
+#define store_release(ptr, value)                                              \
+    atomic_store_explicit(                                                     \
+        (_Atomic uint32_t *)(ptr), (value), memory_order_release)
+
+static int uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(
+    int fd,
+    unsigned to_submit,
+    unsigned min_complete,
+    unsigned flags,
+    const void *arg,
+    size_t arg_size)
+{
+    return (int)syscall(
+        __NR_io_uring_enter, fd, to_submit, min_complete, flags, arg,
+        arg_size);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned num)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, num);
+}
+
+static void *map(int fd, size_t size, off_t offset)
+{
+    void *ptr = mmap(
+        NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        offset);
+    return MAP_FAILED == ptr ? NULL : ptr;
+}
+
+static uint8_t probe_read_op(int fd)
+{
+    const size_t ops_num = 256;
+    const size_t size    = sizeof(struct io_uring_probe)
+        + ops_num * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    uint8_t read_op              = IORING_OP_READ;
+
+    CHECK_ERRNO(probe);
+
+    if (0 == uring_register(fd, IORING_REGISTER_PROBE, probe, ops_num)
+        && OP_READ_MULTISHOT <= probe->last_op
+        && probe->ops[OP_READ_MULTISHOT].flags & IO_URING_OP_SUPPORTED)
+    {
+        read_op = OP_READ_MULTISHOT;
+    }
+    free(probe);
+    return read_op;
+}
+
+static void release_bid(tty_uring_t *uring, uint16_t bid)
+{
+    struct io_uring_buf_ring *ring = uring->pbuf.ring;
+    const uint16_t mask            = uring->pbuf.buf_num - 1;
+    struct io_uring_buf *buf       = &ring->bufs[uring->pbuf.tail & mask];
+
+    buf->addr
+        = (uint64_t)(uintptr_t)(uring->pbuf.mem + bid * uring->pbuf.buf_size);
+    buf->len  = (uint32_t)uring->pbuf.buf_size;
+    buf->bid  = bid;
+    ++uring->pbuf.tail;
+    atomic_store_explicit(
+        (_Atomic uint16_t *)&ring->tail, uring->pbuf.tail,
+        memory_order_release);
+}
+
+static int pbuf_init(tty_uring_t *uring, size_t buf_size, unsigned buf_num)
+{
+    uring->pbuf.ring_size = buf_num * sizeof(struct io_uring_buf);
+    uring->pbuf.ring      = mmap(
+        NULL, uring->pbuf.ring_size, PROT_READ | PROT_WRITE,
+        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    CHECK_ERRNO_RETURN(MAP_FAILED != uring->pbuf.ring, -errno);
+
+    uring->pbuf.buf_size = buf_size;
+    uring->pbuf.buf_num  = (uint16_t)buf_num;
+    uring->pbuf.tail     = 0;
+    CHECK_ERRNO(NULL != (uring->pbuf.mem = malloc(buf_size * buf_num)));
+
+    struct io_uring_buf_reg reg;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)uring->pbuf.ring;
+    reg.ring_entries = buf_num;
+    reg.bgid         = 0;
+
+    CHECK_ERRNO_RETURN(
+        0 == uring_register(uring->fd, IORING_REGISTER_PBUF_RING, &reg, 1),
+        -errno);
+
+    for (unsigned bid = 0; bid < buf_num; ++bid)
+        release_bid(uring, (uint16_t)bid);
+    return 0;
+}
+
+int tty_uring_init(
+    tty_uring_t *uring, unsigned entries, size_t buf_size, unsigned buf_num)
+{
+    CHECK(uring);
+    CHECK(entries);
+    CHECK(buf_size);
+    CHECK(buf_num && buf_num <= UINT16_C(0x8000));
+    CHECK(0 == (buf_num & (buf_num - 1)));
+
+    memset(uring, 0, sizeof(tty_uring_t));
+    uring->fd = -1;
+
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    const int fd = uring_setup(entries, &params);
+
+    CHECK_ERRNO_RETURN(-1 != fd, -errno);
+    uring->fd = fd;
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)
+        || !(params.features & IORING_FEAT_NODROP)
+        || !(params.features & IORING_FEAT_EXT_ARG))
+    {
+        logW("io_uring features %x not supported", params.features);
+        tty_uring_deinit(uring);
+        return -ENOSYS;
+    }
+
+    const size_t sq_size
+        = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    const size_t cq_size
+        = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    // IORING_FEAT_SINGLE_MMAP: SQ and CQ rings share single mapping
+    uring->sq.size      = max(sq_size, cq_size);
+    uring->cq.size      = uring->sq.size;
+    uring->sq.ptr       = map(fd, uring->sq.size, IORING_OFF_SQ_RING);
+    uring->cq.ptr       = uring->sq.ptr;
+    uring->sq.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sq.sqes      = map(fd, uring->sq.sqes_size, IORING_OFF_SQES);
+
+    if (!uring->sq.ptr || !uring->sq.sqes)
+    {
+        const int error = errno;
+        tty_uring_deinit(uring);
+        return -error;
+    }
+
+    char *const sq = uring->sq.ptr;
+    char *const cq = uring->cq.ptr;
+
+    uring->sq.head       = (uint32_t *)(sq + params.sq_off.head);
+    uring->sq.tail       = (uint32_t *)(sq + params.sq_off.tail);
+    uring->sq.array      = (uint32_t *)(sq + params.sq_off.array);
+    uring->sq.mask       = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    uring->sq.entries    = *(uint32_t *)(sq + params.sq_off.ring_entries);
+    uring->sq.local_tail = *uring->sq.tail;
+    uring->sq.flags      = (uint32_t *)(sq + params.sq_off.flags);
+    uring->cq.head       = (uint32_t *)(cq + params.cq_off.head);
+    uring->cq.tail       = (uint32_t *)(cq + params.cq_off.tail);
+    uring->cq.mask       = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    uring->cq.cqes       = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    uring->cq.overflow   = (uint32_t *)(cq + params.cq_off.overflow);
+    uring->cq.dropped    = *uring->cq.overflow;
+
+    // sqe[i] is always published in slot i
+    for (uint32_t i = 0; i < uring->sq.entries; ++i)
+        uring->sq.array[i] = i;
+
+    CHECK_ERRNO(
+        NULL
+        != (uring->sq.timeouts
+            = calloc(uring->sq.entries, sizeof(struct __kernel_timespec))));
+
+    const int r = pbuf_init(uring, buf_size, buf_num);
+
+    if (r)
+    {
+        tty_uring_deinit(uring);
+        return r;
+    }
+
+    uring->read_op = probe_read_op(fd);
+    logT(
+        "%p (%d) entries %u buf %zux%u read_op %u", uring, uring->fd,
+        uring->sq.entries, buf_size, buf_num, uring->read_op);
+    return 0;
+}
+
+void tty_uring_deinit(tty_uring_t *uring)
+{
+    if (!uring) return;
+
+    if (uring->sq.sqes) munmap(uring->sq.sqes, uring->sq.sqes_size);
+    if (uring->sq.ptr) munmap(uring->sq.ptr, uring->sq.size);
+    if (-1 != uring->fd) CHECK_ERRNO(0 == close(uring->fd));
+    if (uring->pbuf.ring && MAP_FAILED != uring->pbuf.ring)
+        munmap(uring->pbuf.ring, uring->pbuf.ring_size);
+    FREE(uring->pbuf.mem);
+    FREE(uring->sq.timeouts);
+    logT("%p (%d)", uring, uring->fd);
+    memset(uring, 0, sizeof(tty_uring_t));
+    uring->fd = -1;
+}
+
+static uint32_t sq_space(tty_uring_t *uring)
+{
+    const uint32_t used = uring->sq.local_tail - load_acquire(uring->sq.head);
+    return uring->sq.entries - used;
+}
+
+static struct io_uring_sqe *
+sqe_get(tty_uring_t *uring, uint64_t user_data, tty_uring_op_t op)
+{
+    const uint32_t idx       = uring->sq.local_tail & uring->sq.mask;
+    struct io_uring_sqe *sqe = &uring->sq.sqes[idx];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->user_data = user_data << USER_DATA_SHIFT | (uint64_t)op;
+    ++uring->sq.local_tail;
+    return sqe;
+}
+
+static void reserve(tty_uring_t *uring, uint32_t num)
+{
+    if (num <= sq_space(uring)) return;
+    // ring full, push pending requests to kernel
+    tty_uring_submit(uring, 0, 0);
+    CHECK(num <= sq_space(uring));
+}
+
+void tty_uring_read(tty_uring_t *uring, tty_dev_t *dev, uint64_t user_data)
+{
+    CHECK(uring);
+    CHECK(dev);
+    CHECK(-1 != dev->fd);
+
+    reserve(uring, 1);
+
+    struct io_uring_sqe *sqe = sqe_get(uring, user_data, TTY_URING_OP_READ);
+
+    sqe->opcode    = uring->read_op;
+    sqe->fd        = dev->fd;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->len = OP_READ_MULTISHOT == uring->read_op ? 0 : uring->pbuf.buf_size;
+}
+
+// addr/len: IORING_OP_WRITE buffer or IORING_OP_WRITEV iovec array
+static void write_sqe(
+    tty_uring_t *uring,
+    tty_dev_t *dev,
+    uint8_t opcode,
+    const void *addr,
+    uint32_t len,
+    int timeout_us,
+    uint64_t user_data)
+{
+    CHECK(uring);
+    CHECK(dev);
+    CHECK(-1 != dev->fd);
+    CHECK(addr);
+
+    // linked requests must be submitted in the same batch
+    reserve(uring, 0 > timeout_us ? 1 : 2);
+
+    struct io_uring_sqe *sqe = sqe_get(uring, user_data, TTY_URING_OP_WRITE);
+
+    sqe->opcode = opcode;
+    sqe->fd     = dev->fd;
+    sqe->addr   = (uint64_t)(uintptr_t)addr;
+    sqe->len    = len;
+
+    if (0 > timeout_us) return;
+
+    sqe->flags |= IOSQE_IO_LINK;
+
+    struct __kernel_timespec *ts
+        = &uring->sq.timeouts[uring->sq.local_tail & uring->sq.mask];
+
+    ts->tv_sec  = timeout_us / 1000000;
+    ts->tv_nsec = (timeout_us % 1000000) * 1000;
+
+    sqe         = sqe_get(uring, user_data, TTY_URING_OP_TIMEOUT);
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->addr   = (uint64_t)(uintptr_t)ts;
+    sqe->len    = 1;
+}
+
+void tty_uring_write(
+    tty_uring_t *uring,
+    tty_dev_t *dev,
+    const char *begin,
+    const char *end,
+    int timeout_us,
+    uint64_t user_data)
+{
+    CHECK(end);
+    write_sqe(
+        uring, dev, IORING_OP_WRITE, begin, (uint32_t)(end - begin),
+        timeout_us, user_data);
+}
+
+void tty_uring_writev(
+    tty_uring_t *uring,
+    tty_dev_t *dev,
+    const struct iovec *iov,
+    int iovcnt,
+    int timeout_us,
+    uint64_t user_data)
+{
+    CHECK(0 < iovcnt);
+    write_sqe(
+        uring, dev, IORING_OP_WRITEV, iov, (uint32_t)iovcnt, timeout_us,
+        user_data);
+}
+
+int tty_uring_submit(tty_uring_t *uring, unsigned min_complete, int timeout_us)
+{
+    CHECK(uring);
+
+    const uint32_t to_submit
+        = uring->sq.local_tail - load_acquire(uring->sq.head);
+
+    store_release(uring->sq.tail, uring->sq.local_tail);
+
+    if (!to_submit && !min_complete) return 0;
+
+    struct __kernel_timespec ts
+        = {.tv_sec  = timeout_us / 1000000,
+           .tv_nsec = (timeout_us % 1000000) * 1000};
+    struct io_uring_getevents_arg arg
+        = {.sigmask    = 0,
+           .sigmask_sz = _NSIG / 8,
+           .pad        = 0,
+           .ts         = 0 > timeout_us ? 0 : (uint64_t)(uintptr_t)&ts};
+    const unsigned flags
+        = min_complete ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+
+    const int r = uring_enter(
+        uring->fd, to_submit, min_complete, flags, min_complete ? &arg : NULL,
+        min_complete ? sizeof(arg) : 0);
+
+    CHECK_ERRNO(-1 != r || ETIME == errno || EINTR == errno);
+    return -1 == r ? 0 : r;
+}
+
+size_t tty_uring_reap(
+    tty_uring_t *uring,
+    tty_uring_event_t *const begin,
+    const tty_uring_event_t *const end)
+{
+    CHECK(uring);
+    CHECK(begin);
+    CHECK(end);
+
+    uint32_t head            = *uring->cq.head;
+    uint32_t tail            = load_acquire(uring->cq.tail);
+    tty_uring_event_t *event = begin;
+
+    for (; event != end; ++head)
+    {
+        if (head == tail)
+        {
+            // CQ was full, kernel posts held back completions on enter
+            if (!(load_acquire(uring->sq.flags) & IORING_SQ_CQ_OVERFLOW))
+                break;
+            store_release(uring->cq.head, head);
+            CHECK_ERRNO(
+                -1 != uring_enter(
+                    uring->fd, 0, 0, IORING_ENTER_GETEVENTS, NULL, 0)
+                || EINTR == errno);
+            tail = load_acquire(uring->cq.tail);
+            if (head == tail) break;
+        }
+        const struct io_uring_cqe *cqe
+            = &uring->cq.cqes[head & uring->cq.mask];
+        const tty_uring_op_t op
+            = (tty_uring_op_t)(cqe->user_data & USER_DATA_OP);
+
+        // link timeouts are reported via result of linked write
+        if (TTY_URING_OP_TIMEOUT == op) continue;
+
+        memset(event, 0, sizeof(tty_uring_event_t));
+        event->user_data = cqe->user_data >> USER_DATA_SHIFT;
+        event->op        = op;
+        event->result    = cqe->res;
+        event->more      = !!(cqe->flags & IORING_CQE_F_MORE);
+
+        if (TTY_URING_OP_READ == op && cqe->flags & IORING_CQE_F_BUFFER)
+        {
+            event->bid  = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            event->data = uring->pbuf.mem + event->bid * uring->pbuf.buf_size;
+        }
+        ++event;
+    }
+
+    store_release(uring->cq.head, head);
+
+    const uint32_t overflow = load_acquire(uring->cq.overflow);
+
+    if (overflow != uring->cq.dropped)
+    {
+        logW(
+            "%d %u completions dropped", uring->fd,
+            overflow - uring->cq.dropped);
+        uring->cq.dropped = overflow;
+    }
+    return (size_t)(event - begin);
+}
+
+void tty_uring_release(tty_uring_t *uring, const tty_uring_event_t *event)
+{
+    CHECK(uring);
+    CHECK(event);
+
+    if (TTY_URING_OP_READ != event->op || !event->data) return;
+    release_bid(uring, event->bid);
+}
+
+int tty_uring_multishot(const tty_uring_t *uring)
+{
+    CHECK(uring);
+    return OP_READ_MULTISHOT == uring->read_op;
+}
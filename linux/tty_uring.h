@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tty.h"
+
+/* io_uring based I/O backend for tty_dev_t (raw syscalls, liburing is not
+ * required). Single ring can serve many tty_dev_t:
+ *     - multishot reads into a ring of registered (provided) buffers
+ *       (READ_MULTISHOT requires Linux >= 6.7)
+ *     - writes linked with timeout (IOSQE_IO_LINK + IORING_OP_LINK_TIMEOUT)
+ *     - completions of all ports are reaped in batches
+ *
+ * Reads require VMIN >= 1 (see tty_configure_read()), with VMIN == 0 tty
+ * completes read with 0 bytes instead of waiting for data.
+ *
+ * Every submission is tagged with user_data (lower 62 bits are preserved)
+ * so completions can be dispatched back to the originating port.
+ *
+ * Completions which do not fit into CQ are held back by kernel
+ * (IORING_FEAT_NODROP) and flushed by tty_uring_reap().
+ *
+ * master_impl uses it as optional transport (rtu_master_uring_t). */
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+struct __kernel_timespec;
+struct iovec;
+
+typedef enum
+{
+    TTY_URING_OP_READ    = 1,
+    TTY_URING_OP_WRITE   = 2,
+    TTY_URING_OP_TIMEOUT = 3
+} tty_uring_op_t;
+
+typedef struct
+{
+    uint64_t user_data;
+    tty_uring_op_t op;
+    // READ/WRITE: number of bytes, fail: -errno (-ECANCELED on write timeout)
+    int result;
+    // READ: received bytes, must be returned with tty_uring_release()
+    const char *data;
+    uint16_t bid;
+    /* READ: multishot read is still armed, if 0 tty_uring_read() has to be
+     * called again */
+    int more;
+} tty_uring_event_t;
+
+typedef struct tty_uring
+{
+    int fd;
+    struct
+    {
+        void *ptr;
+        size_t size;
+        uint32_t *head;
+        uint32_t *tail;
+        uint32_t *array;
+        uint32_t mask;
+        uint32_t entries;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+        // link timeouts, indexed by sqe, valid until submitted
+        struct __kernel_timespec *timeouts;
+        uint32_t local_tail;
+        // IORING_SQ_CQ_OVERFLOW
+        uint32_t *flags;
+    } sq;
+    struct
+    {
+        void *ptr;
+        size_t size;
+        uint32_t *head;
+        uint32_t *tail;
+        uint32_t mask;
+        struct io_uring_cqe *cqes;
+        // completions lost by kernel, last value reported
+        uint32_t *overflow;
+        uint32_t dropped;
+    } cq;
+    struct
+    {
+        struct io_uring_buf_ring *ring;
+        size_t ring_size;
+        char *mem;
+        size_t buf_size;
+        uint16_t buf_num;
+        uint16_t tail;
+    } pbuf;
+    // READ_MULTISHOT if supported by kernel, READ otherwise (re-armed)
+    uint8_t read_op;
+} tty_uring_t;
+
+/* return: 0 on success, -errno if io_uring is not available (caller should
+ * fallback to poll based tty_read/tty_write)
+ * buf_num: power of 2 */
+int tty_uring_init(
+    tty_uring_t *, unsigned entries, size_t buf_size, unsigned buf_num);
+void tty_uring_deinit(tty_uring_t *);
+// arm multishot read, data is delivered into provided buffers
+void tty_uring_read(tty_uring_t *, tty_dev_t *, uint64_t user_data);
+/* write [begin, end) linked with timeout_us (-1 no timeout)
+ * [begin, end) must stay valid until completion is reaped */
+void tty_uring_write(
+    tty_uring_t *,
+    tty_dev_t *,
+    const char *begin,
+    const char *end,
+    int timeout_us,
+    uint64_t user_data);
+/* gather variant of tty_uring_write(), iov (array and segments) must stay
+ * valid until completion is reaped */
+void tty_uring_writev(
+    tty_uring_t *,
+    tty_dev_t *,
+    const struct iovec *iov,
+    int iovcnt,
+    int timeout_us,
+    uint64_t user_data);
+/* submit pending requests and wait for at least min_complete completions
+ * (timeout_us: -1 infinite)
+ * return: number of submitted requests */
+int tty_uring_submit(tty_uring_t *, unsigned min_complete, int timeout_us);
+/* completions held back by kernel (CQ overflow) are flushed once CQ is
+ * drained
+ * return: number of events stored in [begin, end) */
+size_t tty_uring_reap(
+    tty_uring_t *, tty_uring_event_t *begin, const tty_uring_event_t *end);
+// return buffer of READ event back to the kernel
+void tty_uring_release(tty_uring_t *, const tty_uring_event_t *);
+// return: 1 READ stays armed until !event.more, 0 every READ is single shot
+int tty_uring_multishot(const tty_uring_t *);
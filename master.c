@@ -56,22 +56,86 @@ const void *valid_crc(const void *const adu, const size_t adu_size)
     return valid_crc_impl(begin, end);
 }
 
+// max number of coils/inputs (FC1/FC2) and coils (FC15)
+#define RD_BITS_MAX UINT16_C(0x7D0)
+#define WR_BITS_MAX UINT16_C(0x7B0)
+
+#define BITS_TO_BYTES(n) (((n) + 7u) / 8u)
+
+static char *make_request_mem_access(
+    const addr_t slave_addr,
+    const fcode_t fcode,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    char *const dst,
+    const size_t max_size)
+{
+    if (sizeof(modbus_rtu_mem_access_request_t) > max_size) return NULL;
+
+    modbus_rtu_mem_access_request_t req
+        = {.addr     = slave_addr,
+           .fcode    = fcode,
+           .mem_addr = mem_addr,
+           .count    = count};
+
+    if (!implace_crc(&req, sizeof(req))) return NULL;
+    memcpy(dst, &req, sizeof(req));
+    return dst + sizeof(req);
+}
+
+static const modbus_rtu_rd_bits_reply_t *
+parse_reply_rd_bits(const void *adu, size_t adu_size)
+{
+    const size_t expected_min_size
+        = sizeof(modbus_rtu_rd_bits_reply_header_t) + sizeof(crc_t);
+
+    if (expected_min_size > adu_size) return NULL;
+
+    const modbus_rtu_rd_bits_reply_t *reply = adu;
+
+    if (expected_min_size + reply->header.byte_count != adu_size) return NULL;
+    if (!valid_crc(adu, adu_size)) return NULL;
+    return reply;
+}
+
 char *make_request_rd_coils(
     const addr_t slave_addr,
     const mem_addr_t mem_addr,
-    const uint8_t count,
+    const count_t count,
     char *const dst,
     const size_t max_size)
 {
     if (!dst) return NULL;
-    if (UINT8_C(0x7D) < count) return NULL;
+    if (!COUNT_TO_WORD(count) || RD_BITS_MAX < COUNT_TO_WORD(count))
+        return NULL;
+    return make_request_mem_access(
+        slave_addr, FCODE_RD_COILS, mem_addr, count, dst, max_size);
+}
 
-    const char req[] = {slave_addr,   FCODE_RD_COILS, mem_addr.high,
-                        mem_addr.low, UINT8_C(0),     count};
+const modbus_rtu_rd_coils_reply_t *
+parse_reply_rd_coils(const void *adu, size_t adu_size)
+{
+    return parse_reply_rd_bits(adu, adu_size);
+}
 
-    if (sizeof(req) > max_size) return NULL;
-    memcpy(dst, req, sizeof(req));
-    return implace_crc_impl(dst, dst + sizeof(req), max_size);
+char *make_request_rd_inputs(
+    const addr_t slave_addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    char *const dst,
+    const size_t max_size)
+{
+    if (!dst) return NULL;
+    if (!COUNT_TO_WORD(count) || RD_BITS_MAX < COUNT_TO_WORD(count))
+        return NULL;
+    return make_request_mem_access(
+        slave_addr, FCODE_RD_INPUT, mem_addr, count, dst, max_size);
+}
+
+const modbus_rtu_rd_inputs_reply_t *
+parse_reply_rd_inputs(const void *adu, size_t adu_size)
+{
+    return parse_reply_rd_bits(adu, adu_size);
 }
 
 char *make_request_rd_holding_registers(
@@ -113,6 +177,26 @@ parse_reply_rd_holding_registers(const void *adu, size_t adu_size)
     return reply;
 }
 
+char *make_request_rd_input_registers(
+    const addr_t slave_addr,
+    const mem_addr_t mem_addr,
+    const count_t count,
+    char *const dst,
+    const size_t max_size)
+{
+    if (!dst) return NULL;
+    if (!COUNT_TO_WORD(count) || UINT8_C(0x7D) < COUNT_TO_WORD(count))
+        return NULL;
+    return make_request_mem_access(
+        slave_addr, FCODE_RD_IN_REGISTERS, mem_addr, count, dst, max_size);
+}
+
+const modbus_rtu_rd_input_registers_reply_t *
+parse_reply_rd_input_registers(const void *adu, size_t adu_size)
+{
+    return parse_reply_rd_holding_registers(adu, adu_size);
+}
+
 char *make_request_wr_coil(
     const addr_t slave_addr,
     const mem_addr_t mem_addr,
@@ -131,6 +215,14 @@ char *make_request_wr_coil(
     return implace_crc_impl(dst, dst + sizeof(req), max_size);
 }
 
+const modbus_rtu_wr_coil_reply_t *
+parse_reply_wr_coil(const void *adu, size_t adu_size)
+{
+    if (sizeof(modbus_rtu_wr_coil_reply_t) != adu_size) return NULL;
+    if (!valid_crc(adu, adu_size)) return NULL;
+    return adu;
+}
+
 char *make_request_wr_register(
     const addr_t slave_addr,
     const mem_addr_t mem_addr,
@@ -208,6 +300,94 @@ parse_reply_wr_registers(const void *const adu, const size_t adu_size)
     return adu;
 }
 
+char *make_request_wr_coils(
+    const addr_t slave_addr,
+    const mem_addr_t mem_addr,
+    const uint8_t *const bits,
+    const count_t count,
+    char *const dst,
+    const size_t max_size)
+{
+    if (!bits || !dst) return NULL;
+    if (!COUNT_TO_WORD(count) || WR_BITS_MAX < COUNT_TO_WORD(count))
+        return NULL;
+
+    const size_t data_size = BITS_TO_BYTES(COUNT_TO_WORD(count));
+    const size_t expected_size
+        = sizeof(modbus_rtu_wr_coils_request_header_t) + data_size
+        + sizeof(crc_t);
+
+    if (expected_size > max_size) return NULL;
+
+    const modbus_rtu_wr_coils_request_header_t req_header
+        = {.addr       = slave_addr,
+           .fcode      = FCODE_WR_COILS,
+           .mem_addr   = mem_addr,
+           .count      = count,
+           .byte_count = (uint8_t)data_size};
+
+    char *curr = dst;
+
+    memcpy(curr, &req_header, sizeof(req_header));
+    curr += sizeof(req_header);
+    memcpy(curr, bits, data_size);
+    curr += data_size;
+    return implace_crc_impl(dst, curr, max_size);
+}
+
+const modbus_rtu_wr_coils_reply_t *
+parse_reply_wr_coils(const void *const adu, const size_t adu_size)
+{
+    return parse_reply_wr_registers(adu, adu_size);
+}
+
+char *make_request_rd_wr_registers(
+    const addr_t slave_addr,
+    const mem_addr_t rd_mem_addr,
+    const count_t rd_count,
+    const mem_addr_t wr_mem_addr,
+    const data16_t *const wr_data,
+    const count_t wr_count,
+    char *const dst,
+    const size_t max_size)
+{
+    if (!wr_data || !dst) return NULL;
+    if (!COUNT_TO_WORD(rd_count) || UINT8_C(0x7D) < COUNT_TO_WORD(rd_count))
+        return NULL;
+    if (!COUNT_TO_WORD(wr_count) || UINT8_C(0x79) < COUNT_TO_WORD(wr_count))
+        return NULL;
+
+    const size_t data_size = COUNT_TO_WORD(wr_count) * sizeof(data16_t);
+    const size_t expected_size
+        = sizeof(modbus_rtu_rd_wr_registers_request_header_t) + data_size
+        + sizeof(crc_t);
+
+    if (expected_size > max_size) return NULL;
+
+    const modbus_rtu_rd_wr_registers_request_header_t req_header
+        = {.addr        = slave_addr,
+           .fcode       = FCODE_RD_WR_REGISTERS,
+           .rd_mem_addr = rd_mem_addr,
+           .rd_count    = rd_count,
+           .wr_mem_addr = wr_mem_addr,
+           .wr_count    = wr_count,
+           .byte_count  = (uint8_t)data_size};
+
+    char *curr = dst;
+
+    memcpy(curr, &req_header, sizeof(req_header));
+    curr += sizeof(req_header);
+    memcpy(curr, wr_data, data_size);
+    curr += data_size;
+    return implace_crc_impl(dst, curr, max_size);
+}
+
+const modbus_rtu_rd_wr_registers_reply_t *
+parse_reply_rd_wr_registers(const void *adu, size_t adu_size)
+{
+    return parse_reply_rd_holding_registers(adu, adu_size);
+}
+
 char *make_request_wr_bytes(
     addr_t slave_addr,
     mem_addr_t mem_addr,
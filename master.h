@@ -35,13 +35,51 @@ typedef struct __attribute__((packed))
 
 typedef modbus_rtu_mem_access_request_t modbus_rtu_rd_coils_request_t;
 
+/* count: 1 .. 2000 coils */
 char *make_request_rd_coils(
     modbus_rtu_addr_t,
     modbus_rtu_mem_addr_t,
-    uint8_t count,
+    modbus_rtu_count_t,
     char *dst,
     size_t max_size);
 
+typedef struct __attribute__((packed))
+{
+    modbus_rtu_addr_t addr;
+    modbus_rtu_fcode_t fcode;
+    uint8_t byte_count;
+} modbus_rtu_rd_bits_reply_header_t;
+
+/* state of coil/input mem_addr + i is bit (i % 8) of bits[i / 8], unused
+ * bits of last byte are 0 */
+typedef struct __attribute__((packed))
+{
+    modbus_rtu_rd_bits_reply_header_t header;
+    uint8_t bits[];
+} modbus_rtu_rd_bits_reply_t;
+
+typedef modbus_rtu_rd_bits_reply_t modbus_rtu_rd_coils_reply_t;
+
+const modbus_rtu_rd_coils_reply_t *
+parse_reply_rd_coils(const void *adu, size_t adu_size);
+
+/* FCODE_RD_INPUT ------------------------------------------------------------*/
+
+typedef modbus_rtu_mem_access_request_t modbus_rtu_rd_inputs_request_t;
+
+/* count: 1 .. 2000 inputs */
+char *make_request_rd_inputs(
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t,
+    char *dst,
+    size_t max_size);
+
+typedef modbus_rtu_rd_bits_reply_t modbus_rtu_rd_inputs_reply_t;
+
+const modbus_rtu_rd_inputs_reply_t *
+parse_reply_rd_inputs(const void *adu, size_t adu_size);
+
 /* FCODE_RD_HOLDING_REGISTERS ------------------------------------------------*/
 
 typedef modbus_rtu_mem_access_request_t
@@ -70,8 +108,29 @@ typedef struct __attribute__((packed))
 const modbus_rtu_rd_holding_registers_reply_t *
 parse_reply_rd_holding_registers(const void *adu, size_t adu_size);
 
+/* FCODE_RD_IN_REGISTERS -----------------------------------------------------*/
+
+typedef modbus_rtu_mem_access_request_t
+    modbus_rtu_rd_input_registers_request_t;
+
+char *make_request_rd_input_registers(
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    modbus_rtu_count_t,
+    char *dst,
+    size_t max_size);
+
+typedef modbus_rtu_rd_holding_registers_reply_header_t
+    modbus_rtu_rd_input_registers_reply_header_t;
+typedef modbus_rtu_rd_holding_registers_reply_t
+    modbus_rtu_rd_input_registers_reply_t;
+
+const modbus_rtu_rd_input_registers_reply_t *
+parse_reply_rd_input_registers(const void *adu, size_t adu_size);
+
 /* FCODE_WR_COIL -------------------------------------------------------------*/
 
+/* data: 0xFF (ON) or 0x00 (OFF) */
 char *make_request_wr_coil(
     modbus_rtu_addr_t,
     modbus_rtu_mem_addr_t,
@@ -79,6 +138,18 @@ char *make_request_wr_coil(
     char *dst,
     size_t max_size);
 
+typedef struct __attribute__((packed))
+{
+    modbus_rtu_addr_t addr;
+    modbus_rtu_fcode_t fcode;
+    modbus_rtu_mem_addr_t mem_addr;
+    modbus_rtu_data16_t data;
+    modbus_rtu_crc_t crc;
+} modbus_rtu_wr_coil_reply_t;
+
+const modbus_rtu_wr_coil_reply_t *
+parse_reply_wr_coil(const void *adu, size_t adu_size);
+
 /* FCODE_WR_REGISTER ---------------------------------------------------------*/
 
 typedef struct __attribute__((packed))
@@ -135,6 +206,64 @@ typedef struct __attribute__((packed))
 const modbus_rtu_wr_registers_reply_t *
 parse_reply_wr_registers(const void *adu, size_t adu_size);
 
+/* FCODE_WR_COILS ------------------------------------------------------------*/
+
+typedef struct __attribute__((packed))
+{
+    modbus_rtu_addr_t addr;
+    modbus_rtu_fcode_t fcode;
+    modbus_rtu_mem_addr_t mem_addr;
+    modbus_rtu_count_t count;
+    uint8_t byte_count;
+} modbus_rtu_wr_coils_request_header_t;
+
+/* bits: packed as in modbus_rtu_rd_bits_reply_t, count: 1 .. 1968 coils */
+char *make_request_wr_coils(
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t,
+    const uint8_t *bits,
+    modbus_rtu_count_t,
+    char *dst,
+    size_t max_size);
+
+typedef modbus_rtu_wr_registers_reply_t modbus_rtu_wr_coils_reply_t;
+
+const modbus_rtu_wr_coils_reply_t *
+parse_reply_wr_coils(const void *adu, size_t adu_size);
+
+/* FCODE_RD_WR_REGISTERS -----------------------------------------------------*/
+
+typedef struct __attribute__((packed))
+{
+    modbus_rtu_addr_t addr;
+    modbus_rtu_fcode_t fcode;
+    modbus_rtu_mem_addr_t rd_mem_addr;
+    modbus_rtu_count_t rd_count;
+    modbus_rtu_mem_addr_t wr_mem_addr;
+    modbus_rtu_count_t wr_count;
+    uint8_t byte_count;
+} modbus_rtu_rd_wr_registers_request_header_t;
+
+/* write is executed before read (single round trip)
+ * rd count: 1 .. 125 registers, wr count: 1 .. 121 registers */
+char *make_request_rd_wr_registers(
+    modbus_rtu_addr_t,
+    modbus_rtu_mem_addr_t rd_mem_addr,
+    modbus_rtu_count_t rd_count,
+    modbus_rtu_mem_addr_t wr_mem_addr,
+    const modbus_rtu_data16_t *wr_data,
+    modbus_rtu_count_t wr_count,
+    char *dst,
+    size_t max_size);
+
+typedef modbus_rtu_rd_holding_registers_reply_header_t
+    modbus_rtu_rd_wr_registers_reply_header_t;
+typedef modbus_rtu_rd_holding_registers_reply_t
+    modbus_rtu_rd_wr_registers_reply_t;
+
+const modbus_rtu_rd_wr_registers_reply_t *
+parse_reply_rd_wr_registers(const void *adu, size_t adu_size);
+
 /* FCODE_WR_BYTES ------------------------------------------------------------*/
 
 typedef struct __attribute__((packed))
@@ -0,0 +1,37 @@
+include linux/Makefile.defs
+
+TARGET = master_linux
+
+CFLAGS += \
+	-DRTU_MEMORY_ADDR=0x1000 \
+	-DRTU_MEMORY_SIZE=1024 \
+	-DTLOG_SIZE=4096 \
+	-DTTY_ASYNC_LOW_LATENCY \
+	-I . \
+	-I linux \
+	-Wfatal-errors
+
+LDFLAGS += -lrt -lpthread
+
+CSRCS = \
+	linux/crc.c \
+	linux/gnu.c \
+	linux/log.c \
+	linux/master_bits.c \
+	linux/master_impl.c \
+	linux/master_main.c \
+	linux/master_trace.c \
+	linux/pipe.c \
+	linux/rtu_impl.c \
+	linux/rtu_log_impl.c \
+	linux/spsc.c \
+	linux/termios2.c \
+	linux/time_util.c \
+	linux/tty.c \
+	linux/tty_uring.c \
+	linux/util.c \
+	master.c \
+	rtu.c \
+	rtu_memory.c
+
+include linux/Makefile.rules
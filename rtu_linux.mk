@@ -18,9 +18,12 @@ CSRCS = \
 	linux/crc.c \
 	linux/gnu.c \
 	linux/log.c \
+	linux/pipe.c \
 	linux/rtu_impl.c \
 	linux/rtu_log_impl.c \
 	linux/rtu_main.c \
+	linux/spsc.c \
+	linux/termios2.c \
 	linux/time_util.c \
 	linux/tty.c \
 	linux/util.c \
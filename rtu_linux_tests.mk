@@ -19,13 +19,24 @@ CSRCS = \
 	linux/crc.c \
 	linux/gnu.c \
 	linux/log.c \
+	linux/master_async.c \
+	linux/master_bits.c \
+	linux/master_coalesce.c \
+	linux/master_decode.c \
 	linux/master_impl.c \
+	linux/master_mirror.c \
+	linux/master_sched.c \
+	linux/master_shared.c \
+	linux/master_trace.c \
 	linux/pipe.c \
 	linux/rtu_impl.c \
 	linux/rtu_log_impl.c \
+	linux/spsc.c \
+	linux/termios2.c \
 	linux/tests/rtu_tests.c \
 	linux/time_util.c \
 	linux/tty.c \
+	linux/tty_uring.c \
 	linux/tty_pair.c \
 	linux/util.c \
 	master.c \
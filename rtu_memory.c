@@ -207,6 +207,88 @@ static uint8_t *write_n16(
 }
 #endif /* MODBUS_RTU_MEMORY_WR_REGISTERS_DISABLED */
 
+#ifndef MODBUS_RTU_MEMORY_RD_WR_REGISTERS_DISABLED
+static uint8_t *read_write_n16(
+    rtu_memory_t *rtu_memory,
+    const uint8_t *begin,
+    const uint8_t *end,
+    const uint8_t *curr,
+    uint8_t *reply)
+{
+    const uint16_t rtu_mem_begin = rtu_memory->header.addr_begin;
+    const uint16_t rtu_mem_end   = rtu_memory->header.addr_end;
+    const uint8_t request_size
+        = 1 /* fcode */ + 2 /* rd addr */ + 2 /* rd num */ + 2 /* wr addr */
+        + 2 /* wr num */ + 1 /* byte count */;
+
+    RETURN_EXCEPTION_IF(
+        request_size > end - begin, FCODE_RD_WR_REGISTERS, ECODE_FORMAT_ERROR,
+        reply);
+
+    const uint16_t rd_addr = rd16(curr);
+    curr += sizeof(rd_addr);
+    const uint16_t rd_num = rd16(curr);
+    curr += sizeof(rd_num);
+    const uint16_t wr_addr = rd16(curr);
+    curr += sizeof(wr_addr);
+    const uint16_t wr_num = rd16(curr);
+    curr += sizeof(wr_num);
+    const uint8_t byte_count = *curr;
+    curr += sizeof(byte_count);
+
+    RETURN_EXCEPTION_IF_NOT(
+        0 < rd_num && 0x7E > rd_num && 0 < wr_num && 0x7A > wr_num
+            && byte_count == (wr_num << 1),
+        FCODE_RD_WR_REGISTERS, ECODE_ILLEGAL_DATA_VALUE, reply);
+
+    RETURN_EXCEPTION_IF(
+        byte_count != end - curr, FCODE_RD_WR_REGISTERS, ECODE_FORMAT_ERROR,
+        reply);
+
+    RETURN_EXCEPTION_IF_NOT(
+        rtu_mem_begin <= rd_addr && rtu_mem_end >= rd_addr + rd_num
+            && rtu_mem_begin <= wr_addr && rtu_mem_end >= wr_addr + wr_num,
+        FCODE_RD_WR_REGISTERS, ECODE_ILLEGAL_DATA_ADDRESS, reply);
+
+    /* validate all registers first, write is not applied partially */
+    for (const uint8_t *data = curr; data != end; data += 2)
+    {
+        RETURN_EXCEPTION_IF(
+            *data, FCODE_RD_WR_REGISTERS, ECODE_ILLEGAL_DATA_VALUE, reply);
+    }
+
+    #ifdef DEBUG_RTU_MEMORY
+    RTU_LOG_DBG16("nRW", rd_addr);
+    RTU_LOG_DBG16("nRW", wr_addr);
+    #endif
+
+    /* write is executed before read */
+    uint16_t addr_begin = wr_addr - rtu_mem_begin;
+    uint16_t addr_end   = addr_begin + wr_num;
+
+    for (; addr_begin != addr_end; ++addr_begin)
+    {
+        rtu_memory->bytes[addr_begin] = (uint8_t)rd16(curr);
+        curr += 2;
+    }
+
+    /* fcode */
+    *reply++ = (uint8_t)FCODE_RD_WR_REGISTERS;
+    /* byte count */
+    *reply++ = (uint8_t)(rd_num << 1);
+
+    addr_begin = rd_addr - rtu_mem_begin;
+    addr_end   = addr_begin + rd_num;
+
+    for (; addr_begin != addr_end; ++addr_begin)
+    {
+        reply = wr16(reply, rtu_memory->bytes[addr_begin]);
+    }
+
+    return reply;
+}
+#endif /* MODBUS_RTU_MEMORY_RD_WR_REGISTERS_DISABLED */
+
 static uint8_t *read_n8(
     rtu_memory_t *rtu_memory,
     const uint8_t *begin,
@@ -341,6 +423,14 @@ uint8_t *rtu_memory_pdu_cb(
     }
 #endif
 
+#ifndef MODBUS_RTU_MEMORY_RD_WR_REGISTERS_DISABLED
+    if (FCODE_RD_WR_REGISTERS == fcode)
+    {
+        dst_begin = read_write_n16(rtu_memory, begin, end, curr, dst_begin);
+        goto exit;
+    }
+#endif
+
     if (FCODE_RD_BYTES == fcode)
     {
         dst_begin = read_n8(rtu_memory, begin, end, curr, dst_begin);
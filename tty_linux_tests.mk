@@ -15,10 +15,12 @@ CSRCS = \
 	linux/buf.c \
 	linux/gnu.c \
 	linux/log.c \
+	linux/termios2.c \
 	linux/tests/tty_dev_tests.c \
 	linux/time_util.c \
 	linux/tty.c \
 	linux/tty_pair.c \
+	linux/tty_uring.c \
 	linux/util.c
 
 include linux/Makefile.rules